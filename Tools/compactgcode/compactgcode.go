@@ -0,0 +1,438 @@
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"errors"
+	"flag"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"log"
+	"os"
+	"strconv"
+	"strings"
+)
+
+// These must match class CompactFileGCodeInput in src/GCodes/GCodeInput.h
+const (
+	magic         = "RRFCGC"
+	formatVersion = 1
+	headerSize    = 8
+	blockSize     = 1024
+	maxTextLength = 160
+
+	recordPadding  = 0x00
+	recordTextLine = 0x01
+	recordMoveG0   = 0x10
+
+	numFields         = 7
+	numRelativeFields = 4
+)
+
+var fieldLetters = "XYZEFIJ"
+var fieldDecimals = []int{3, 3, 3, 5, 1, 3, 3}
+
+func main() {
+	in := flag.String("i", "-", "Path to input file or \"-\" for stdin")
+	out := flag.String("o", "-", "Path to output file or \"-\" for stdout")
+	decode := flag.Bool("d", false, "Decode a compact file to GCode instead of encoding")
+	verify := flag.Bool("verify", false, "Encode the input, decode the result and check that it matches the input")
+	flag.Parse()
+
+	var input []byte
+	var err error
+	if *in == "-" {
+		input, err = ioutil.ReadAll(os.Stdin)
+	} else {
+		input, err = ioutil.ReadFile(*in)
+	}
+	if err != nil {
+		log.Fatal(err)
+	}
+
+	if *verify {
+		if err := verifyRoundTrip(input); err != nil {
+			log.Fatal(err)
+		}
+		return
+	}
+
+	var output []byte
+	if *decode {
+		lines, err := decodeFile(input)
+		if err != nil {
+			log.Fatal(err)
+		}
+		output = []byte(strings.Join(lines, "\n") + "\n")
+	} else {
+		output, _, err = encodeFile(input)
+		if err != nil {
+			log.Fatal(err)
+		}
+	}
+
+	if *out == "-" {
+		_, err = os.Stdout.Write(output)
+	} else {
+		err = ioutil.WriteFile(*out, output, 0644)
+	}
+	if err != nil {
+		log.Fatal(err)
+	}
+}
+
+// splitCommands strips the comment from a line and splits it into commands in the same way as the firmware does,
+// i.e. a G or M that is preceded by a space or tab and is not inside a quoted string starts a new command
+func splitCommands(line string) []string {
+	inQuotes := false
+	if i := strings.IndexFunc(line, func(r rune) bool {
+		if r == '"' {
+			inQuotes = !inQuotes
+		}
+		return r == ';' && !inQuotes
+	}); i >= 0 {
+		line = line[:i]
+	}
+	line = strings.TrimSpace(line)
+
+	var commands []string
+	inQuotes = false
+	primed := false
+	start := 0
+	for i, c := range line {
+		if c == '"' {
+			inQuotes = !inQuotes
+			primed = false
+		} else if !inQuotes {
+			if primed && (c == 'G' || c == 'g' || c == 'M' || c == 'm') {
+				commands = append(commands, strings.TrimSpace(line[start:i]))
+				start = i
+			}
+			primed = c == ' ' || c == '\t'
+		}
+	}
+	if start < len(line) {
+		commands = append(commands, strings.TrimSpace(line[start:]))
+	}
+	return commands
+}
+
+// parseFixed converts a decimal number to an integer number of units of 10^-decimals, if it can be represented exactly
+func parseFixed(s string, decimals int) (int32, bool) {
+	negative := false
+	if strings.HasPrefix(s, "-") {
+		negative = true
+		s = s[1:]
+	}
+	intPart, fracPart := s, ""
+	if i := strings.IndexByte(s, '.'); i >= 0 {
+		intPart, fracPart = s[:i], s[i+1:]
+	}
+	if intPart == "" && fracPart == "" {
+		return 0, false
+	}
+	for _, c := range intPart + fracPart {
+		if c < '0' || c > '9' {
+			return 0, false
+		}
+	}
+	fracPart = strings.TrimRight(fracPart, "0")
+	if len(fracPart) > decimals {
+		return 0, false
+	}
+	fracPart += strings.Repeat("0", decimals-len(fracPart))
+	v, err := strconv.ParseInt(intPart+fracPart, 10, 32)
+	if err != nil {
+		return 0, false
+	}
+	if negative {
+		v = -v
+	}
+	return int32(v), true
+}
+
+type move struct {
+	command int
+	mask    uint8
+	values  [numFields]int32
+}
+
+// parseMove returns the move if the command is a G0..G3 command that we can encode exactly
+func parseMove(cmd string) (move, bool) {
+	var m move
+	fields := strings.Fields(cmd)
+	if len(fields) == 0 || len(fields[0]) < 2 || fields[0][0] != 'G' {
+		return m, false
+	}
+	n, err := strconv.Atoi(fields[0][1:])
+	if err != nil || n < 0 || n > 3 || strings.ContainsAny(fields[0][1:], "+-") {
+		return m, false
+	}
+	m.command = n
+	for _, f := range fields[1:] {
+		field := strings.IndexByte(fieldLetters, f[0])
+		if field < 0 || m.mask&(1<<field) != 0 {
+			return m, false
+		}
+		v, ok := parseFixed(f[1:], fieldDecimals[field])
+		if !ok {
+			return m, false
+		}
+		m.mask |= 1 << field
+		m.values[field] = v
+	}
+	return m, true
+}
+
+func appendVarint(b []byte, v uint32) []byte {
+	for v >= 0x80 {
+		b = append(b, byte(v)|0x80)
+		v >>= 7
+	}
+	return append(b, byte(v))
+}
+
+func zigzag(v int32) uint32 {
+	return uint32(v<<1) ^ uint32(v>>31)
+}
+
+type encoder struct {
+	out         []byte
+	lastValues  [numRelativeFields]int32
+	lastBlock   int
+	lastF       int32
+	haveLastF   bool
+	numMoves    int
+	numText     int
+	numComments int
+}
+
+func (e *encoder) encodeMove(m move) []byte {
+	rec := []byte{byte(recordMoveG0 + m.command), 0}
+	for field := 0; field < numFields; field++ {
+		if m.mask&(1<<field) == 0 {
+			continue
+		}
+		v := m.values[field]
+		if field == 4 {
+			if e.haveLastF && v == e.lastF {
+				continue // the feed rate is modal, so we don't need to repeat it
+			}
+		}
+		if field < numRelativeFields {
+			v -= e.lastValues[field]
+		}
+		rec[1] |= 1 << field
+		rec = appendVarint(rec, zigzag(v))
+	}
+	return rec
+}
+
+// addRecord appends a record, padding to the next block boundary if it would otherwise cross it
+func (e *encoder) addRecord(makeRecord func() []byte) {
+	rec := makeRecord()
+	if len(e.out)%blockSize+len(rec) > blockSize {
+		for len(e.out)%blockSize != 0 {
+			e.out = append(e.out, recordPadding)
+		}
+	}
+	if block := len(e.out) / blockSize; block != e.lastBlock {
+		// The relative values are reset at the start of each block
+		e.lastBlock = block
+		e.lastValues = [numRelativeFields]int32{}
+		rec = makeRecord()
+	}
+	e.out = append(e.out, rec...)
+}
+
+func encodeFile(input []byte) ([]byte, []string, error) {
+	e := encoder{out: append([]byte(magic), formatVersion, 0)}
+	var commands []string
+	scanner := bufio.NewScanner(bytes.NewReader(input))
+	scanner.Buffer(make([]byte, 64*1024), 1024*1024)
+	lineNumber := 0
+	for scanner.Scan() {
+		lineNumber++
+		if line := strings.TrimSpace(scanner.Text()); strings.HasPrefix(line, ";") {
+			// Keep whole-line comments so that the firmware can still find the slicer information in them
+			if len(line) > maxTextLength {
+				line = line[:maxTextLength]
+			}
+			e.addRecord(func() []byte {
+				return append(appendVarint([]byte{recordTextLine}, uint32(len(line))), line...)
+			})
+			commands = append(commands, line)
+			e.numComments++
+			continue
+		}
+		for _, cmd := range splitCommands(scanner.Text()) {
+			if m, ok := parseMove(cmd); ok {
+				e.addRecord(func() []byte { return e.encodeMove(m) })
+				for field := 0; field < numRelativeFields; field++ {
+					if m.mask&(1<<field) != 0 {
+						e.lastValues[field] = m.values[field]
+					}
+				}
+				if m.mask&(1<<4) != 0 {
+					e.lastF = m.values[4]
+					e.haveLastF = true
+				}
+				commands = append(commands, formatMove(m))
+				e.numMoves++
+			} else {
+				if len(cmd) > maxTextLength {
+					return nil, nil, fmt.Errorf("line %d: command is too long", lineNumber)
+				}
+				e.addRecord(func() []byte {
+					return append(appendVarint([]byte{recordTextLine}, uint32(len(cmd))), cmd...)
+				})
+				e.haveLastF = false // the command may change the feed rate
+				commands = append(commands, cmd)
+				e.numText++
+			}
+		}
+	}
+	if err := scanner.Err(); err != nil {
+		return nil, nil, err
+	}
+	log.Printf("%d moves, %d other commands, %d comments, %d bytes in, %d bytes out (%.1f%%)",
+		e.numMoves, e.numText, e.numComments, len(input), len(e.out), 100.0*float64(len(e.out))/float64(len(input)))
+	return e.out, commands, nil
+}
+
+func formatFixed(letter byte, v int32, decimals int) string {
+	sign := ""
+	mag := int64(v)
+	if mag < 0 {
+		sign = "-"
+		mag = -mag
+	}
+	scale := int64(1)
+	for i := 0; i < decimals; i++ {
+		scale *= 10
+	}
+	return fmt.Sprintf(" %c%s%d.%0*d", letter, sign, mag/scale, decimals, mag%scale)
+}
+
+// formatMove produces the same GCode as the firmware does when it decodes a move record
+func formatMove(m move) string {
+	s := fmt.Sprintf("G%d", m.command)
+	for field := 0; field < numFields; field++ {
+		if m.mask&(1<<field) != 0 {
+			s += formatFixed(fieldLetters[field], m.values[field], fieldDecimals[field])
+		}
+	}
+	return s
+}
+
+func readVarint(r *bytes.Reader) (uint32, error) {
+	var v uint32
+	for shift := uint(0); shift < 32; shift += 7 {
+		b, err := r.ReadByte()
+		if err != nil {
+			return 0, err
+		}
+		v |= uint32(b&0x7F) << shift
+		if b&0x80 == 0 {
+			return v, nil
+		}
+	}
+	return 0, errors.New("bad varint")
+}
+
+// decodeFile decodes a compact file in the same way as the firmware
+func decodeFile(input []byte) ([]string, error) {
+	if len(input) < headerSize || string(input[:len(magic)]) != magic {
+		return nil, errors.New("not a compact GCode file")
+	}
+	if input[len(magic)] != formatVersion {
+		return nil, fmt.Errorf("unsupported format version %d", input[len(magic)])
+	}
+	r := bytes.NewReader(input[headerSize:])
+	var lines []string
+	var lastValues [numRelativeFields]int32
+	lastBlock := 0
+	for {
+		offset := len(input) - r.Len()
+		recordType, err := r.ReadByte()
+		if err == io.EOF {
+			return lines, nil
+		}
+		if block := offset / blockSize; block != lastBlock {
+			lastBlock = block
+			lastValues = [numRelativeFields]int32{}
+		}
+		switch {
+		case recordType == recordPadding:
+
+		case recordType == recordTextLine:
+			n, err := readVarint(r)
+			if err != nil || n > maxTextLength || int(n) > r.Len() {
+				return nil, fmt.Errorf("bad text record at offset %d", offset)
+			}
+			text := make([]byte, n)
+			r.Read(text)
+			lines = append(lines, string(text))
+
+		case recordType >= recordMoveG0 && recordType <= recordMoveG0+3:
+			mask, err := r.ReadByte()
+			if err != nil || mask >= 1<<numFields {
+				return nil, fmt.Errorf("bad move record at offset %d", offset)
+			}
+			m := move{command: int(recordType - recordMoveG0), mask: mask}
+			for field := 0; field < numFields; field++ {
+				if mask&(1<<field) == 0 {
+					continue
+				}
+				u, err := readVarint(r)
+				if err != nil {
+					return nil, fmt.Errorf("bad move record at offset %d", offset)
+				}
+				v := int32(u>>1) ^ -int32(u&1)
+				if field < numRelativeFields {
+					v += lastValues[field]
+					lastValues[field] = v
+				}
+				m.values[field] = v
+			}
+			lines = append(lines, formatMove(m))
+
+		default:
+			return nil, fmt.Errorf("bad record type 0x%02x at offset %d", recordType, offset)
+		}
+	}
+}
+
+// verifyRoundTrip encodes the input, decodes it again and checks that we get the same commands back.
+// Moves whose feed rate is the same as the previous move lose the repeated F parameter, which doesn't change their meaning.
+func verifyRoundTrip(input []byte) error {
+	encoded, commands, err := encodeFile(input)
+	if err != nil {
+		return err
+	}
+	decoded, err := decodeFile(encoded)
+	if err != nil {
+		return err
+	}
+	if len(decoded) != len(commands) {
+		return fmt.Errorf("encoded %d commands but decoded %d", len(commands), len(decoded))
+	}
+	for i := range commands {
+		if decoded[i] != commands[i] && decoded[i] != stripF(commands[i]) {
+			return fmt.Errorf("command %d: expected \"%s\" but decoded \"%s\"", i+1, commands[i], decoded[i])
+		}
+	}
+	log.Printf("verified %d commands", len(commands))
+	return nil
+}
+
+func stripF(cmd string) string {
+	if i := strings.Index(cmd, " F"); i >= 0 {
+		if j := strings.IndexByte(cmd[i+1:], ' '); j >= 0 {
+			return cmd[:i] + cmd[i+1+j:]
+		}
+		return cmd[:i]
+	}
+	return cmd
+}
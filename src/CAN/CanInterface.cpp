@@ -13,12 +13,15 @@
 #include "CanSender.h"
 #include "Movement/DDA.h"
 #include "Movement/DriveMovement.h"
+#include "Platform.h"
+#include "RepRap.h"
 
 const unsigned int NumCanBuffers = 40;
 
 const size_t NumCanBoards = (MaxCanDrivers + DriversPerCanBoard - 1)/DriversPerCanBoard;
 
 static CanMessageBuffer *movementBuffers[NumCanBoards];
+static bool movementIncomplete = false;						// true if we couldn't allocate a buffer for one of the boards in the move being prepared
 
 // CanMovementMessage is declared in project Duet3Expansion, so we need to implement its members here
 void CanMovementMessage::DebugPrint()
@@ -49,6 +52,7 @@ void CanInterface::StartMovement(const DDA& dda)
 	{
 		CanMessageBuffer::Free(mb);
 	}
+	movementIncomplete = false;
 }
 
 // This is called by DDA::Prepare for each active CAN DM in the move
@@ -62,7 +66,8 @@ void CanInterface::AddMovement(const DDA& dda, const PrepParams& params, size_t
 		buf = CanMessageBuffer::Allocate();
 		if (buf == nullptr)
 		{
-			return;		//TODO error handling
+			movementIncomplete = true;				// FinishMovement will discard the whole move
+			return;
 		}
 
 		buf->expansionBoardId = expansionBoardNumber + 1;
@@ -95,8 +100,20 @@ void CanInterface::AddMovement(const DDA& dda, const PrepParams& params, size_t
 }
 
 // This is called by DDA::Prepare when all DMs for CAN drives` have been processed
+// We send the move to all the boards involved or to none of them, so that a board never executes part of a move
 void CanInterface::FinishMovement(uint32_t moveStartTime)
 {
+	if (movementIncomplete)
+	{
+		for (CanMessageBuffer*& buf : movementBuffers)
+		{
+			CanMessageBuffer::Free(buf);
+		}
+		movementIncomplete = false;
+		reprap.GetPlatform().Message(ErrorMessage, "Out of CAN buffers, move not sent to expansion boards\n");
+		return;
+	}
+
 	for (CanMessageBuffer*& buf : movementBuffers)
 	{
 		if (buf != nullptr)
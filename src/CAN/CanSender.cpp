@@ -395,6 +395,7 @@ void CanSender::Send(CanMessageBuffer *buf)
 	else
 	{
 		lastBuffer->next = buf;
+		lastBuffer = buf;
 	}
 	canSenderTask.Give();
 }
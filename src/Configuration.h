@@ -49,6 +49,8 @@ constexpr float DefaultEInstantDv = 2.0;
 
 constexpr float DefaultMinFeedrate = 0.5;				// The minimum movement speed (extruding moves will go slower than this if the extrusion rate demands it)
 
+constexpr float DefaultFilamentDiameter = 1.75;			// mm, used to convert a tool's maximum volumetric flow rate to an extrusion speed
+
 constexpr float DefaultAxisMinimum = 0.0;
 constexpr float DefaultAxisMaximum = 200.0;
 
@@ -289,7 +291,7 @@ constexpr float DefaultG0FeedRate = 18000;				// The initial feed rate for G0 co
 constexpr float DefaultRetractSpeed = 1000.0;			// The default firmware retraction and un-retraction speed, in mm
 constexpr float DefaultRetractLength = 2.0;
 
-constexpr float MaxArcDeviation = 0.02;					// maximum deviation from ideal arc due to segmentation
+constexpr float DefaultSegmentDeviation = 0.02;			// default maximum deviation from the ideal path due to segmentation, configurable using M669 E
 constexpr float MinArcSegmentLength = 0.1;				// G2 and G3 arc movement commands get split into segments at least this long
 constexpr float MaxArcSegmentLength = 2.0;				// G2 and G3 arc movement commands get split into segments at most this long
 constexpr float MinArcSegmentsPerSec = 50;
@@ -380,9 +380,47 @@ void GCodeBuffer::DecodeCommand()
 		commandEnd = gcodeLineEnd;
 	}
 
+	IndexParameters();
 	bufferState = GCodeBufferState::ready;
 }
 
+// Scan the parameters of the current command once and record where each parameter letter first occurs, so that Seen doesn't need to scan the command again.
+// Letters inside quoted strings and expressions are not parameters, nor is an E preceded by a digit because it is the exponent of a number.
+void GCodeBuffer::IndexParameters()
+{
+	memset(parameterIndex, NoParameter, sizeof(parameterIndex));
+	bool inQuotes = false;
+	unsigned int inBrackets = 0;
+	for (unsigned int i = parameterStart; i < commandEnd; ++i)
+	{
+		const char b = gcodeBuffer[i];
+		if (b == '"')
+		{
+			inQuotes = !inQuotes;
+		}
+		else if (!inQuotes)
+		{
+			if (inBrackets == 0 && isalpha(b))
+			{
+				const char c = toupper(b);
+				uint8_t& index = parameterIndex[c - 'A'];
+				if (index == NoParameter && (c != 'E' || i == parameterStart || !isdigit(gcodeBuffer[i - 1])))
+				{
+					index = (uint8_t)i;
+				}
+			}
+			else if (b == '[')
+			{
+				++inBrackets;
+			}
+			else if (b == ']' && inBrackets != 0)
+			{
+				--inBrackets;
+			}
+		}
+	}
+}
+
 // Add an entire string, overwriting any existing content and adding '\n' at the end if necessary to make it a complete line
 void GCodeBuffer::Put(const char *str, size_t len)
 {
@@ -439,6 +477,18 @@ FilePosition GCodeBuffer::GetFilePosition(size_t bytesCached) const
 // Is 'c' in the G Code string? 'c' must be uppercase.
 // Leave the pointer there for a subsequent read.
 bool GCodeBuffer::Seen(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+	{
+		const uint8_t index = parameterIndex[c - 'A'];
+		readPointer = (index == NoParameter) ? -1 : (int)index;
+		return index != NoParameter;
+	}
+	return ScanFor(c);
+}
+
+// Search the command for a character that is not in the parameter index. Leave the pointer there for a subsequent read.
+bool GCodeBuffer::ScanFor(char c)
 {
 	bool inQuotes = false;
 	unsigned int inBrackets = 0;
@@ -726,7 +776,11 @@ bool GCodeBuffer::InternalGetPossiblyQuotedString(const StringRef& str)
 	}
 #endif
 
-	commandEnd = gcodeLineEnd;				// the string is the remainder of the line of gcode
+	if (commandEnd != gcodeLineEnd)
+	{
+		commandEnd = gcodeLineEnd;			// the string is the remainder of the line of gcode
+		IndexParameters();
+	}
 	for (;;)
 	{
 		const char c = gcodeBuffer[readPointer++];
@@ -1269,7 +1323,7 @@ float GCodeBuffer::ReadFloatValue(const char *p, const char **endptr)
 	}
 #endif
 
-	return SafeStrtof(p, endptr);
+	return FastStrtof(p, endptr);
 }
 
 uint32_t GCodeBuffer::ReadUIValue(const char *p, const char **endptr)
@@ -93,6 +93,7 @@ public:
 
 	size_t CommandLength() const { return commandEnd - commandStart; }		// get the length of the current command
 	const char* CommandStart() const { return gcodeBuffer + commandStart; }	// get the start of the current command
+	void SetBytesRead(size_t n) { commandLength = n; }						// set how many bytes were read to build this command, for inputs that decode the characters
 
 	void PrintCommand(const StringRef& s) const;
 
@@ -119,6 +120,8 @@ private:
 	void StoreAndAddToChecksum(char c);
 	bool LineFinished();								// Deal with receiving end-of-line and return true if we have a command
 	void DecodeCommand();
+	void IndexParameters();								// Build the table of where each parameter letter is
+	bool ScanFor(char c);								// Search the command for a character that is not a parameter letter
 	bool InternalGetQuotedString(const StringRef& str)
 		pre (readPointer >= 0; gcodeBuffer[readPointer] == '"'; str.IsEmpty());
 	bool InternalGetPossiblyQuotedString(const StringRef& str)
@@ -142,6 +145,7 @@ private:
 	unsigned int commandLength;							// Number of characters we read to build this command including the final \r or \n
 	unsigned int gcodeLineEnd;							// Number of characters in the entire line of gcode
 	int readPointer;									// Where in the buffer to read next
+	uint8_t parameterIndex[26];							// Index in the buffer of the first occurrence of each parameter letter, or NoParameter if not present
 	GCodeBufferState bufferState;						// Idle, executing or paused
 
 	FileStore *fileBeingWritten;						// If we are copying GCodes to a file, which file it is
@@ -167,6 +171,9 @@ private:
 
 	bool queueCodes;									// Can we queue certain G-codes from this source?
 	bool binaryWriting;									// Executing gcode or writing binary file?
+
+	static constexpr uint8_t NoParameter = 0xFF;		// value in parameterIndex to indicate that the letter was not seen
+	static_assert(GCODE_LENGTH < NoParameter, "parameterIndex can't hold all buffer indices");
 };
 
 inline const char* GCodeBuffer::Buffer() const
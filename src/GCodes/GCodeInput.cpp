@@ -8,9 +8,14 @@
 #include "GCodeInput.h"
 
 #include "RepRap.h"
+#include "Platform.h"
 #include "GCodes.h"
 #include "GCodeBuffer.h"
 
+#if SUPPORT_FILE_READ_AHEAD
+# include "Movement/StepTimer.h"
+#endif
+
 bool GCodeInput::FillBuffer(GCodeBuffer *gb)
 {
 	const size_t bytesToPass = min<size_t>(BytesCached(), GCODE_LENGTH);
@@ -212,11 +217,28 @@ bool NetworkGCodeInput::FillBuffer(GCodeBuffer *gb) /*override*/
 
 // File-based G-code input source
 
+#if SUPPORT_FILE_READ_AHEAD
+FileGCodeInput::FileGCodeInput() : GCodeInput(), lastFile(nullptr)
+#else
+FileGCodeInput::FileGCodeInput() : RegularGCodeInput(), lastFile(nullptr)
+#endif
+{
+#if SUPPORT_FILE_READ_AHEAD
+	ResetReadAhead();
+	bytesRead = readClocks = 0;
+	numReads = numStalls = 0;
+#endif
+}
+
 // Reset this input. Should be called when the associated file is being closed
 void FileGCodeInput::Reset()
 {
 	lastFile = nullptr;
+#if SUPPORT_FILE_READ_AHEAD
+	ResetReadAhead();
+#else
 	RegularGCodeInput::Reset();
+#endif
 }
 
 // Reset this input. Should be called when a specific G-code or macro file is closed outside of the reading context
@@ -228,6 +250,99 @@ void FileGCodeInput::Reset(const FileData &file)
 	}
 }
 
+#if SUPPORT_FILE_READ_AHEAD
+
+void FileGCodeInput::ResetReadAhead()
+{
+	blockLength[0] = blockLength[1] = 0;
+	readAheadPointer = 0;
+	readBlock = 0;
+}
+
+size_t FileGCodeInput::ReadAheadBytesCached() const
+{
+	return blockLength[readBlock] - readAheadPointer + blockLength[readBlock ^ 1];
+}
+
+size_t FileGCodeInput::BytesCached() const
+{
+	return ReadAheadBytesCached();
+}
+
+char FileGCodeInput::ReadByte()
+{
+	const char c = readAheadBuffer[readBlock][readAheadPointer++];
+	if (readAheadPointer == blockLength[readBlock])
+	{
+		// We have finished with this block, so it can be refilled. Move on to the other one, which may be empty too.
+		blockLength[readBlock] = 0;
+		readAheadPointer = 0;
+		readBlock ^= 1;
+	}
+	return c;
+}
+
+// Read another chunk of G-codes from the file and return true if more data is available
+GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file)
+{
+	const size_t bytesCached = ReadAheadBytesCached();
+
+	// Keep track of the last file we read from
+	if (lastFile != nullptr && lastFile != file.f)
+	{
+		if (bytesCached > 0)
+		{
+			// Rewind back to the right position so we can resume at the right position later.
+			// This may be necessary when nested macros are executed.
+			lastFile->Seek(lastFile->Position() - bytesCached);
+		}
+
+		ResetReadAhead();
+	}
+	lastFile = file.f;
+
+	// If a block is empty, fill it. We only read one block per call, so that if the other one has data then we can get on with parsing it.
+	const unsigned int fillBlock = (blockLength[readBlock] == 0) ? readBlock : readBlock ^ 1;
+	if (blockLength[fillBlock] == 0)
+	{
+		// Start reading at the current file position, but stop at a sector boundary so that subsequent reads are sector-aligned
+		const size_t bytesToRead = FileReadAheadBlockSize - (size_t)(file.GetPosition() % FileSectorSize);
+		const bool stalled = (ReadAheadBytesCached() == 0);			// true if we have nothing left to parse while we wait for the card
+		const uint32_t startClocks = StepTimer::GetInterruptClocks();
+		const int nbytes = file.Read(readAheadBuffer[fillBlock], bytesToRead);
+		if (nbytes < 0)
+		{
+			return GCodeInputReadResult::error;
+		}
+		if (nbytes > 0)
+		{
+			readClocks += StepTimer::GetInterruptClocks() - startClocks;
+			bytesRead += (uint32_t)nbytes;
+			++numReads;
+			if (stalled)
+			{
+				++numStalls;
+			}
+			blockLength[fillBlock] = (size_t)nbytes;
+			return GCodeInputReadResult::haveData;
+		}
+	}
+
+	return (ReadAheadBytesCached() > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::noData;
+}
+
+// Report and reset the read-ahead statistics
+void FileGCodeInput::Diagnostics(MessageType mtype)
+{
+	const float readSeconds = (float)readClocks/(float)StepTimer::StepClockRate;
+	reprap.GetPlatform().MessageF(mtype, "File read-ahead: %u reads, %" PRIu32 " bytes at %.1fKB/sec, %u stalls\n",
+									numReads, bytesRead, (readSeconds > 0.0) ? (double)((float)bytesRead/(readSeconds * 1024.0)) : 0.0, numStalls);
+	bytesRead = readClocks = 0;
+	numReads = numStalls = 0;
+}
+
+#else
+
 // Read another chunk of G-codes from the file and return true if more data is available
 GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file)
 {
@@ -274,4 +389,521 @@ GCodeInputReadResult FileGCodeInput::ReadFromFile(FileData &file)
 	return (bytesCached > 0) ? GCodeInputReadResult::haveData : GCodeInputReadResult::noData;
 }
 
+#endif
+
+#if SUPPORT_COMPACT_GCODE
+
+// Compact GCode file input
+
+static constexpr char CompactGCodeMagic[] = "RRFCGC";						// the first 6 bytes of the header, followed by the format version and a zero byte
+static constexpr char FieldLetters[] = "XYZEFIJ";
+static constexpr uint32_t FieldScales[] = { 1000, 1000, 1000, 100000, 10, 1000, 1000 };
+
+static_assert(ARRAY_SIZE(FieldScales) == ARRAY_SIZE(FieldLetters) - 1, "Wrong number of field scales");
+
+CompactFileGCodeInput::CompactFileGCodeInput()
+	: FileGCodeInput(), compactFile(nullptr), decodeOffset(0), recordStartOffset(0), currentBlock(0),
+	  recordLength(0), decoding(false), compactStateValid(false), hadError(false)
+{
+	ResetValues();
+}
+
+void CompactFileGCodeInput::Reset()
+{
+	if (lastFile != nullptr && lastFile == compactFile)
+	{
+		compactStateValid = false;
+	}
+	decoding = false;
+	recordLength = 0;
+	FileGCodeInput::Reset();
+}
+
+// Reset this input. This is called when a file is closed or its position is changed, so if it is the compact file then our decoding state is no longer valid.
+void CompactFileGCodeInput::Reset(const FileData &file)
+{
+	if (file.f == compactFile)
+	{
+		compactStateValid = false;
+	}
+	FileGCodeInput::Reset(file);
+}
+
+size_t CompactFileGCodeInput::BytesCached() const
+{
+	// The bytes of a partly-collected record have been read from the file but not yet executed
+	return FileGCodeInput::BytesCached() + recordLength;
+}
+
+GCodeInputReadResult CompactFileGCodeInput::ReadFromFile(FileData &file)
+{
+	if (hadError)
+	{
+		hadError = false;
+		return GCodeInputReadResult::error;
+	}
+
+	if (file.f != lastFile)
+	{
+		// We are starting to read a file, or returning to a file after running a macro
+		if (file.f == compactFile && compactStateValid)
+		{
+			decoding = true;
+		}
+		else if (!StartDecoding(file))
+		{
+			return GCodeInputReadResult::error;
+		}
+	}
+	return FileGCodeInput::ReadFromFile(file);
+}
+
+// Check the header of the file. If it is in compact format, set up the decoding state for its current position.
+// The file position may be anywhere in the file, for example when resuming a paused print. If it isn't at a record boundary then
+// we start from the record it is in. Return false if there was a file error or the file is in compact format but we can't decode it.
+bool CompactFileGCodeInput::StartDecoding(FileData& file)
+{
+	if (file.compactFormat == FileData::CompactFormat::notCompact)
+	{
+		// We checked the header when we started reading this file, so we don't need to read it again when we return to the file after a macro
+		decoding = false;
+		return true;
+	}
+
+	const FilePosition pos = file.GetPosition();
+	if (file.compactFormat == FileData::CompactFormat::unknown)
+	{
+		char header[HeaderSize];
+		if (!file.Seek(0))
+		{
+			return false;
+		}
+		const int nbytes = file.Read(header, HeaderSize);
+		if (nbytes < 0)
+		{
+			return false;
+		}
+
+		if (!IsCompactHeader(header, (size_t)nbytes))
+		{
+			// It's a normal GCode file
+			file.compactFormat = FileData::CompactFormat::notCompact;
+			if (file.f == compactFile)
+			{
+				compactFile = nullptr;
+			}
+			decoding = false;
+			return file.Seek(pos);
+		}
+
+		if ((uint8_t)header[strlen(CompactGCodeMagic)] != FormatVersion)
+		{
+			reprap.GetPlatform().MessageF(ErrorMessage, "Unsupported compact GCode file version %u\n", (unsigned int)(uint8_t)header[strlen(CompactGCodeMagic)]);
+			return false;
+		}
+		file.compactFormat = FileData::CompactFormat::compact;
+	}
+
+	compactFile = file.f;
+	decoding = true;
+	compactStateValid = false;
+
+	// The decoding state depends only on the records since the start of the block, so decode them without executing them
+	const FilePosition startPos = max<FilePosition>(pos, (FilePosition)HeaderSize);
+	FilePosition offset = max<FilePosition>(startPos - (startPos % CompactGCodeBlockSize), (FilePosition)HeaderSize);
+	currentBlock = offset/CompactGCodeBlockSize;
+	ResetValues();
+	recordLength = 0;
+	if (!file.Seek(offset))
+	{
+		return false;
+	}
+
+	String<GCODE_LENGTH> line;
+	while (offset < startPos)
+	{
+		char buf[64];
+		const int n = file.Read(buf, min<size_t>(sizeof(buf), startPos - offset));
+		if (n <= 0)
+		{
+			break;
+		}
+		for (int i = 0; i < n; ++i)
+		{
+			if (recordLength == 0)
+			{
+				recordStartOffset = offset;
+			}
+			record[recordLength++] = (uint8_t)buf[i];
+			++offset;
+			const RecordStatus st = CheckRecord();
+			if (st == RecordStatus::bad)
+			{
+				return false;
+			}
+			if (st == RecordStatus::complete)
+			{
+				(void)ApplyRecord(line.GetRef());
+				recordLength = 0;
+			}
+		}
+	}
+
+	// If we stopped part way through a record, resume from the start of it
+	decodeOffset = (recordLength != 0) ? recordStartOffset : offset;
+	recordLength = 0;
+	compactStateValid = true;
+	return file.Seek(decodeOffset);
+}
+
+bool CompactFileGCodeInput::FillBuffer(GCodeBuffer *gb)
+{
+	if (!decoding)
+	{
+		return FileGCodeInput::FillBuffer(gb);
+	}
+
+	while (FileGCodeInput::BytesCached() != 0)
+	{
+		if (recordLength == 0)
+		{
+			recordStartOffset = decodeOffset;
+		}
+		record[recordLength++] = (uint8_t)ReadByte();
+		++decodeOffset;
+
+		const RecordStatus st = CheckRecord();
+		if (st == RecordStatus::bad)
+		{
+			reprap.GetPlatform().MessageF(ErrorMessage, "Bad record in compact GCode file at offset %" PRIu32 "\n", recordStartOffset);
+			hadError = true;
+			recordLength = 0;
+			return false;
+		}
+
+		if (st == RecordStatus::complete)
+		{
+			String<GCODE_LENGTH> line;
+			const bool haveLine = ApplyRecord(line.GetRef());
+			const size_t bytesRead = recordLength;
+			recordLength = 0;
+			if (haveLine)
+			{
+				gb->Put(line.c_str(), line.strlen());
+				gb->SetBytesRead(bytesRead);				// so that the file position of the command is the start of the record
+				if (gb->IsWritingFile())
+				{
+					gb->WriteToFile();
+				}
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Read a varint from the record starting at 'index', returning false if we haven't collected all of it yet
+bool CompactFileGCodeInput::GetVarint(size_t& index, uint32_t& val) const
+{
+	return GetVarint(record, recordLength, index, val);
+}
+
+// Read a varint from the data starting at 'index', returning false if the data ends before the varint does
+/*static*/ bool CompactFileGCodeInput::GetVarint(const uint8_t *data, size_t length, size_t& index, uint32_t& val)
+{
+	val = 0;
+	for (unsigned int shift = 0; index < length && shift < 32; shift += 7)
+	{
+		const uint8_t b = data[index++];
+		val |= (uint32_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Check whether the record we have collected is complete
+CompactFileGCodeInput::RecordStatus CompactFileGCodeInput::CheckRecord() const
+{
+	const uint8_t recordType = record[0];
+	if (recordType == RecordType::padding)
+	{
+		return RecordStatus::complete;
+	}
+
+	size_t index = 1;
+	if (recordType == RecordType::textLine)
+	{
+		uint32_t len;
+		if (!GetVarint(index, len))
+		{
+			return (recordLength >= 3) ? RecordStatus::bad : RecordStatus::incomplete;	// the length of a valid text record fits in 2 bytes
+		}
+		return (len >= GCODE_LENGTH) ? RecordStatus::bad
+				: (recordLength >= index + len) ? RecordStatus::complete
+					: RecordStatus::incomplete;
+	}
+
+	if (recordType >= RecordType::moveG0 && recordType <= RecordType::moveG3)
+	{
+		if (recordLength < 2)
+		{
+			return RecordStatus::incomplete;
+		}
+		uint8_t mask = record[1];
+		if (mask >= (1u << NumFields))
+		{
+			return RecordStatus::bad;
+		}
+		++index;
+		for (; mask != 0; mask >>= 1)
+		{
+			uint32_t val;
+			if ((mask & 1) != 0 && !GetVarint(index, val))
+			{
+				return (recordLength >= 2 + 5 * NumFields) ? RecordStatus::bad : RecordStatus::incomplete;
+			}
+		}
+		return RecordStatus::complete;
+	}
+
+	return RecordStatus::bad;
+}
+
+// Update the decoding state from the complete record we have collected and convert it to a line of GCode.
+// Return true if there is a line of GCode to execute.
+bool CompactFileGCodeInput::ApplyRecord(const StringRef& line)
+{
+	const FilePosition block = recordStartOffset/CompactGCodeBlockSize;
+	if (block != currentBlock)
+	{
+		currentBlock = block;
+		ResetValues();
+	}
+
+	const uint8_t recordType = record[0];
+	size_t index = 1;
+	uint32_t val;
+	if (recordType == RecordType::textLine)
+	{
+		(void)GetVarint(index, val);
+		line.copy(reinterpret_cast<const char*>(record + index), val);
+		return true;
+	}
+
+	if (recordType == RecordType::padding)
+	{
+		return false;
+	}
+
+	line.printf("G%u", (unsigned int)(recordType - RecordType::moveG0));
+	const uint8_t mask = record[1];
+	++index;
+	for (size_t field = 0; field < NumFields; ++field)
+	{
+		if ((mask & (1u << field)) != 0)
+		{
+			(void)GetVarint(index, val);
+			int32_t ival = Unzigzag(val);
+			if (field < NumRelativeFields)
+			{
+				ival += lastValues[field];
+				lastValues[field] = ival;
+			}
+			AppendField(line, field, ival);
+		}
+	}
+	return true;
+}
+
+// Append a parameter to a line of GCode, converting the fixed point value to text without using floating point
+/*static*/ void CompactFileGCodeInput::AppendField(const StringRef& line, size_t field, int32_t ival)
+{
+	const uint32_t scale = FieldScales[field];
+	const uint32_t magnitude = (ival < 0) ? (uint32_t)-ival : (uint32_t)ival;
+	line.catf(" %c%s%" PRIu32 ".", FieldLetters[field], (ival < 0) ? "-" : "", magnitude/scale);
+	const uint32_t fraction = magnitude % scale;
+	if (scale == 10)
+	{
+		line.catf("%" PRIu32, fraction);
+	}
+	else if (scale == 1000)
+	{
+		line.catf("%03" PRIu32, fraction);
+	}
+	else
+	{
+		line.catf("%05" PRIu32, fraction);
+	}
+}
+
+// Return true if the data at the start of a file is the header of a compact GCode file
+/*static*/ bool CompactFileGCodeInput::IsCompactHeader(const char *data, size_t length)
+{
+	return length >= HeaderSize && memcmp(data, CompactGCodeMagic, strlen(CompactGCodeMagic)) == 0;
+}
+
+// Convert data read from a compact file starting at 'offset' to GCode text in place, returning the length of the text. This is used by FileInfoParser.
+// The data must start at a block boundary or in the header, and end at a block boundary or the end of the file, so that it holds whole records.
+// We copy text records, which include the comments that the slicer wrote. Of the moves we only need the Z coordinate, so we convert moves that change Z
+// to G0 or G1 commands with just a Z parameter. The text is never longer than the records it replaces except for moves, so if a move would overwrite
+// data that we haven't converted yet we hold it back until there is room, replacing it if a later move changes Z before the next text record.
+// The output is always in file order, so a text record that follows a held back move is written after it, and any of it that doesn't fit yet is held back too.
+// We stop at a bad record.
+/*static*/ size_t CompactFileGCodeInput::ConvertToText(char *buf, size_t length, FilePosition offset)
+{
+	const uint8_t * const data = reinterpret_cast<const uint8_t*>(buf);
+	size_t readIndex = (offset < HeaderSize) ? min<size_t>(HeaderSize - offset, length) : 0;
+	size_t writeIndex = 0;
+	FilePosition block = (offset + readIndex)/CompactGCodeBlockSize;
+	int32_t lastZ = 0;
+	String<StringLength20> pendingMove;									// the last move that changed Z, if we haven't had room to write it yet
+	char heldBack[StringLength40];										// output that comes before the pending move and that we haven't had room to write yet
+	size_t heldBackLength = 0;
+	for (;;)
+	{
+		// Write as much of the held back output as there is room for, then the pending move if there is room for all of it
+		if (heldBackLength != 0)
+		{
+			const size_t numToWrite = min<size_t>(heldBackLength, readIndex - writeIndex);
+			memcpy(buf + writeIndex, heldBack, numToWrite);
+			writeIndex += numToWrite;
+			heldBackLength -= numToWrite;
+			memmove(heldBack, heldBack + numToWrite, heldBackLength);
+		}
+		if (heldBackLength == 0 && !pendingMove.IsEmpty() && writeIndex + pendingMove.strlen() <= readIndex)
+		{
+			memcpy(buf + writeIndex, pendingMove.c_str(), pendingMove.strlen());
+			writeIndex += pendingMove.strlen();
+			pendingMove.Clear();
+		}
+		if (readIndex >= length)
+		{
+			break;
+		}
+
+		const FilePosition recordBlock = (offset + readIndex)/CompactGCodeBlockSize;
+		if (recordBlock != block)
+		{
+			block = recordBlock;
+			lastZ = 0;
+		}
+
+		const uint8_t recordType = data[readIndex++];
+		uint32_t val;
+		if (recordType == RecordType::padding)
+		{
+			// Nothing to do
+		}
+		else if (recordType == RecordType::textLine)
+		{
+			if (!GetVarint(data, length, readIndex, val) || val > length - readIndex)
+			{
+				break;
+			}
+
+			// The text must come after any move that we are still holding back
+			if (!pendingMove.IsEmpty())
+			{
+				if (heldBackLength + pendingMove.strlen() <= sizeof(heldBack))
+				{
+					memcpy(heldBack + heldBackLength, pendingMove.c_str(), pendingMove.strlen());
+					heldBackLength += pendingMove.strlen();
+				}
+				pendingMove.Clear();											// if there is no room then we lose the move, which is better than writing it out of order
+			}
+
+			if (heldBackLength == 0)
+			{
+				memmove(buf + writeIndex, buf + readIndex, val);				// the text starts at least 2 bytes after where we write it
+				writeIndex += val;
+				buf[writeIndex++] = '\n';
+			}
+			else
+			{
+				// Write the held back output followed by the text and a newline as far as we can without overwriting the data after the text, and hold back the rest.
+				// Because the text starts at least 2 bytes after where we write, we end up holding back less than we did before.
+				const size_t totalLength = heldBackLength + val + 1;
+				const size_t numToWrite = min<size_t>(totalLength, readIndex + val - writeIndex);
+				const size_t textToWrite = (numToWrite > heldBackLength) ? min<size_t>(numToWrite - heldBackLength, val) : 0;
+
+				// Save what we can't write yet before we overwrite any of the text
+				char newHeldBack[sizeof(heldBack)];
+				size_t newHeldBackLength = 0;
+				if (numToWrite < heldBackLength)
+				{
+					newHeldBackLength = heldBackLength - numToWrite;
+					memcpy(newHeldBack, heldBack + numToWrite, newHeldBackLength);
+				}
+				if (numToWrite < totalLength)
+				{
+					memcpy(newHeldBack + newHeldBackLength, buf + readIndex + textToWrite, val - textToWrite);
+					newHeldBackLength += val - textToWrite;
+					newHeldBack[newHeldBackLength++] = '\n';
+				}
+
+				memmove(buf + writeIndex + heldBackLength, buf + readIndex, textToWrite);
+				memcpy(buf + writeIndex, heldBack, min<size_t>(numToWrite, heldBackLength));
+				if (numToWrite == totalLength)
+				{
+					buf[writeIndex + totalLength - 1] = '\n';
+				}
+				writeIndex += numToWrite;
+				memcpy(heldBack, newHeldBack, newHeldBackLength);
+				heldBackLength = newHeldBackLength;
+			}
+			readIndex += val;
+		}
+		else if (recordType >= RecordType::moveG0 && recordType <= RecordType::moveG3 && readIndex < length)
+		{
+			const uint8_t mask = data[readIndex++];
+			bool haveZ = false;
+			size_t field = 0;
+			for (; field < NumFields; ++field)
+			{
+				if ((mask & (1u << field)) != 0)
+				{
+					if (!GetVarint(data, length, readIndex, val))
+					{
+						break;
+					}
+					if (field == ZField)
+					{
+						lastZ += Unzigzag(val);
+						haveZ = true;
+					}
+				}
+			}
+			if (field < NumFields || mask >= (1u << NumFields))
+			{
+				break;
+			}
+
+			if (haveZ)
+			{
+				pendingMove.printf("G%u", (unsigned int)(recordType - RecordType::moveG0));
+				AppendField(pendingMove.GetRef(), ZField, lastZ);
+				pendingMove.cat('\n');
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+	return writeIndex;
+}
+
+void CompactFileGCodeInput::ResetValues()
+{
+	for (int32_t& v : lastValues)
+	{
+		v = 0;
+	}
+}
+
+#endif
+
 // End
@@ -16,6 +16,18 @@
 const size_t GCodeInputBufferSize = 256;				// How many bytes can we cache per input source?
 const size_t GCodeInputFileReadThreshold = 128;			// How many free bytes must be available before data is read from the SD card?
 
+#if SUPPORT_FILE_READ_AHEAD
+const size_t FileSectorSize = 512;						// The sector size of the SD card
+# if SAME70
+const size_t FileReadAheadBlockSize = 4096;				// How many bytes we read from the SD card at a time, must be a multiple of the sector size
+# else
+const size_t FileReadAheadBlockSize = 2048;				// How many bytes we read from the SD card at a time, must be a multiple of the sector size
+# endif
+static_assert(FileReadAheadBlockSize % FileSectorSize == 0, "Read-ahead block size must be a multiple of the sector size");
+const size_t FileReadAheadAlignment = 32;				// The SAME70 cache line size. The card DMA invalidates whole cache lines, so no other data may share them.
+static_assert(FileReadAheadBlockSize % FileReadAheadAlignment == 0, "Read-ahead block size must be a multiple of the cache line size");
+#endif
+
 
 // This base class is intended to provide incoming G-codes for the GCodeBuffer class
 class GCodeInput
@@ -85,21 +97,122 @@ enum class GCodeInputReadResult : uint8_t { haveData, noData, error };
 
 // This class is an expansion of the RegularGCodeInput class to buffer G-codes and to rewind file positions when
 // nested G-code files are started. However buffered codes are not explicitly checked for M112.
+// If read-ahead is supported, we don't use the ring buffer so we don't derive from RegularGCodeInput. Instead we read whole blocks from the file
+// into one of two read-ahead buffers while the other one is being parsed. The reads are sector-aligned, so FatFS transfers the data straight into
+// our buffer instead of copying it through its own sector buffer, and it can read several sectors at once when they are in the same cluster.
+#if SUPPORT_FILE_READ_AHEAD
+class FileGCodeInput : public GCodeInput
+#else
 class FileGCodeInput : public RegularGCodeInput
+#endif
 {
 public:
 
-	FileGCodeInput() : RegularGCodeInput(), lastFile(nullptr) { }
+	FileGCodeInput();
 
 	void Reset() override;								// This should be called when the associated file is being closed
-	void Reset(const FileData &file);					// Should be called when a specific G-code or macro file is closed or re-opened outside the reading context
+	virtual void Reset(const FileData &file);			// Should be called when a specific G-code or macro file is closed or re-opened outside the reading context
 
-	GCodeInputReadResult ReadFromFile(FileData &file);	// Read another chunk of G-codes from the file and return true if more data is available
+	virtual GCodeInputReadResult ReadFromFile(FileData &file);	// Read another chunk of G-codes from the file and return true if more data is available
+
+#if SUPPORT_FILE_READ_AHEAD
+	size_t BytesCached() const override;				// How many bytes have been cached?
+	void Diagnostics(MessageType mtype);				// Report and reset the read-ahead statistics
+
+protected:
+	char ReadByte() override;
+	size_t ReadAheadBytesCached() const;				// How many bytes are in the read-ahead buffers?
+#else
+protected:
+#endif
 
-private:
 	FileStore *lastFile;
+
+#if SUPPORT_FILE_READ_AHEAD
+private:
+	void ResetReadAhead();
+
+	size_t blockLength[2];								// The number of bytes in each read-ahead block, or zero if the block is empty
+	size_t readAheadPointer;							// The index of the next byte to read in the current block
+	unsigned int readBlock;								// The block we are reading from. If it is empty then so is the other one.
+
+	uint32_t bytesRead;									// Statistics for M122
+	uint32_t readClocks;
+	unsigned int numReads;
+	unsigned int numStalls;
+
+	alignas(FileReadAheadAlignment) char readAheadBuffer[2][FileReadAheadBlockSize];
+#endif
+};
+
+#if SUPPORT_COMPACT_GCODE
+
+// Compact GCode files hold G0/G1/G2/G3 moves in binary form. They are produced from normal GCode files by the converter in Tools/compactgcode.
+// The file starts with an 8-byte header. After that it is a sequence of records, each starting with a type byte:
+//  0x00				padding, used so that no record crosses a multiple of CompactGCodeBlockSize in the file
+//  0x01 len text		a line of GCode that isn't a simple move, without the newline. The length is a varint.
+//  0x10..0x13 mask v..	a G0..G3 command. Bits 0..6 of the mask say which of the X Y Z E F I J parameters follow, in that order, as zigzag varints.
+//						X Y Z and E are in units of 0.001mm (0.00001mm for E) relative to the value in the previous move record.
+//						F is absolute in units of 0.1mm/min and I J are absolute in units of 0.001mm. A missing F means the feed rate is unchanged.
+// The values that X Y Z and E are relative to are reset to zero at the start of each block, so that we can start decoding at any record
+// after decoding no more than one block. Each record holds a single command, so file positions of commands are always record boundaries.
+// We decode each record into a line of GCode and pass it to the GCodeBuffer.
+class CompactFileGCodeInput : public FileGCodeInput
+{
+public:
+	CompactFileGCodeInput();
+
+	void Reset() override;
+	void Reset(const FileData &file) override;
+	GCodeInputReadResult ReadFromFile(FileData &file) override;
+	bool FillBuffer(GCodeBuffer *gb) override;
+	size_t BytesCached() const override;
+
+	static constexpr FilePosition CompactGCodeBlockSize = 1024;
+	static constexpr size_t HeaderSize = 8;
+	static constexpr uint8_t FormatVersion = 1;
+
+	static bool IsCompactHeader(const char *data, size_t length);					// Return true if the data at the start of a file says it is in compact format
+	static size_t ConvertToText(char *buf, size_t length, FilePosition offset);		// Convert whole records to text in place for FileInfoParser, returning the length
+
+private:
+	enum class RecordStatus : uint8_t { incomplete, complete, bad };
+
+	enum RecordType : uint8_t
+	{
+		padding = 0x00,
+		textLine = 0x01,
+		moveG0 = 0x10,
+		moveG3 = 0x13
+	};
+
+	static constexpr size_t NumFields = 7;				// X Y Z E F I J
+	static constexpr size_t NumRelativeFields = 4;		// X Y Z E
+	static constexpr size_t ZField = 2;
+
+	bool StartDecoding(FileData& file);					// Check whether the file is in compact format and if so set up to decode it from the current position
+	RecordStatus CheckRecord() const;					// Check whether the record we have collected is complete
+	bool GetVarint(size_t& index, uint32_t& val) const;	// Read a varint from the record, returning false if it is incomplete
+	static bool GetVarint(const uint8_t *data, size_t length, size_t& index, uint32_t& val);
+	static int32_t Unzigzag(uint32_t val) { return (int32_t)(val >> 1) ^ -(int32_t)(val & 1); }
+	static void AppendField(const StringRef& line, size_t field, int32_t ival);
+	bool ApplyRecord(const StringRef& line);			// Update the decoding state from a complete record and convert it to GCode, returning true if there is a line to execute
+	void ResetValues();
+
+	FileStore *compactFile;								// The file we have most recently found to be in compact format
+	FilePosition decodeOffset;							// The offset in compactFile of the next byte we will decode
+	FilePosition recordStartOffset;						// The offset in compactFile of the record we are collecting
+	FilePosition currentBlock;							// The block that the last record started in
+	int32_t lastValues[NumRelativeFields];				// The last values of the fields that are stored as differences
+	size_t recordLength;								// The number of bytes we have collected of the current record
+	bool decoding;										// True if we are reading from compactFile
+	bool compactStateValid;								// True if our decoding state matches the position of compactFile
+	bool hadError;										// True if we found a bad record
+	uint8_t record[GCODE_LENGTH + 3];					// The record we are collecting. The longest record is a text record of the longest possible GCode.
 };
 
+#endif
+
 // This class receives its data from the network task
 class NetworkGCodeInput: public RegularGCodeInput
 {
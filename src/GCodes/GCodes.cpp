@@ -72,6 +72,11 @@ void GCodes::RawMove::SetDefaults(size_t firstDriveToZero)
 	usingStandardFeedrate = false;
 	usePressureAdvance = false;
 	hasExtrusion = false;
+	isNativeArc = false;
+	followMesh = false;
+#if SUPPORT_ASYNC_MOVES
+	ringNumber = 0;
+#endif
 	endStopsToCheck = 0;
 	filePos = noFilePosition;
 	tool = nullptr;
@@ -98,7 +103,11 @@ GCodes::GCodes(Platform& p) :
 #endif
 	isFlashing(false), fileBeingHashed(nullptr), lastWarningMillis(0), sdTimingFile(nullptr)
 {
+#if SUPPORT_COMPACT_GCODE
+	fileInput = new CompactFileGCodeInput();
+#else
 	fileInput = new FileGCodeInput();
+#endif
 	fileGCode = new GCodeBuffer("file", GenericMessage, true);
 	serialInput = new StreamGCodeInput(SERIAL_MAIN_DEVICE);
 	serialGCode = new GCodeBuffer("serial", UsbMessage, true);
@@ -1909,7 +1918,7 @@ void GCodes::DoPause(GCodeBuffer& gb, PauseReason reason, const char *msg)
 			pauseRestorePoint.virtualExtruderPosition = moveBuffer.virtualExtruderPosition;
 			pauseRestorePoint.filePos = moveBuffer.filePos;
 			pauseRestorePoint.feedRate = moveBuffer.feedRate;
-			pauseRestorePoint.proportionDone = (float)(totalSegments - segmentsLeft)/(float)totalSegments;
+			pauseRestorePoint.proportionDone = GetSegmentedMoveProportionDone();
 			pauseRestorePoint.initialUserX = moveBuffer.initialUserX;
 			pauseRestorePoint.initialUserY = moveBuffer.initialUserY;
 			ToolOffsetInverseTransform(pauseRestorePoint.moveCoords, currentUserPosition);	// transform the returned coordinates to user coordinates
@@ -2074,7 +2083,7 @@ bool GCodes::DoEmergencyPause()
 		pauseRestorePoint.feedRate = moveBuffer.feedRate;
 		pauseRestorePoint.virtualExtruderPosition = moveBuffer.virtualExtruderPosition;
 		pauseRestorePoint.filePos = moveBuffer.filePos;
-		pauseRestorePoint.proportionDone = (float)(totalSegments - segmentsLeft)/(float)totalSegments;
+		pauseRestorePoint.proportionDone = GetSegmentedMoveProportionDone();
 		pauseRestorePoint.initialUserX = moveBuffer.initialUserX;
 		pauseRestorePoint.initialUserY = moveBuffer.initialUserY;
 #if SUPPORT_LASER || SUPPORT_IOBITS
@@ -2095,6 +2104,23 @@ bool GCodes::DoEmergencyPause()
 #endif
 	}
 
+#if SUPPORT_ASYNC_MOVES
+	// Move stopped the independent movement queues too and put the positions where their axes stopped in the restore point.
+	// If we skipped moves in the main queue we have already converted them, otherwise the user coordinates of those axes are where the last commands sent them.
+	if (!movesSkipped)
+	{
+		float stoppedUserPosition[MaxAxes];
+		ToolOffsetInverseTransform(pauseRestorePoint.moveCoords, stoppedUserPosition);
+		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+		{
+			if (reprap.GetMove().GetRingNumber(axis) != 0)
+			{
+				currentUserPosition[axis] = stoppedUserPosition[axis];
+			}
+		}
+	}
+#endif
+
 	codeQueue->PurgeEntries();
 
 	// Replace the paused machine coordinates by user coordinates, which we updated earlier
@@ -2620,6 +2646,9 @@ void GCodes::Diagnostics(MessageType mtype)
 	}
 
 	codeQueue->Diagnostics(mtype);
+#if SUPPORT_FILE_READ_AHEAD
+	fileInput->Diagnostics(mtype);
+#endif
 }
 
 // Lock movement and wait for pending moves to finish.
@@ -2873,6 +2902,11 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 
 	// Set up default move parameters
 	moveBuffer.isCoordinated = isCoordinated;
+	moveBuffer.isNativeArc = false;
+	moveBuffer.followMesh = false;
+#if SUPPORT_ASYNC_MOVES
+	moveBuffer.ringNumber = 0;
+#endif
 	moveBuffer.endStopsToCheck = 0;
 	moveBuffer.moveType = 0;
 	moveBuffer.tool = reprap.GetCurrentTool();
@@ -3054,6 +3088,36 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 
 	LoadExtrusionAndFeedrateFromGCode(gb, axesMentioned != 0);
 
+#if SUPPORT_ASYNC_MOVES
+	// If the axes mentioned have been assigned to an independent movement queue, send the move to that queue
+	if (axesMentioned != 0)
+	{
+		unsigned int ringNumber = MaxAuxDDARings + 1;						// an invalid ring number until we find the first axis mentioned
+		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+		{
+			if (IsBitSet(axesMentioned, axis))
+			{
+				const unsigned int axisRingNumber = reprap.GetMove().GetRingNumber(axis);
+				if (ringNumber > MaxAuxDDARings)
+				{
+					ringNumber = axisRingNumber;
+				}
+				else if (axisRingNumber != ringNumber)
+				{
+					reprap.GetPlatform().Message(GenericMessage, "G0/G1: axes in different movement queues can't be moved together");
+					return true;
+				}
+			}
+		}
+		if (ringNumber != 0 && moveBuffer.hasExtrusion)
+		{
+			reprap.GetPlatform().Message(GenericMessage, "G0/G1: can't extrude while moving axes in an independent movement queue");
+			return true;
+		}
+		moveBuffer.ringNumber = ringNumber;
+	}
+#endif
+
 	// Set up the move. We must assign segmentsLeft last, so that when Move runs as a separate task the move won't be picked up by the Move process before it is complete.
 	// Note that if this is an extruder-only move, we don't do axis movements to allow for tool offset changes, we defer those until an axis moves.
 	if (moveBuffer.moveType != 0)
@@ -3144,6 +3208,14 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 		// Apply segmentation if necessary. To speed up simulation on SCARA printers, we don't apply kinematics segmentation when simulating.
 		// Note for when we use RTOS: as soon as we set segmentsLeft nonzero, the Move process will assume that the move is ready to take, so this must be the last thing we do.
 		const Kinematics& kin = reprap.GetMove().GetKinematics();
+		doingMeshSegmentedMove = false;
+#if SUPPORT_ASYNC_MOVES
+		if (moveBuffer.ringNumber != 0)
+		{
+			totalSegments = 1;											// only axes that don't share motors with other axes can be in independent queues, so they never need segmenting
+		}
+		else
+#endif
 		if (kin.UseSegmentation() && simulationMode != 1 && (moveBuffer.hasExtrusion || moveBuffer.isCoordinated || !kin.UseRawG0()))
 		{
 			// This kinematics approximates linear motion by means of segmentation.
@@ -3151,11 +3223,52 @@ bool GCodes::DoStraightMove(GCodeBuffer& gb, bool isCoordinated)
 			const float xyLength = sqrtf(fsquare(currentUserPosition[X_AXIS] - initialX) + fsquare(currentUserPosition[Y_AXIS] - initialY));
 			const float moveTime = xyLength/moveBuffer.feedRate;			// this is a best-case time, often the move will take longer
 			totalSegments = (unsigned int)max<int>(1, min<int>(rintf(xyLength/kin.GetMinSegmentLength()), rintf(moveTime * kin.GetSegmentsPerSecond())));
+
+			// The segments/second and minimum segment length limit the processing load. Use fewer segments if that still keeps the path within the segment deviation.
+			// If mesh compensation is in use then we must still have at least one segment per grid cell crossed, so that the segments are smaller than the mesh spacing.
+			if (totalSegments > 1)
+			{
+				unsigned int deviationSegments = kin.GetSegmentsForDeviation(moveBuffer.initialCoords, moveBuffer.coords, numVisibleAxes, numTotalAxes);
+				if (deviationSegments != 0 && deviationSegments < totalSegments)
+				{
+					if (reprap.GetMove().IsUsingMesh())
+					{
+						// The height map uses head reference point coordinates
+						const float xOffset = Tool::GetOffset(moveBuffer.tool, X_AXIS);
+						const float yOffset = Tool::GetOffset(moveBuffer.tool, Y_AXIS);
+						const unsigned int meshSegments = reprap.GetMove().AccessHeightMap().GetMinimumSegments(moveBuffer.initialCoords[X_AXIS] + xOffset, moveBuffer.initialCoords[Y_AXIS] + yOffset,
+																													moveBuffer.coords[X_AXIS] + xOffset, moveBuffer.coords[Y_AXIS] + yOffset);
+						deviationSegments = max<unsigned int>(deviationSegments, meshSegments);
+					}
+					totalSegments = min<unsigned int>(totalSegments, deviationSegments);
+				}
+			}
 		}
 		else if (reprap.GetMove().IsUsingMesh() && (moveBuffer.isCoordinated || machineType == MachineType::fff))
 		{
-			const HeightMap& heightMap = reprap.GetMove().AccessHeightMap();
-			totalSegments = max<unsigned int>(1, heightMap.GetMinimumSegments(currentUserPosition[X_AXIS] - initialX, currentUserPosition[Y_AXIS] - initialY));
+			// Unless the Z motor can follow the height map, split the move where it crosses the grid lines because the height correction changes gradient there.
+			// The height map uses head reference point coordinates.
+			meshSegmentStart[0] = moveBuffer.initialCoords[X_AXIS] + Tool::GetOffset(moveBuffer.tool, X_AXIS);
+			meshSegmentStart[1] = moveBuffer.initialCoords[Y_AXIS] + Tool::GetOffset(moveBuffer.tool, Y_AXIS);
+			meshSegmentEnd[0] = moveBuffer.coords[X_AXIS] + Tool::GetOffset(moveBuffer.tool, X_AXIS);
+			meshSegmentEnd[1] = moveBuffer.coords[Y_AXIS] + Tool::GetOffset(moveBuffer.tool, Y_AXIS);
+#if SUPPORT_SEGMENT_FREE_MESH
+			if (reprap.GetMove().CanUseSegmentFreeMesh(moveBuffer.tool))
+			{
+				// The Z motor follows the height map during the move, so we don't need to split it
+				totalSegments = 1;
+				moveBuffer.followMesh = true;
+			}
+			else
+#endif
+			{
+				const HeightMap& heightMap = reprap.GetMove().AccessHeightMap();
+				totalSegments = max<unsigned int>(1, heightMap.GetMinimumSegments(meshSegmentStart[0], meshSegmentStart[1], meshSegmentEnd[0], meshSegmentEnd[1]));
+
+				// If we are resuming part way through the move then we need equal segments, so just use the same number of them
+				doingMeshSegmentedMove = (totalSegments > 1 && moveFractionToSkip == 0.0);
+				meshSegmentFraction = 0.0;
+			}
 		}
 		else
 		{
@@ -3345,6 +3458,11 @@ const char* GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise)
 	moveBuffer.moveType = 0;
 	moveBuffer.tool = reprap.GetCurrentTool();
 	moveBuffer.isCoordinated = true;
+	moveBuffer.isNativeArc = false;
+	moveBuffer.followMesh = false;
+#if SUPPORT_ASYNC_MOVES
+	moveBuffer.ringNumber = 0;
+#endif
 
 	// Set up the arc centre coordinates and record which axes behave like an X axis.
 	// The I and J parameters are always relative to present position.
@@ -3419,23 +3537,75 @@ const char* GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise)
 		}
 	}
 
-	// Compute how many segments to use
-	// For the arc to deviate up to MaxArcDeviation from the ideal, the segment length should be sqrt(8 * arcRadius * MaxArcDeviation + fsquare(MaxArcDeviation))
-	// We leave out the square term because it is very small
-	// In CNC applications even very small deviations can be visible, so we use a smaller segment length at low speeds
-	const float arcSegmentLength = constrain<float>
-									(	min<float>(sqrt(8 * arcRadius * MaxArcDeviation), moveBuffer.feedRate * (1.0/MinArcSegmentsPerSec)),
-										MinArcSegmentLength,
-										MaxArcSegmentLength
-									);
-	totalSegments = max<unsigned int>((unsigned int)((arcRadius * totalArc)/arcSegmentLength + 0.8), 1u);
-	arcAngleIncrement = totalArc/totalSegments;
-	if (clockwise)
+#if SUPPORT_NATIVE_ARCS
+	// If the motor positions are linear in X and Y, pass the whole arc to the Move class as a single move.
+	// We can't do this when resuming part way through an arc, or if the X and Y scale factors differ because then the path isn't circular.
+	if (   moveFractionToSkip == 0.0
+		&& axisScaleFactors[X_AXIS] == axisScaleFactors[Y_AXIS]
+		&& reprap.GetMove().CanUseNativeArcs(moveBuffer.tool)
+		&& ArcIsWithinLimits((clockwise) ? -totalArc : totalArc)
+	   )
+	{
+		moveBuffer.isNativeArc = true;
+		moveBuffer.arcRadius = arcRadius * axisScaleFactors[X_AXIS];
+		moveBuffer.arcStartAngle = arcCurrentAngle;
+		moveBuffer.arcTotalAngle = (clockwise) ? -totalArc : totalArc;
+		totalSegments = 1;
+	}
+	else
+#endif
 	{
-		arcAngleIncrement = -arcAngleIncrement;
+		// Compute how many segments to use. A chord that subtends angle A deviates from the arc by arcRadius * (1 - cos(A/2)),
+		// so use the largest angle that keeps the deviation within the limit set for the kinematics.
+		// In CNC applications even very small deviations can be visible, so we use a smaller segment length at low speeds.
+		// With the default deviation this gives the same segments as when the deviation was fixed.
+		const Kinematics& kin = reprap.GetMove().GetKinematics();
+		const float scaledRadius = arcRadius * max<float>(axisScaleFactors[X_AXIS], axisScaleFactors[Y_AXIS]);
+		const float maxAngleIncrement = (kin.GetSegmentDeviation() < scaledRadius) ? 2.0 * acosf(1.0 - kin.GetSegmentDeviation()/scaledRadius) : Pi;
+		const float arcSegmentLength = constrain<float>
+										(	min<float>(scaledRadius * maxAngleIncrement, moveBuffer.feedRate * (1.0/MinArcSegmentsPerSec)),
+											MinArcSegmentLength,
+											MaxArcSegmentLength
+										);
+		totalSegments = max<unsigned int>((unsigned int)((scaledRadius * totalArc)/arcSegmentLength + 0.8), 1u);
+		arcAngleIncrement = totalArc/totalSegments;
+
+		if (kin.UseSegmentation() && simulationMode != 1)
+		{
+			// The motors move linearly within each segment, so the path between the segment end points isn't straight either.
+			// Estimate how many pieces each segment needs from the first one, and split the segments further if necessary.
+			float segmentEnd[MaxAxes];
+			const float segmentEndAngle = arcCurrentAngle + ((clockwise) ? -arcAngleIncrement : arcAngleIncrement);
+			for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+			{
+				if (axis != Z_AXIS && IsBitSet(Tool::GetYAxes(moveBuffer.tool), axis))
+				{
+					segmentEnd[axis] = arcCentre[axis] + arcRadius * axisScaleFactors[axis] * sinf(segmentEndAngle);
+				}
+				else if (axis != Z_AXIS && IsBitSet(Tool::GetXAxes(moveBuffer.tool), axis))
+				{
+					segmentEnd[axis] = arcCentre[axis] + arcRadius * axisScaleFactors[axis] * cosf(segmentEndAngle);
+				}
+				else
+				{
+					segmentEnd[axis] = moveBuffer.initialCoords[axis] + (moveBuffer.coords[axis] - moveBuffer.initialCoords[axis])/totalSegments;
+				}
+			}
+			const unsigned int piecesPerSegment = kin.GetSegmentsForDeviation(moveBuffer.initialCoords, segmentEnd, numVisibleAxes, numTotalAxes);
+			if (piecesPerSegment > 1)
+			{
+				totalSegments = min<unsigned int>(totalSegments * piecesPerSegment, max<unsigned int>((unsigned int)((scaledRadius * totalArc)/kin.GetMinSegmentLength()), totalSegments));
+				arcAngleIncrement = totalArc/totalSegments;
+			}
+		}
+		if (clockwise)
+		{
+			arcAngleIncrement = -arcAngleIncrement;
+		}
 	}
 
 	doingArcMove = true;
+	doingMeshSegmentedMove = false;
 	FinaliseMove(gb);
 	UnlockAll(gb);			// allow pause
 //	debugPrintf("Radius %.2f, initial angle %.1f, increment %.1f, segments %u\n",
@@ -3443,6 +3613,37 @@ const char* GCodes::DoArcMove(GCodeBuffer& gb, bool clockwise)
 	return nullptr;
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Check that an arc move that we are going to pass to the Move class as a single move stays within the machine limits.
+// The end point has already been checked, so we only need to check the points at which the arc crosses the lines through the centre parallel to the X and Y axes.
+bool GCodes::ArcIsWithinLimits(float totalArc) const
+{
+	for (unsigned int quadrant = 0; quadrant < 4; ++quadrant)
+	{
+		const float angle = quadrant * (Pi/2);
+		float angleToPoint = fmodf((totalArc >= 0.0) ? angle - arcCurrentAngle : arcCurrentAngle - angle, TwoPi);
+		if (angleToPoint < 0.0)
+		{
+			angleToPoint += TwoPi;
+		}
+		if (angleToPoint < fabsf(totalArc))
+		{
+			float coords[MaxAxes];
+			memcpy(coords, moveBuffer.coords, sizeof(coords));
+			coords[X_AXIS] = arcCentre[X_AXIS] + arcRadius * axisScaleFactors[X_AXIS] * cosf(angle);
+			coords[Y_AXIS] = arcCentre[Y_AXIS] + arcRadius * axisScaleFactors[Y_AXIS] * sinf(angle);
+			if (reprap.GetMove().GetKinematics().LimitPosition(coords, nullptr, numVisibleAxes, axesHomed, true, limitAxes) != LimitPositionResult::ok)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+#endif
+
 // Adjust the move parameters to account for segmentation and/or part of the move having been done already
 void GCodes::FinaliseMove(GCodeBuffer& gb)
 {
@@ -3454,9 +3655,12 @@ void GCodes::FinaliseMove(GCodeBuffer& gb)
 		segMoveState = SegmentedMoveState::active;
 		gb.SetState(GCodeState::waitingForSegmentedMoveToGo);
 
-		for (size_t drive = numTotalAxes; drive < MaxTotalDrivers; ++drive)
+		if (!doingMeshSegmentedMove)											// if the segments are unequal then ReadMove shares out the extrusion
 		{
-			moveBuffer.coords[drive] /= totalSegments;							// change the extrusion to extrusion per segment
+			for (size_t drive = numTotalAxes; drive < MaxTotalDrivers; ++drive)
+			{
+				moveBuffer.coords[drive] /= totalSegments;						// change the extrusion to extrusion per segment
+			}
 		}
 
 		if (moveFractionToSkip != 0.0)
@@ -3500,6 +3704,14 @@ bool GCodes::ReadMove(RawMove& m)
 				m.coords[drive] *= (1.0 - firstSegmentFractionToSkip);
 			}
 		}
+		else if (doingMeshSegmentedMove)
+		{
+			// Do the rest of the extrusion
+			for (size_t drive = numTotalAxes; drive < MaxTotalDrivers; ++drive)
+			{
+				m.coords[drive] *= (1.0 - meshSegmentFraction);
+			}
+		}
 		m.proportionDone = 1.0;
 		if (doingArcMove)
 		{
@@ -3516,6 +3728,17 @@ bool GCodes::ReadMove(RawMove& m)
 			arcCurrentAngle += arcAngleIncrement;
 		}
 
+		// If we are splitting the move at the height map grid lines, work out how much of the remaining move this segment does
+		float proportionOfRemainder = 1.0/segmentsLeft;
+		float fractionOfMove = 0.0;
+		if (doingMeshSegmentedMove)
+		{
+			const float nextFraction = reprap.GetMove().AccessHeightMap().GetNextSegmentFraction(meshSegmentStart[0], meshSegmentStart[1], meshSegmentEnd[0], meshSegmentEnd[1], meshSegmentFraction);
+			proportionOfRemainder = (nextFraction - meshSegmentFraction)/(1.0 - meshSegmentFraction);
+			fractionOfMove = nextFraction - meshSegmentFraction;
+			meshSegmentFraction = nextFraction;
+		}
+
 		for (size_t drive = 0; drive < numVisibleAxes; ++drive)
 		{
 			if (doingArcMove && drive != Z_AXIS && IsBitSet(Tool::GetYAxes(moveBuffer.tool), drive))
@@ -3530,12 +3753,21 @@ bool GCodes::ReadMove(RawMove& m)
 			}
 			else
 			{
-				const float movementToDo = (moveBuffer.coords[drive] - moveBuffer.initialCoords[drive])/segmentsLeft;
+				const float movementToDo = (moveBuffer.coords[drive] - moveBuffer.initialCoords[drive]) * proportionOfRemainder;
 				moveBuffer.initialCoords[drive] += movementToDo;
 			}
 			m.coords[drive] = moveBuffer.initialCoords[drive];
 		}
 
+		if (doingMeshSegmentedMove)
+		{
+			// Do the extrusion in proportion to the length of the segment
+			for (size_t drive = numTotalAxes; drive < MaxTotalDrivers; ++drive)
+			{
+				m.coords[drive] *= fractionOfMove;
+			}
+		}
+
 		if (segmentsLeftToStartAt < segmentsLeft)
 		{
 			// We are resuming a print part way through a move and we printed this segment already
@@ -3547,7 +3779,7 @@ bool GCodes::ReadMove(RawMove& m)
 		if (reprap.GetMove().GetKinematics().LimitPosition(m.coords, nullptr, numVisibleAxes, axesHomed, true, limitAxes) != LimitPositionResult::ok)
 		{
 			segMoveState = SegmentedMoveState::aborted;
-			doingArcMove = false;
+			doingArcMove = doingMeshSegmentedMove = false;
 			segmentsLeft = 0;
 			return false;
 		}
@@ -3562,7 +3794,7 @@ bool GCodes::ReadMove(RawMove& m)
 		}
 		--segmentsLeft;
 
-		m.proportionDone = (float)(totalSegments - segmentsLeft)/(float)totalSegments;
+		m.proportionDone = GetSegmentedMoveProportionDone();
 	}
 
 	return true;
@@ -3574,7 +3806,12 @@ void GCodes::ClearMove()
 
 	segmentsLeft = 0;
 	segMoveState = SegmentedMoveState::inactive;
-	doingArcMove = false;
+	doingArcMove = doingMeshSegmentedMove = false;
+	moveBuffer.isNativeArc = false;
+	moveBuffer.followMesh = false;
+#if SUPPORT_ASYNC_MOVES
+	moveBuffer.ringNumber = 0;
+#endif
 	moveBuffer.endStopsToCheck = 0;
 	moveBuffer.moveType = 0;
 	moveBuffer.isFirmwareRetraction = false;
@@ -5040,6 +5277,11 @@ bool GCodes::IsCodeQueueIdle() const
 void GCodes::StopPrint(StopPrintReason reason)
 {
 	segmentsLeft = 0;
+	moveBuffer.isNativeArc = false;
+	moveBuffer.followMesh = false;
+#if SUPPORT_ASYNC_MOVES
+	moveBuffer.ringNumber = 0;
+#endif
 	isPaused = pausePending = filamentChangePausePending = false;
 
 	FileData& fileBeingPrinted = fileGCode->OriginalMachineState().fileState;
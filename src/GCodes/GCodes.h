@@ -124,12 +124,20 @@ public:
 		FilePosition filePos;											// offset in the file being printed at the start of reading this move
 		float proportionDone;											// what proportion of the entire move has been done when this segment is complete
 		float initialUserX, initialUserY;								// if this is a segment of an arc move, the user X and Y coordinates at the start
+#if SUPPORT_NATIVE_ARCS
+		float arcRadius;												// if this is a complete arc move, the radius in machine coordinates
+		float arcStartAngle;											// if this is a complete arc move, the angle of the start point from the arc centre
+		float arcTotalAngle;											// if this is a complete arc move, the angle turned through, positive for anticlockwise
+#endif
 		const Tool *tool;												// which tool (if any) is being used
 		EndstopsBitmap endStopsToCheck;									// endstops to check
 #if SUPPORT_LASER || SUPPORT_IOBITS
 		LaserPwmOrIoBits laserPwmOrIoBits;								// the laser PWM or port bit settings required
 #endif
 		uint8_t moveType;												// the S parameter from the G0 or G1 command, 0 for a normal move
+#if SUPPORT_ASYNC_MOVES
+		uint8_t ringNumber;												// which movement queue this move is for, 0 for the main queue
+#endif
 
 		uint8_t isFirmwareRetraction : 1;								// true if this is a firmware retraction/un-retraction move
 		uint8_t usePressureAdvance : 1;									// true if we want to us extruder pressure advance, if there is any extrusion
@@ -137,6 +145,8 @@ public:
 		uint8_t hasExtrusion : 1;										// true if the move includes extrusion - only valid if the move was set up by SetupMove
 		uint8_t isCoordinated : 1;										// true if this is a coordinates move
 		uint8_t usingStandardFeedrate : 1;								// true if this move uses the standard feed rate
+		uint8_t isNativeArc : 1;										// true if this is a complete arc move that the Move class executes without segmenting it
+		uint8_t followMesh : 1;											// true if the Z motor should follow the height map because the move wasn't split at the grid lines
 
 		uint8_t retractOccured;											// this indicate step of gcode retraction
 
@@ -149,6 +159,10 @@ public:
 	void Exit();														// Shut it down
 	void Reset();														// Reset some parameter to defaults
 	bool ReadMove(RawMove& m);											// Called by the Move class to get a movement set by the last G Code
+#if SUPPORT_ASYNC_MOVES
+	bool ReadMove(unsigned int ringNumber, RawMove& m)					// Called by the Move class to get a movement for a particular movement queue
+		{ return segmentsLeft != 0 && moveBuffer.ringNumber == ringNumber && ReadMove(m); }
+#endif
 	void ClearMove();
 	bool QueueFileToPrint(const char* fileName, const StringRef& reply);	// Open a file of G Codes to run
 	void StartPrinting(bool fromStart);									// Start printing the file already selected
@@ -322,6 +336,9 @@ private:
 	bool DoStraightMove(GCodeBuffer& gb, bool isCoordinated) __attribute__((hot));	// Execute a straight move returning any error message
 	const char* DoArcMove(GCodeBuffer& gb, bool clockwise)						// Execute an arc move returning any error message
 		pre(segmentsLeft == 0; resourceOwners[MoveResource] == &gb);
+#if SUPPORT_NATIVE_ARCS
+	bool ArcIsWithinLimits(float totalArc) const;								// Check that an arc move that won't be segmented stays within the machine limits
+#endif
 	void FinaliseMove(GCodeBuffer& gb);											// Adjust the move parameters to account for segmentation and/or part of the move having been done already
 	bool CheckEnoughAxesHomed(AxesBitmap axesMoved);							// Check that enough axes have been homed
 	void AbortPrint(GCodeBuffer& gb);											// Cancel any print in progress
@@ -412,7 +429,7 @@ private:
 	GCodeResult UpdateFirmware(GCodeBuffer& gb, const StringRef &reply);		// Handle M997
 	GCodeResult SendI2c(GCodeBuffer& gb, const StringRef &reply);				// Handle M260
 	GCodeResult ReceiveI2c(GCodeBuffer& gb, const StringRef &reply);			// Handle M261
-	GCodeResult SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile);	// Handle M37 to simulate a whole file
+	GCodeResult SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile, uint8_t newSimulationMode);	// Handle M37 to simulate a whole file
 	GCodeResult ChangeSimulationMode(GCodeBuffer& gb, const StringRef &reply, uint32_t newSimulationMode);		// Handle M37 to change the simulation mode
 
 	GCodeResult WriteConfigOverrideFile(GCodeBuffer& gb, const StringRef& reply) const; // Write the config-override file
@@ -512,6 +529,11 @@ private:
 	unsigned int segmentsLeft;					// The number of segments left to do in the current move, or 0 if no move available
 	unsigned int totalSegments;					// The total number of segments left in the complete move
 
+	float GetSegmentedMoveProportionDone() const
+	{
+		return (doingMeshSegmentedMove) ? meshSegmentFraction : (float)(totalSegments - segmentsLeft)/(float)totalSegments;
+	}
+
 	unsigned int segmentsLeftToStartAt;
 	float moveFractionToSkip;
 	float firstSegmentFractionToSkip;
@@ -526,6 +548,11 @@ private:
 	float arcAngleIncrement;
 	bool doingArcMove;
 
+	float meshSegmentStart[2];					// the XY coordinates at the start of a move that we split where it crosses the height map grid lines
+	float meshSegmentEnd[2];					// the XY coordinates at the end of that move
+	float meshSegmentFraction;					// how much of that move we have done
+	bool doingMeshSegmentedMove;				// true if the current move is split at the height map grid lines instead of into equal segments
+
 	float savedZPosition;
 	bool isZSaved;
 
@@ -599,7 +626,7 @@ private:
 	uint8_t tapsDone;							// how many times we tapped the current point
 
 	float simulationTime;						// Accumulated simulation time
-	uint8_t simulationMode;						// 0 = not simulating, 1 = simulating, >1 are simulation modes for debugging
+	uint8_t simulationMode;						// 0 = not simulating, 1 = simulating, 3 = simulating with step time calculation, other values are simulation modes for debugging
 	bool exitSimulationWhenFileComplete;		// true if simulating a file
 	bool updateFileWhenSimulationComplete;		// true if simulated time should be appended to the file
 
@@ -1007,7 +1007,8 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 			if (seen)
 			{
 				const bool updateFile = !gb.Seen('F') || gb.GetUIValue() == 1;
-				result = SimulateFile(gb, reply, simFileName.GetRef(), updateFile);
+				const uint8_t newSimulationMode = (gb.Seen('S') && gb.GetUIValue() == StepTimingSimulationMode) ? StepTimingSimulationMode : 1;
+				result = SimulateFile(gb, reply, simFileName.GetRef(), updateFile, newSimulationMode);
 			}
 			else
 			{
@@ -1021,6 +1022,7 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				{
 					reply.printf("Simulation mode: %s, move time: %.1f sec, other time: %.1f sec",
 							(simulationMode != 0) ? "on" : "off", (double)reprap.GetMove().GetSimulationTime(), (double)simulationTime);
+					reprap.GetMove().ReportSimulatedSteps(reply);
 				}
 			}
 		}
@@ -2870,20 +2872,62 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		result = LoadHeightMap(gb, reply, true);
 		break;
 
-	case 376: // Set taper height
+	case 376: // Set taper height, mesh interpolation method and mesh segmentation
 		{
+			// Read and check all the parameters before we change anything, so that a bad parameter doesn't leave the command half done
 			Move& move = reprap.GetMove();
-			if (gb.Seen('H'))
+			bool seenTaper = false;
+			float taperHeight = 0.0;
+			gb.TryGetFValue('H', taperHeight, seenTaper);
+
+			const bool seenMethod = gb.Seen('I');
+			const int32_t method = (seenMethod) ? gb.GetIValue() : 0;
+			if (method != 0 && method != 1)
 			{
-				move.SetTaperHeight(gb.GetFValue());
+				reply.copy("M376 I parameter must be 0 (bilinear) or 1 (bicubic)");
+				result = GCodeResult::error;
+				break;
 			}
-			else if (move.GetTaperHeight() > 0.0)
+#if SUPPORT_SEGMENT_FREE_MESH
+			const bool seenSegmentFree = gb.Seen('S');
+			const int32_t segmentFree = (seenSegmentFree) ? gb.GetIValue() : 0;
+			if (segmentFree != 0 && segmentFree != 1)
 			{
-				reply.printf("Bed compensation taper height is %.1fmm", (double)move.GetTaperHeight());
+				reply.copy("M376 S parameter must be 0 (segmented) or 1 (segment-free)");
+				result = GCodeResult::error;
+				break;
 			}
-			else
+#else
+			const bool seenSegmentFree = false;
+#endif
+			if (seenTaper)
+			{
+				move.SetTaperHeight(taperHeight);
+			}
+			if (seenMethod)
+			{
+				move.AccessHeightMap().UseBicubicInterpolation(method == 1);
+			}
+#if SUPPORT_SEGMENT_FREE_MESH
+			if (seenSegmentFree)
+			{
+				move.UseSegmentFreeMesh(segmentFree == 1);
+			}
+#endif
+			if (!seenTaper && !seenMethod && !seenSegmentFree)
 			{
-				reply.copy("Bed compensation is not tapered");
+				if (move.GetTaperHeight() > 0.0)
+				{
+					reply.printf("Bed compensation taper height is %.1fmm", (double)move.GetTaperHeight());
+				}
+				else
+				{
+					reply.copy("Bed compensation is not tapered");
+				}
+				reply.catf(", mesh interpolation is %s", (move.AccessHeightMap().UsingBicubicInterpolation()) ? "bicubic" : "bilinear");
+#if SUPPORT_SEGMENT_FREE_MESH
+				reply.catf(", moves are %s", (move.UsingSegmentFreeMesh()) ? "not segmented where possible" : "segmented at the grid lines");
+#endif
 			}
 		}
 		break;
@@ -3771,6 +3815,12 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				reprap.GetMove().SetJerkPolicy(gb.GetUIValue());
 			}
 
+			if (gb.Seen('J'))
+			{
+				seen = true;
+				reprap.GetMove().SetJunctionDeviation(gb.GetFValue());
+			}
+
 			if (!seen)
 			{
 				const float multiplier2 = (code == 566) ? MinutesToSeconds : 1.0;
@@ -3790,6 +3840,11 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 				{
 					reply.catf(", jerk policy: %u", reprap.GetMove().GetJerkPolicy());
 				}
+				const float junctionDeviation = reprap.GetMove().GetJunctionDeviation();
+				if (junctionDeviation > 0.0)
+				{
+					reply.catf(", junction deviation: %.3fmm", (double)junctionDeviation);
+				}
 			}
 		}
 		break;
@@ -3910,51 +3965,85 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		break;
 
 	case 572: // Set/report pressure advance
-		if (gb.Seen('S'))
 		{
-			if (!LockMovementAndWaitForStandstill(gb))
+			// S is the linear pressure advance, Q is the coefficient of the square of the extrusion speed and T is the smoothing time
+			bool seenS = false, seenQ = false, seenT = false;
+			float advance = 0.0, quadratic = 0.0, smoothingTime = 0.0;
+			gb.TryGetFValue('S', advance, seenS);
+			gb.TryGetFValue('Q', quadratic, seenQ);
+			gb.TryGetFValue('T', smoothingTime, seenT);
+			if (seenS || seenQ || seenT)
 			{
-				return false;
-			}
-			const float advance = gb.GetFValue();
-			if (gb.Seen('D'))
-			{
-				uint32_t eDrive[MaxExtruders];
-				size_t eCount = MaxExtruders;
-				gb.GetUnsignedArray(eDrive, eCount, false);
-				for (size_t i = 0; i < eCount; i++)
+				if (!LockMovementAndWaitForStandstill(gb))
 				{
-					if (eDrive[i] >= numExtruders)
-					{
-						reply.printf("Invalid extruder number '%" PRIu32 "'", eDrive[i]);
-						result = GCodeResult::error;
-						break;
-					}
-					platform.SetPressureAdvance(eDrive[i], advance);
+					return false;
 				}
-			}
-			else
-			{
-				const Tool * const ct = reprap.GetCurrentTool();
-				if (ct == nullptr)
+				if (quadratic < 0.0 || smoothingTime < 0.0)
 				{
-					reply.copy("No tool selected");
+					reply.copy("Pressure advance Q and T parameters must not be negative");
 					result = GCodeResult::error;
+					break;
+				}
+				auto setAdvance = [seenS, seenQ, seenT, advance, quadratic, smoothingTime](unsigned int extruder)
+					{
+						Platform& platform = reprap.GetPlatform();
+						if (seenS)
+						{
+							platform.SetPressureAdvance(extruder, advance);
+						}
+						if (seenQ)
+						{
+							platform.SetPressureAdvanceQuadratic(extruder, quadratic);
+						}
+						if (seenT)
+						{
+							platform.SetPressureAdvanceSmoothingTime(extruder, smoothingTime);
+						}
+					};
+
+				if (gb.Seen('D'))
+				{
+					uint32_t eDrive[MaxExtruders];
+					size_t eCount = MaxExtruders;
+					gb.GetUnsignedArray(eDrive, eCount, false);
+					for (size_t i = 0; i < eCount; i++)
+					{
+						if (eDrive[i] >= numExtruders)
+						{
+							reply.printf("Invalid extruder number '%" PRIu32 "'", eDrive[i]);
+							result = GCodeResult::error;
+							break;
+						}
+						setAdvance(eDrive[i]);
+					}
 				}
 				else
 				{
-					ct->IterateExtruders([advance](unsigned int extruder) { reprap.GetPlatform().SetPressureAdvance(extruder, advance); });
+					const Tool * const ct = reprap.GetCurrentTool();
+					if (ct == nullptr)
+					{
+						reply.copy("No tool selected");
+						result = GCodeResult::error;
+					}
+					else
+					{
+						ct->IterateExtruders(setAdvance);
+					}
 				}
 			}
-		}
-		else
-		{
-			reply.copy("Extruder pressure advance");
-			char c = ':';
-			for (size_t i = 0; i < numExtruders; ++i)
+			else
 			{
-				reply.catf("%c %.3f", c, (double)platform.GetPressureAdvance(i));
-				c = ',';
+				reply.copy("Extruder pressure advance");
+				char c = ':';
+				for (size_t i = 0; i < numExtruders; ++i)
+				{
+					reply.catf("%c %.3f", c, (double)platform.GetPressureAdvance(i));
+					if (platform.GetPressureAdvanceQuadratic(i) != 0.0 || platform.GetPressureAdvanceSmoothingTime(i) != 0.0)
+					{
+						reply.catf(" (Q%.4f T%.3f)", (double)platform.GetPressureAdvanceQuadratic(i), (double)platform.GetPressureAdvanceSmoothingTime(i));
+					}
+					c = ',';
+				}
 			}
 		}
 		break;
@@ -4265,6 +4354,70 @@ bool GCodes::HandleMcode(GCodeBuffer& gb, const StringRef& reply)
 		result = reprap.GetMove().ConfigureDynamicAcceleration(gb, reply);
 		break;
 
+	case 595: // Configure movement queue length
+		result = reprap.GetMove().ConfigureMovementQueue(gb, reply);
+		break;
+
+#if SUPPORT_ASYNC_MOVES
+	case 596: // Configure independent movement queues
+		result = reprap.GetMove().ConfigureAuxMovementQueue(gb, reply);
+		break;
+#endif
+
+	case 598: // Set/report tool maximum volumetric flow rate
+		{
+			// If there is no P parameter then use the current tool
+			Tool* tool;
+			if (gb.Seen('P'))
+			{
+				const int tNumber = gb.GetIValue();
+				tool = reprap.GetTool(tNumber);
+				if (tool == nullptr)
+				{
+					reply.printf("Tool %d not found", tNumber);
+					result = GCodeResult::error;
+					break;
+				}
+			}
+			else
+			{
+				tool = reprap.GetCurrentTool();
+				if (tool == nullptr)
+				{
+					reply.copy("No P parameter and no tool selected");
+					result = GCodeResult::badOrMissingParameter;
+					break;
+				}
+			}
+
+			const int tNumber = tool->Number();
+			bool seen = false;
+			float flow = tool->GetMaxVolumetricFlow(), diameter = tool->GetFilamentDiameter();
+			gb.TryGetFValue('S', flow, seen);
+			gb.TryGetFValue('D', diameter, seen);
+			if (seen)
+			{
+				if (flow < 0.0 || diameter <= 0.0)
+				{
+					reply.copy("Maximum flow rate must not be negative and filament diameter must be positive");
+					result = GCodeResult::error;
+				}
+				else
+				{
+					tool->SetMaxVolumetricFlow(flow, diameter);
+				}
+			}
+			else if (flow > 0.0)
+			{
+				reply.printf("Tool %d maximum volumetric flow %.1fmm^3/sec with %.2fmm filament", tNumber, (double)flow, (double)diameter);
+			}
+			else
+			{
+				reply.printf("Tool %d has no volumetric flow limit", tNumber);
+			}
+		}
+		break;
+
 #if OMNI_GCODES
 	case 611: // Set LCD password - it's similar to M551
 	{
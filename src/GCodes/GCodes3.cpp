@@ -443,7 +443,7 @@ GCodeResult GCodes::DefineGrid(GCodeBuffer& gb, const StringRef &reply)
 }
 
 // Handle M37 to simulate a whole file
-GCodeResult GCodes::SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile)
+GCodeResult GCodes::SimulateFile(GCodeBuffer& gb, const StringRef &reply, const StringRef& file, bool updateFile, uint8_t newSimulationMode)
 {
 	if (reprap.GetPrintMonitor().IsPrinting())
 	{
@@ -463,7 +463,7 @@ GCodeResult GCodes::SimulateFile(GCodeBuffer& gb, const StringRef &reply, const
 		simulationTime = 0.0;
 		exitSimulationWhenFileComplete = true;
 		updateFileWhenSimulationComplete = updateFile;
-		simulationMode = 1;
+		simulationMode = newSimulationMode;
 		reprap.GetMove().Simulate(simulationMode);
 		reprap.GetPrintMonitor().StartingPrint(file.c_str());
 		StartPrinting(true);
@@ -932,7 +932,7 @@ GCodeResult GCodes::FindCenterOfCavity(GCodeBuffer& gb, const StringRef& reply,
 			SetBit(moveBuffer.endStopsToCheck, axis);
 			axesToSenseLength = 0;
 
-			doingArcMove = false;
+			doingArcMove = doingMeshSegmentedMove = false;
 
 			moveBuffer.canPauseAfter = false;
 			moveBuffer.hasExtrusion = false;
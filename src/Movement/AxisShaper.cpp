@@ -0,0 +1,112 @@
+/*
+ * AxisShaper.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: David
+ */
+
+#include "AxisShaper.h"
+
+#if SUPPORT_MOTION_SHAPING
+
+#include "StepTimer.h"
+
+static const char * const shaperTypeNames[] = { "none", "zv", "zvd", "ei" };
+constexpr float EiVibrationTolerance = 0.05;		// the residual vibration that the EI shaper allows at the design frequency
+
+AxisShaper::AxisShaper()
+	: type(InputShaperType::none), numImpulses(0), frequency(40.0), damping(0.1), startOffsetClocks(0.0), extraClocks(0.0)
+{
+}
+
+// Look up a shaper type by name, returning true if found
+/*static*/ bool AxisShaper::GetTypeFromName(const char *name, InputShaperType& t)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(shaperTypeNames); ++i)
+	{
+		if (StringEqualsIgnoreCase(name, shaperTypeNames[i]))
+		{
+			t = (InputShaperType)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *AxisShaper::GetTypeName() const
+{
+	return shaperTypeNames[(size_t)type];
+}
+
+// Configure this shaper, returning true if the parameters are acceptable
+bool AxisShaper::Configure(InputShaperType t, float freq, float damp)
+{
+	if (t != InputShaperType::none && (freq < 4.0 || freq > 10000.0 || damp < 0.0 || damp > 0.99))
+	{
+		return false;
+	}
+	type = t;
+	frequency = freq;
+	damping = damp;
+	CalculateImpulses();
+	return true;
+}
+
+// Calculate the amplitudes and times of the impulses, and the timing adjustments needed to fit the shaped acceleration into the phase
+void AxisShaper::CalculateImpulses()
+{
+	const float sqrtOneMinusZetaSquared = sqrtf(1.0 - fsquare(damping));
+	const float k = expf(-damping * Pi/sqrtOneMinusZetaSquared);
+	const float halfPeriodClocks = (0.5 * StepTimer::StepClockRate)/(frequency * sqrtOneMinusZetaSquared);
+
+	switch (type)
+	{
+	case InputShaperType::none:
+	default:
+		numImpulses = 0;
+		break;
+
+	case InputShaperType::zv:
+		numImpulses = 2;
+		amplitudes[0] = 1.0;
+		amplitudes[1] = k;
+		break;
+
+	case InputShaperType::zvd:
+		numImpulses = 3;
+		amplitudes[0] = 1.0;
+		amplitudes[1] = 2.0 * k;
+		amplitudes[2] = fsquare(k);
+		break;
+
+	case InputShaperType::ei:
+		numImpulses = 3;
+		amplitudes[0] = 0.25 * (1.0 + EiVibrationTolerance);
+		amplitudes[1] = 0.5 * (1.0 - EiVibrationTolerance) * k;
+		amplitudes[2] = amplitudes[0] * fsquare(k);
+		break;
+	}
+
+	// Normalise the amplitudes and find the centroid of the impulses
+	float sum = 0.0;
+	for (unsigned int i = 0; i < numImpulses; ++i)
+	{
+		sum += amplitudes[i];
+	}
+	float centroid = 0.0;
+	for (unsigned int i = 0; i < numImpulses; ++i)
+	{
+		amplitudes[i] /= sum;
+		delayClocks[i] = halfPeriodClocks * i;
+		centroid += amplitudes[i] * delayClocks[i];
+	}
+
+	// The shaped acceleration must start no earlier than the start of the phase, end no later than the end of it, and be centred on the middle of it
+	const float durationClocks = (numImpulses == 0) ? 0.0 : delayClocks[numImpulses - 1];
+	startOffsetClocks = durationClocks - 2.0 * centroid;
+	extraClocks = durationClocks + startOffsetClocks;
+}
+
+#endif
+
+// End
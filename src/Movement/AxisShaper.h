@@ -0,0 +1,65 @@
+/*
+ * AxisShaper.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: David
+ */
+
+#ifndef SRC_MOVEMENT_AXISSHAPER_H_
+#define SRC_MOVEMENT_AXISSHAPER_H_
+
+#include "RepRapFirmware.h"
+
+#if SUPPORT_MOTION_SHAPING
+
+enum class InputShaperType : uint8_t
+{
+	none = 0,
+	zv,					// zero vibration
+	zvd,				// zero vibration and derivative
+	ei					// extra insensitive
+};
+
+// Class to describe the input shaper applied to the acceleration and deceleration of one axis.
+// The shaper is a short train of impulses with amplitudes adding up to 1, which is convolved with the acceleration of each phase of the move.
+class AxisShaper
+{
+public:
+	static constexpr unsigned int MaxImpulses = 3;
+
+	AxisShaper();
+
+	bool Configure(InputShaperType t, float freq, float damp);
+	static bool GetTypeFromName(const char *name, InputShaperType& t);
+
+	bool IsEnabled() const { return type != InputShaperType::none; }
+	const char *GetTypeName() const;
+	float GetFrequency() const { return frequency; }
+	float GetDamping() const { return damping; }
+	bool SameAs(const AxisShaper& other) const { return type == other.type && frequency == other.frequency && damping == other.damping; }
+
+	unsigned int GetNumImpulses() const { return numImpulses; }
+	float GetAmplitude(unsigned int i) const { return amplitudes[i]; }
+	float GetDelayClocks(unsigned int i) const { return delayClocks[i]; }
+
+	// To keep the phase duration, speed change and distance the same as without shaping, we delay the shaped acceleration by startOffsetClocks and
+	// shorten the unshaped acceleration pulse by extraClocks. The shaper can only be used when the phase is longer than extraClocks.
+	float GetStartOffsetClocks() const { return startOffsetClocks; }
+	float GetExtraClocks() const { return extraClocks; }
+
+private:
+	void CalculateImpulses();
+
+	InputShaperType type;
+	uint8_t numImpulses;
+	float frequency;							// the ringing frequency in Hz
+	float damping;								// the damping ratio of the ringing
+	float amplitudes[MaxImpulses];
+	float delayClocks[MaxImpulses];
+	float startOffsetClocks;
+	float extraClocks;
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_AXISSHAPER_H_ */
@@ -10,6 +10,7 @@
 #include "RepRap.h"
 #include "Storage/FileStore.h"
 #include <cmath>
+#include <limits>
 
 const char * const GridDefinition::HeightMapLabelLines[] =
 {
@@ -72,6 +73,11 @@ void GridDefinition::CheckValidity()
 	{
 		recipXspacing = 1.0/xSpacing;
 		recipYspacing = 1.0/ySpacing;
+
+		// Clamp coordinates slightly short of the last grid lines, so that interpolation always has a cell to work with
+		constexpr float ClampMargin = 0.01;
+		xClampMax = xMin + (numX - 1) * xSpacing - ClampMargin;
+		yClampMax = yMin + (numY - 1) * ySpacing - ClampMargin;
 	}
 }
 
@@ -234,7 +240,7 @@ void GridDefinition::PrintError(float originalXrange, float originalYrange, cons
 // Increase the version number in the following string whenever we change the format of the height map file.
 const char * const HeightMap::HeightMapComment = "RepRapFirmware height map file v2";
 
-HeightMap::HeightMap() : useMap(false) { }
+HeightMap::HeightMap() : useMap(false), useBicubic(false) { }
 
 void HeightMap::SetGrid(const GridDefinition& gd)
 {
@@ -262,17 +268,234 @@ void HeightMap::SetGridHeight(size_t xIndex, size_t yIndex, float height)
 	}
 }
 
-// Return the minimum number of segments for a move by this X or Y amount
-// Note that deltaX and deltaY may be negative
-unsigned int HeightMap::GetMinimumSegments(float deltaX, float deltaY) const
+// Return the number of segments for a move if we split it so that Z follows the height map closely enough. See GetNextSegmentFraction for where the splits go.
+unsigned int HeightMap::GetMinimumSegments(float startX, float startY, float endX, float endY) const
+{
+	unsigned int numSegments = 0;
+	float fraction = 0.0;
+	do
+	{
+		fraction = GetNextSegmentFraction(startX, startY, endX, endY, fraction);
+		++numSegments;
+	} while (fraction < 1.0 && numSegments < MaxSegments);
+	return numSegments;
+}
+
+// Return the fraction of the way from the start to the end of the move at which the next segment should end, given that the previous one ended at 'fraction'.
+// Each segment moves Z in a straight line, so we end it at a grid line crossing chosen so that the line stays within MaxSegmentHeightError of the interpolated surface.
+// With bilinear interpolation the surface only has kinks at the grid lines, so a segment may always run to the first grid line it crosses; after that we merge further crossings
+// into it while the error allows, which avoids making separate short segments where the move crosses an X line and a Y line close together.
+// With bicubic interpolation the surface is smooth but curved, so grid lines are just convenient places to end segments and we shorten a segment further if it curves too much.
+float HeightMap::GetNextSegmentFraction(float startX, float startY, float endX, float endY, float fraction) const
+{
+	const float deltaX = endX - startX;
+	const float deltaY = endY - startY;
+	const float length = sqrtf(fsquare(deltaX) + fsquare(deltaY));
+	if (length <= MinSegmentLength)
+	{
+		return 1.0;
+	}
+
+	const float minStep = MinSegmentLength/length;
+	const float startHeight = GetInterpolatedHeightError(startX + deltaX * fraction, startY + deltaY * fraction);
+
+	// Heights at the grid line crossings and half way between them, which the straight line in Z from the start to the end of the segment must pass close to
+	float sampleFractions[2 * MaxMergedCrossings], sampleHeights[2 * MaxMergedCrossings];
+	size_t numSamples = 0;
+
+	float segmentEnd = fraction;
+	float lastCrossing = fraction;
+	float crossing = GetNextGridCrossing(startX, startY, deltaX, deltaY, fraction + minStep);
+	float crossingHeight;
+	for (unsigned int numCrossings = 1; ; ++numCrossings)
+	{
+		const float midFraction = 0.5 * (lastCrossing + crossing);
+		sampleFractions[numSamples] = midFraction;
+		sampleHeights[numSamples] = GetInterpolatedHeightError(startX + deltaX * midFraction, startY + deltaY * midFraction);
+		++numSamples;
+		crossingHeight = GetInterpolatedHeightError(startX + deltaX * crossing, startY + deltaY * crossing);
+		if (   (segmentEnd > fraction || useBicubic)
+			&& !IsWithinHeightTolerance(fraction, startHeight, crossing, crossingHeight, sampleFractions, sampleHeights, numSamples)
+		   )
+		{
+			break;
+		}
+		segmentEnd = crossing;
+		if (crossing >= 1.0 || numCrossings == MaxMergedCrossings)
+		{
+			break;
+		}
+		sampleFractions[numSamples] = crossing;
+		sampleHeights[numSamples] = crossingHeight;
+		++numSamples;
+		lastCrossing = crossing;
+		crossing = GetNextGridCrossing(startX, startY, deltaX, deltaY, crossing + minStep);
+	}
+
+	if (segmentEnd == fraction)
+	{
+		// Bicubic interpolation and the surface curves too much before the first grid line, so halve the segment until it is accurate enough or as short as we allow
+		float midHeight;
+		do
+		{
+			crossing = 0.5 * (fraction + crossing);
+			const float midFraction = 0.5 * (fraction + crossing);
+			midHeight = GetInterpolatedHeightError(startX + deltaX * midFraction, startY + deltaY * midFraction);
+			crossingHeight = GetInterpolatedHeightError(startX + deltaX * crossing, startY + deltaY * crossing);
+		} while (crossing - fraction > 2 * minStep && fabsf(midHeight - 0.5 * (startHeight + crossingHeight)) > MaxSegmentHeightError);
+		segmentEnd = max<float>(crossing, fraction + minStep);
+	}
+
+	// Don't leave a very short final segment
+	return ((1.0 - segmentEnd) * length < MinSegmentLength) ? 1.0 : segmentEnd;
+}
+
+// Return the fraction of the way along the move at which it next crosses a grid line within the grid, not before minFraction, or 1.0 if it doesn't cross any more grid lines
+float HeightMap::GetNextGridCrossing(float startX, float startY, float deltaX, float deltaY, float minFraction) const
+{
+	float nextFraction = 1.0;
+	if (minFraction >= 1.0)
+	{
+		return nextFraction;
+	}
+
+	if (deltaX != 0.0)
+	{
+		// Find the next X grid line in the direction of travel that is within the grid
+		const float gridX = (startX + deltaX * minFraction - def.xMin) * def.recipXspacing;
+		const float line = (deltaX > 0.0) ? max<float>(ceilf(gridX), 0.0) : min<float>(floorf(gridX), (float)(def.numX - 1));
+		if (line >= 0.0 && line <= (float)(def.numX - 1))
+		{
+			nextFraction = min<float>(nextFraction, (def.xMin + line * def.xSpacing - startX)/deltaX);
+		}
+	}
+
+	if (deltaY != 0.0)
+	{
+		// Find the next Y grid line in the direction of travel that is within the grid
+		const float gridY = (startY + deltaY * minFraction - def.yMin) * def.recipYspacing;
+		const float line = (deltaY > 0.0) ? max<float>(ceilf(gridY), 0.0) : min<float>(floorf(gridY), (float)(def.numY - 1));
+		if (line >= 0.0 && line <= (float)(def.numY - 1))
+		{
+			nextFraction = min<float>(nextFraction, (def.yMin + line * def.ySpacing - startY)/deltaY);
+		}
+	}
+
+	// Rounding error may put the crossing slightly before minFraction
+	return max<float>(nextFraction, minFraction);
+}
+
+// Return true if the straight line in Z between the start and end of a segment passes close enough to the sampled heights along it
+/*static*/ bool HeightMap::IsWithinHeightTolerance(float startFraction, float startHeight, float endFraction, float endHeight, const float sampleFractions[], const float sampleHeights[], size_t numSamples)
+{
+	const float slope = (endHeight - startHeight)/(endFraction - startFraction);
+	for (size_t i = 0; i < numSamples; ++i)
+	{
+		if (fabsf(sampleHeights[i] - startHeight - slope * (sampleFractions[i] - startFraction)) > MaxSegmentHeightError)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Return the coefficients of the bilinear height error along the line (startX + dx * d, startY + dy * d) as a quadratic a + b * t + c * t^2, where t is the distance beyond 'distance'.
+// The line must be travelled in the direction of increasing d. Also return the value of t at which the line leaves the grid cell, after which the coefficients are no longer valid.
+// Outside the grid the height error is clamped in the same way as in GetInterpolatedHeightError, so the regions beyond the edges behave like cells too.
+void HeightMap::GetLineCoefficients(float startX, float startY, float dx, float dy, float distance, float& a, float& b, float& c, float& cellLength) const
 {
-	const float xDistance = fabsf(deltaX);
-	unsigned int xSegments = (xDistance > 0.0) ? (unsigned int)(xDistance * def.recipXspacing + 0.4) : 1;
+	uint32_t xIndex, yIndex;
+	float u0, u1, v0, v1;
+	cellLength = std::numeric_limits<float>::infinity();
+	GetCellAlongLine(startX + dx * distance, dx, def.xMin, def.recipXspacing, def.numX, xIndex, u0, u1, cellLength);
+	GetCellAlongLine(startY + dy * distance, dy, def.yMin, def.recipYspacing, def.numY, yIndex, v0, v1, cellLength);
+
+	const uint32_t indexX0Y0 = GetMapIndex(xIndex, yIndex);
+	const float h00 = gridHeights[indexX0Y0];
+	const float h10 = gridHeights[indexX0Y0 + 1];
+	const float h01 = gridHeights[indexX0Y0 + def.numX];
+	const float h11 = gridHeights[indexX0Y0 + def.numX + 1];
+
+	// Within the cell the height is h00 + ex * u + ey * v + exy * u * v, where u and v are the fractional coordinates, which are linear in t
+	const float ex = h10 - h00, ey = h01 - h00, exy = h11 - h10 - h01 + h00;
+	a = h00 + ex * u0 + ey * v0 + exy * u0 * v0;
+	b = ex * u1 + ey * v1 + exy * (u0 * v1 + u1 * v0);
+	c = exy * u1 * v1;
+}
 
-	const float yDistance = fabsf(deltaY);
-	unsigned int ySegments = (yDistance > 0.0) ? (unsigned int)(yDistance * def.recipYspacing + 0.4) : 1;
+// Return the largest rate of change of the bilinear height error along the line (startX + dx * d, startY + dy * d) for d from 0 to 'distance', the largest change in that rate
+// where the line crosses into a new cell, and the largest value of the quadratic coefficient within a cell. These let the caller limit the speed of a motor that follows the height map.
+void HeightMap::GetLineSlopeLimits(float startX, float startY, float dx, float dy, float distance, float& maxSlope, float& maxSlopeChange, float& maxCurvature) const
+{
+	maxSlope = maxSlopeChange = maxCurvature = 0.0;
+	float d = 0.0;
+	float lastSlope = 0.0;
+	for (unsigned int numCells = 0; numCells < MaxSegments; ++numCells)
+	{
+		float a, b, c, cellLength;
+		GetLineCoefficients(startX, startY, dx, dy, d, a, b, c, cellLength);
+		if (numCells != 0)
+		{
+			maxSlopeChange = max<float>(maxSlopeChange, fabsf(b - lastSlope));
+		}
+		const float remaining = distance - d;
+		lastSlope = b + 2.0 * c * min<float>(cellLength, remaining);
+		maxSlope = max<float>(maxSlope, max<float>(fabsf(b), fabsf(lastSlope)));
+		maxCurvature = max<float>(maxCurvature, fabsf(c));
+		if (cellLength >= remaining)
+		{
+			break;
+		}
+		d += max<float>(cellLength, MinCellLength);
+	}
+}
 
-	return max<unsigned int>(xSegments, ySegments);
+// Find the cell along one axis that a line is entering at the specified coordinate, given the rate of change of the coordinate with distance along the line.
+// Return the cell index, the fractional position in the cell and its rate of change with distance, and reduce cellLength to the distance at which the line leaves the cell.
+// Beyond the edges of the grid the fractional position is clamped, so it doesn't change until the line reaches the edge.
+/*static*/ void HeightMap::GetCellAlongLine(float coord, float rate, float gridMin, float recipSpacing, uint32_t numPoints, uint32_t& index, float& frac, float& fracRate, float& cellLength)
+{
+	const float gridCoord = (coord - gridMin) * recipSpacing;
+	const float gridRate = rate * recipSpacing;
+	const float lastLine = (float)(numPoints - 1);
+	if (gridCoord < 0.0 || (gridCoord == 0.0 && gridRate < 0.0))
+	{
+		index = 0;
+		frac = fracRate = 0.0;
+		if (gridRate > 0.0)
+		{
+			cellLength = min<float>(cellLength, -gridCoord/gridRate);
+		}
+	}
+	else if (gridCoord > lastLine || (gridCoord == lastLine && gridRate >= 0.0))
+	{
+		index = numPoints - 2;
+		frac = 1.0;
+		fracRate = 0.0;
+		if (gridRate < 0.0)
+		{
+			cellLength = min<float>(cellLength, (lastLine - gridCoord)/gridRate);
+		}
+	}
+	else
+	{
+		float cell = floorf(gridCoord);
+		if (cell == lastLine || (cell == gridCoord && gridRate < 0.0))
+		{
+			cell -= 1.0;							// we are on a grid line and moving into the cell below it
+		}
+		index = (uint32_t)cell;
+		frac = gridCoord - cell;
+		fracRate = gridRate;
+		if (gridRate > 0.0)
+		{
+			cellLength = min<float>(cellLength, (cell + 1.0 - gridCoord)/gridRate);
+		}
+		else if (gridRate < 0.0)
+		{
+			cellLength = min<float>(cellLength, (cell - gridCoord)/gridRate);
+		}
+	}
 }
 
 // Save the grid to file returning true if an error occurred
@@ -476,26 +699,19 @@ float HeightMap::GetInterpolatedHeightError(float x, float y) const
 		return 0.0;
 	}
 
-	// Last grid point
-	const float xLast = def.xMin + (def.numX-1)*def.xSpacing;
-	const float yLast = def.yMin + (def.numY-1)*def.ySpacing;
-
-	// Clamp to rectangle so InterpolateXY will always have valid parameters
-	const float fEPSILON = 0.01;
-	if (x < def.xMin) { x = def.xMin; }
-	if (y < def.yMin) {	y = def.yMin; }
-	if (x > xLast -fEPSILON) { x = xLast -fEPSILON; }
-	if (y > yLast -fEPSILON) { y = yLast -fEPSILON; }
-
+	// Clamp to rectangle so that the interpolation functions will always have valid parameters
+	x = constrain<float>(x, def.xMin, def.xClampMax);
+	y = constrain<float>(y, def.yMin, def.yClampMax);
 
+	// The coordinates are now not negative relative to the grid, so we can truncate instead of calling floor
 	const float xf = (x - def.xMin) * def.recipXspacing;
-	const float xFloor = floor(xf);
-	const int32_t xIndex = (int32_t)xFloor;
+	const uint32_t xIndex = (uint32_t)xf;
 	const float yf = (y - def.yMin) * def.recipYspacing;
-	const float yFloor = floor(yf);
-	const int32_t yIndex = (int32_t)yFloor;
+	const uint32_t yIndex = (uint32_t)yf;
 
-	return InterpolateXY(xIndex, yIndex, xf - xFloor, yf - yFloor);
+	return (useBicubic)
+			? InterpolateBicubic(xIndex, yIndex, xf - (float)xIndex, yf - (float)yIndex)
+			: InterpolateXY(xIndex, yIndex, xf - (float)xIndex, yf - (float)yIndex);
 }
 
 float HeightMap::InterpolateXY(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const
@@ -512,6 +728,43 @@ float HeightMap::InterpolateXY(uint32_t xIndex, uint32_t yIndex, float xFrac, fl
 			+ (gridHeights[indexX1Y1] * xyFrac);
 }
 
+// Interpolate using Catmull-Rom splines through the 4x4 grid points around the cell. Unlike bilinear interpolation, this gives a surface with no kinks at the grid lines.
+// At the edges of the grid we repeat the edge points.
+float HeightMap::InterpolateBicubic(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const
+{
+	// Calculate the spline weights for the four points in each direction
+	float xWeights[4], yWeights[4];
+	for (size_t i = 0; i < 2; ++i)
+	{
+		const float t = (i == 0) ? xFrac : yFrac;
+		float * const w = (i == 0) ? xWeights : yWeights;
+		const float tSquared = fsquare(t);
+		const float tCubed = tSquared * t;
+		w[0] = 0.5 * (-tCubed + 2.0 * tSquared - t);
+		w[1] = 0.5 * (3.0 * tCubed - 5.0 * tSquared + 2.0);
+		w[2] = 0.5 * (-3.0 * tCubed + 4.0 * tSquared + t);
+		w[3] = 0.5 * (tCubed - tSquared);
+	}
+
+	uint32_t xIndices[4];
+	for (size_t i = 0; i < 4; ++i)
+	{
+		xIndices[i] = (uint32_t)constrain<int32_t>((int32_t)(xIndex + i) - 1, 0, (int32_t)def.numX - 1);
+	}
+
+	float height = 0.0;
+	for (size_t j = 0; j < 4; ++j)
+	{
+		const uint32_t rowStart = GetMapIndex(0, (uint32_t)constrain<int32_t>((int32_t)(yIndex + j) - 1, 0, (int32_t)def.numY - 1));
+		const float rowHeight = xWeights[0] * gridHeights[rowStart + xIndices[0]]
+							  + xWeights[1] * gridHeights[rowStart + xIndices[1]]
+							  + xWeights[2] * gridHeights[rowStart + xIndices[2]]
+							  + xWeights[3] * gridHeights[rowStart + xIndices[3]];
+		height += yWeights[j] * rowHeight;
+	}
+	return height;
+}
+
 void HeightMap::ExtrapolateMissing()
 {
 	//1: calculating the bed plane by least squares fit
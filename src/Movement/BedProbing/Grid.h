@@ -54,6 +54,7 @@ private:
 	// Derived parameters
 	uint32_t numX, numY;
 	float recipXspacing, recipYspacing;
+	float xClampMax, yClampMax;										// The largest coordinates we interpolate at, just short of the last grid lines
 	bool isValid;
 };
 
@@ -75,10 +76,19 @@ public:
 
 	bool LoadFromFile(FileStore *f, const StringRef& r);			// Load the grid from file returning true if an error occurred
 
-	unsigned int GetMinimumSegments(float deltaX, float deltaY) const;	// Return the minimum number of segments for a move by this X or Y amount
+	unsigned int GetMinimumSegments(float startX, float startY, float endX, float endY) const;
+																	// Return the number of segments for a move split so that Z follows the height map closely enough
+	float GetNextSegmentFraction(float startX, float startY, float endX, float endY, float fraction) const;
+																	// Return how far along a move the next segment should end
+	void GetLineCoefficients(float startX, float startY, float dx, float dy, float distance, float& a, float& b, float& c, float& cellLength) const;
+																	// Return the bilinear height error along a line as a quadratic in distance, and how far it remains valid
+	void GetLineSlopeLimits(float startX, float startY, float dx, float dy, float distance, float& maxSlope, float& maxSlopeChange, float& maxCurvature) const;
+																	// Return the largest slope, change of slope at a grid line and curvature of the bilinear height error along a line
 
 	bool UseHeightMap(bool b);
 	bool UsingHeightMap() const { return useMap; }
+	void UseBicubicInterpolation(bool b) { useBicubic = b; }
+	bool UsingBicubicInterpolation() const { return useBicubic; }
 
 	unsigned int GetStatistics(float& mean, float& deviation, float& minError, float& maxError) const;
 																	// Return number of points probed, mean and RMS deviation, min and max error
@@ -86,16 +96,26 @@ public:
 
 private:
 	static const char * const HeightMapComment;						// The start of the comment we write at the start of the height map file
+	static constexpr float MinSegmentLength = 0.5;					// Grid lines closer than this to the start of a segment don't cause a split
+	static constexpr unsigned int MaxSegments = 1000;				// Limit on the number of segments we split a move into
+	static constexpr float MinCellLength = 0.001;					// The minimum distance we treat as being in one grid cell, so that rounding error at the grid lines can't stall us
+	static constexpr unsigned int MaxMergedCrossings = 8;			// Limit on the number of grid line crossings we consider merging into one segment
+	static constexpr float MaxSegmentHeightError = 0.01;			// How far the straight line in Z along a segment may be from the interpolated height
 
 	GridDefinition def;
 	float gridHeights[MaxGridProbePoints];							// The Z coordinates of the points on the bed that were probed
 	uint32_t gridHeightSet[(MaxGridProbePoints + 31)/32];			// Bitmap of which heights are set
 	bool useMap;													// True to do bed compensation
+	bool useBicubic;												// True to use bicubic instead of bilinear interpolation
 
 	uint32_t GetMapIndex(uint32_t xIndex, uint32_t yIndex) const { return (yIndex * def.NumXpoints()) + xIndex; }
 	bool IsHeightSet(uint32_t index) const { return (gridHeightSet[index/32] & (1 << (index & 31))) != 0; }
 
 	float InterpolateXY(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const;
+	float InterpolateBicubic(uint32_t xIndex, uint32_t yIndex, float xFrac, float yFrac) const;
+	float GetNextGridCrossing(float startX, float startY, float deltaX, float deltaY, float minFraction) const;
+	static bool IsWithinHeightTolerance(float startFraction, float startHeight, float endFraction, float endHeight, const float sampleFractions[], const float sampleHeights[], size_t numSamples);
+	static void GetCellAlongLine(float coord, float rate, float gridMin, float recipSpacing, uint32_t numPoints, uint32_t& index, float& frac, float& fracRate, float& cellLength);
 };
 
 #endif /* SRC_MOVEMENT_GRID_H_ */
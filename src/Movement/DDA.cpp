@@ -116,7 +116,8 @@ void DDA::LogProbePosition()
 
 DDA::DDA(DDA* n) : next(n), prev(nullptr), state(empty)
 {
-	activeDMs = completedDMs = nullptr;
+	ClearActiveDMs();
+	completedDMs = nullptr;
 
 	// Set the endpoints to zero, because Move will ask for them.
 	// They will be wrong if we are on a delta. We take care of that when we process the M665 command in config.g.
@@ -137,19 +138,27 @@ DDA::DDA(DDA* n) : next(n), prev(nullptr), state(empty)
 void DDA::ReleaseDMs()
 {
 	// Normally there should be no active DMs, but release any that there may be
+#if DDA_USE_DM_HEAP
+	for (size_t i = 0; i < numActiveDMs; ++i)
+	{
+		DriveMovement::Release(activeDMs[i]);
+	}
+#else
 	for (DriveMovement* dm = activeDMs; dm != nullptr; )
 	{
 		DriveMovement* const next = dm->nextDM;
 		DriveMovement::Release(dm);
 		dm = next;
 	}
+#endif
 	for (DriveMovement* dm = completedDMs; dm != nullptr; )
 	{
 		DriveMovement* const next = dm->nextDM;
 		DriveMovement::Release(dm);
 		dm = next;
 	}
-	activeDMs = completedDMs = nullptr;
+	ClearActiveDMs();
+	completedDMs = nullptr;
 }
 
 // Return the number of clocks this DDA still needs to execute.
@@ -162,6 +171,91 @@ pre(state == executing || state == frozen || state == completed)
 			: (int32_t)clocksNeeded;
 }
 
+#if DDA_USE_DM_HEAP
+
+// Insert the specified drive into the step heap, keeping the drive with the earliest step time at the root.
+// Now that we generate step pulses for multiple motors simultaneously, there is no need to preserve round-robin order between drives with the same step time.
+inline void DDA::InsertDM(DriveMovement *dm)
+pre(numActiveDMs < MaxTotalDrivers)
+{
+	size_t index = numActiveDMs++;
+	while (index != 0)
+	{
+		const size_t parent = (index - 1)/2;
+		if (activeDMs[parent]->nextStepTime <= dm->nextStepTime)
+		{
+			break;
+		}
+		activeDMs[index] = activeDMs[parent];
+		index = parent;
+	}
+	activeDMs[index] = dm;
+}
+
+// Remove the drive at the specified position in the step heap and return it
+inline DriveMovement *DDA::RemoveActiveDM(size_t index)
+pre(index < numActiveDMs)
+{
+	DriveMovement * const removed = activeDMs[index];
+	--numActiveDMs;
+	if (index < numActiveDMs)
+	{
+		// Move the last entry into the gap. It may need to move up if we didn't remove the root, else it may need to move down.
+		DriveMovement * const dm = activeDMs[numActiveDMs];
+		while (index != 0 && activeDMs[(index - 1)/2]->nextStepTime > dm->nextStepTime)
+		{
+			activeDMs[index] = activeDMs[(index - 1)/2];
+			index = (index - 1)/2;
+		}
+		for (;;)
+		{
+			size_t child = 2 * index + 1;
+			if (child >= numActiveDMs)
+			{
+				break;
+			}
+			if (child + 1 < numActiveDMs && activeDMs[child + 1]->nextStepTime < activeDMs[child]->nextStepTime)
+			{
+				++child;
+			}
+			if (activeDMs[child]->nextStepTime >= dm->nextStepTime)
+			{
+				break;
+			}
+			activeDMs[index] = activeDMs[child];
+			index = child;
+		}
+		activeDMs[index] = dm;
+	}
+	return removed;
+}
+
+// Remove and return the drive with the earliest step time
+inline DriveMovement *DDA::RemoveFirstDM()
+pre(numActiveDMs != 0)
+{
+	return RemoveActiveDM(0);
+}
+
+// Remove this drive from the heap of drives with steps due and put it in the completed list
+// Called from the step ISR only.
+void DDA::DeactivateDM(size_t drive)
+{
+	for (size_t i = 0; i < numActiveDMs; ++i)
+	{
+		if (activeDMs[i]->drive == drive)
+		{
+			DriveMovement * const dm = RemoveActiveDM(i);
+			dm->state = DMState::idle;
+			dm->nextDM = completedDMs;
+			completedDMs = dm;
+			break;
+		}
+	}
+}
+
+#else
+
 // Insert the specified drive into the step list, in step time order.
 // We insert the drive before any existing entries with the same step time for best performance. Now that we generate step pulses
 // for multiple motors simultaneously, there is no need to preserve round-robin order.
@@ -176,6 +270,15 @@ inline void DDA::InsertDM(DriveMovement *dm)
 	*dmp = dm;
 }
 
+// Remove and return the drive with the earliest step time
+inline DriveMovement *DDA::RemoveFirstDM()
+pre(activeDMs != nullptr)
+{
+	DriveMovement * const dm = activeDMs;
+	activeDMs = dm->nextDM;
+	return dm;
+}
+
 // Remove this drive from the list of drives with steps due and put it in the completed list
 // Called from the step ISR only.
 void DDA::DeactivateDM(size_t drive)
@@ -196,6 +299,52 @@ void DDA::DeactivateDM(size_t drive)
 	}
 }
 
+#endif
+
+// Time how long it takes to take the drive with the earliest step time out of the step list or heap and insert it back again,
+// which is what the step ISR does after generating each step. Each drive is given a different step interval so that the order keeps changing.
+void DDA::TimeStepScheduling(const StringRef& reply)
+{
+	constexpr size_t MaxTestDrives = (NumDirectDrivers < 12) ? NumDirectDrivers : 12;
+	DDA * const dda = new DDA(nullptr);
+	DriveMovement *dms[MaxTestDrives];
+	for (DriveMovement*& dm : dms)
+	{
+		dm = new DriveMovement(nullptr);
+	}
+
+	reply.printf("Step scheduling (%s):", (DDA_USE_DM_HEAP) ? "heap" : "list");
+	for (size_t numDrives = 3; numDrives <= MaxTestDrives; numDrives += 3)
+	{
+		dda->ClearActiveDMs();
+		for (size_t i = 0; i < numDrives; ++i)
+		{
+			dms[i]->drive = i;
+			dms[i]->nextStepTime = 0;
+			dms[i]->stepInterval = 100 + 37 * i;
+			dda->InsertDM(dms[i]);
+		}
+
+		uint32_t tim = 0;
+		for (unsigned int i = 0; i < 100; ++i)
+		{
+			const uint32_t now = StepTimer::GetInterruptClocks();
+			DriveMovement * const dm = dda->RemoveFirstDM();
+			dm->nextStepTime += dm->stepInterval;
+			dda->InsertDM(dm);
+			tim += StepTimer::GetInterruptClocks() - now;
+		}
+		reply.catf(" %u drives %.2fus", numDrives, (double)(tim * 10000)/StepTimer::StepClockRate);
+	}
+
+	dda->ClearActiveDMs();
+	for (DriveMovement* dm : dms)
+	{
+		delete dm;
+	}
+	delete dda;
+}
+
 void DDA::DebugPrintVector(const char *name, const float *vec, size_t len) const
 {
 	debugPrintf("%s=", name);
@@ -235,10 +384,17 @@ void DDA::DebugPrint(const char *tag) const
 void DDA::DebugPrintAll(const char *tag) const
 {
 	DebugPrint(tag);
+#if DDA_USE_DM_HEAP
+	for (size_t i = 0; i < numActiveDMs; ++i)
+	{
+		activeDMs[i]->DebugPrint();
+	}
+#else
 	for (DriveMovement* dm = activeDMs; dm != nullptr; dm = dm->nextDM)
 	{
 		dm->DebugPrint();
 	}
+#endif
 	for (DriveMovement* dm = completedDMs; dm != nullptr; dm = dm->nextDM)
 	{
 		dm->DebugPrint();
@@ -259,6 +415,19 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 		endPoint[axis] = positionNow[axis];
 	}
 
+#if SUPPORT_ASYNC_MOVES
+	// Axes that belong to other DDA rings must not move in this one. The coordinates we hold for them may be out of date, but that doesn't matter because we never use them.
+	// Move::AssignAxesToRing only allows axes that don't share motors with other axes to be assigned to auxiliary rings, so we can use the axis numbers as motor numbers.
+	const AxesBitmap ringAxes = ring.GetOwnAxes();
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		if (!IsBitSet(ringAxes, axis))
+		{
+			nextMove.coords[axis] = prev->GetEndCoordinate(axis, false);
+		}
+	}
+#endif
+
 	// 1. Compute the new endpoints and the movement vector
 	const Move& move = reprap.GetMove();
 	if (doMotorMapping)
@@ -267,6 +436,15 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 		{
 			return false;												// throw away the move if it couldn't be transformed
 		}
+#if SUPPORT_ASYNC_MOVES
+		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+		{
+			if (!IsBitSet(ringAxes, axis))
+			{
+				endPoint[axis] = positionNow[axis];						// make sure that rounding error in the inverse kinematics can't move these motors
+			}
+		}
+#endif
 		flags.isDeltaMovement = move.IsDeltaMode()
 							&& (endPoint[X_AXIS] != positionNow[X_AXIS] || endPoint[Y_AXIS] != positionNow[Y_AXIS] || endPoint[Z_AXIS] != positionNow[Z_AXIS]);
 	}
@@ -293,7 +471,11 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 		{
 			if (!doMotorMapping && drive < numVisibleAxes)
 			{
+#if SUPPORT_ASYNC_MOVES
+				endPoint[drive] = (IsBitSet(ringAxes, drive)) ? Move::MotorMovementToSteps(drive, nextMove.coords[drive]) : positionNow[drive];
+#else
 				endPoint[drive] = Move::MotorMovementToSteps(drive, nextMove.coords[drive]);
+#endif
 			}
 
 			int32_t delta = endPoint[drive] - positionNow[drive];
@@ -351,6 +533,25 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 		}
 	}
 
+#if SUPPORT_NATIVE_ARCS
+	// An arc move may move the X and Y motors even if it ends where it started
+	flags.isArc = nextMove.isNativeArc && doMotorMapping;
+	if (flags.isArc)
+	{
+		realMove = axesMoving = true;
+		flags.xyMoving = true;
+	}
+#else
+	flags.isArc = false;
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+	// GCodes only asks for this if the move wasn't split where it crosses the grid lines, so the Z motor must follow the height map even if Z doesn't move overall
+	flags.followsMesh = nextMove.followMesh && nextMove.moveType == 0 && doMotorMapping && flags.xyMoving && !flags.isArc;
+#else
+	flags.followsMesh = false;
+#endif
+
 	// 2. Throw it away if there's no real movement.
 	if (!realMove)
 	{
@@ -408,9 +609,29 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 	{
 		// There is some XY movement, so normalise the direction vector so that the total XYZ movement has unit length and 'totalDistance' is the XYZ distance moved.
 		// This means that the user gets the feed rate that he asked for. It also makes the delta calculations simpler.
+#if SUPPORT_NATIVE_ARCS
+		if (flags.isArc)
+		{
+			// Replace the XY chord by the arc length in the direction of the tangent at the end of the arc, which is the direction that the next move needs for lookahead
+			arc.radius = nextMove.arcRadius;
+			arc.startAngle = nextMove.arcStartAngle;
+			arc.totalAngle = nextMove.arcTotalAngle;
+			const float signedArcLength = arc.radius * arc.totalAngle;
+			directionVector[X_AXIS] = -signedArcLength * sinf(arc.startAngle + arc.totalAngle);
+			directionVector[Y_AXIS] = signedArcLength * cosf(arc.startAngle + arc.totalAngle);
+		}
+#endif
 		// First do the bed tilt compensation for deltas.
 		directionVector[Z_AXIS] += (directionVector[X_AXIS] * k.GetTiltCorrection(X_AXIS)) + (directionVector[Y_AXIS] * k.GetTiltCorrection(Y_AXIS));
 		totalDistance = NormaliseXYZ();
+#if SUPPORT_NATIVE_ARCS
+		if (flags.isArc)
+		{
+			const float signedXyFraction = (arc.radius * arc.totalAngle)/totalDistance;
+			arc.startDirection[X_AXIS] = -signedXyFraction * sinf(arc.startAngle);
+			arc.startDirection[Y_AXIS] = signedXyFraction * cosf(arc.startAngle);
+		}
+#endif
 	}
 	else if (axesMoving)
 	{
@@ -435,6 +656,13 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 	float normalisedDirectionVector[MaxTotalDrivers];			// used to hold a unit-length vector in the direction of motion
 	memcpy(normalisedDirectionVector, directionVector, sizeof(normalisedDirectionVector));
 	Absolute(normalisedDirectionVector, MaxTotalDrivers);
+#if SUPPORT_NATIVE_ARCS
+	if (flags.isArc)
+	{
+		// The X and Y components change along an arc, so use the largest values that either of them can reach
+		normalisedDirectionVector[X_AXIS] = normalisedDirectionVector[Y_AXIS] = sqrtf(fsquare(directionVector[X_AXIS]) + fsquare(directionVector[Y_AXIS]));
+	}
+#endif
 	acceleration = beforePrepare.maxAcceleration = VectorBoxIntersection(normalisedDirectionVector, accelerations, MaxTotalDrivers);
 	if (flags.xyMoving)											// apply M204 acceleration limits to XY moves
 	{
@@ -476,6 +704,114 @@ bool DDA::InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMoto
 		k.LimitSpeedAndAcceleration(*this, normalisedDirectionVector, numVisibleAxes, flags.continuousRotationShortcut);	// give the kinematics the chance to further restrict the speed and acceleration
 	}
 
+#if SUPPORT_NATIVE_ARCS
+	if (flags.isArc)
+	{
+		// Limit the XY speed so that the centripetal acceleration doesn't exceed the acceleration we are using
+		const float maxXySpeed = sqrtf(acceleration * arc.radius);
+		const float xyFraction = normalisedDirectionVector[X_AXIS];
+		if (requestedSpeed * xyFraction > maxXySpeed)
+		{
+			requestedSpeed = maxXySpeed/xyFraction;
+		}
+	}
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+	if (flags.followsMesh)
+	{
+		// The Z motor follows the height map, so it moves faster than the net Z movement suggests, its speed changes by the speed times the change in slope
+		// wherever the move crosses a grid line, and it accelerates within each cell as the slope changes. Limit the speed and acceleration to allow for this.
+		// The lookahead only sees the net Z movement, so also limit the Z speed change at the start and end of the move due to the slope there.
+		const float startX = endCoordinates[X_AXIS] + Tool::GetOffset(tool, X_AXIS) - directionVector[X_AXIS] * totalDistance;
+		const float startY = endCoordinates[Y_AXIS] + Tool::GetOffset(tool, Y_AXIS) - directionVector[Y_AXIS] * totalDistance;
+		float maxSlope, maxSlopeChange, maxCurvature;
+		move.AccessHeightMap().GetLineSlopeLimits(startX, startY, directionVector[X_AXIS], directionVector[Y_AXIS], totalDistance, maxSlope, maxSlopeChange, maxCurvature);
+		const Platform& platform = reprap.GetPlatform();
+		const float maxZRate = fabsf(directionVector[Z_AXIS]) + maxSlope;
+		if (maxZRate > 0.0)
+		{
+			requestedSpeed = min<float>(requestedSpeed, platform.MaxFeedrate(Z_AXIS)/maxZRate);
+			acceleration = deceleration = min<float>(acceleration, accelerations[Z_AXIS]/maxZRate);
+		}
+		const float maxJerkSlope = max<float>(maxSlope, maxSlopeChange);
+		if (maxJerkSlope > 0.0)
+		{
+			requestedSpeed = min<float>(requestedSpeed, platform.GetInstantDv(Z_AXIS)/maxJerkSlope);
+		}
+		if (maxCurvature > 0.0)
+		{
+			requestedSpeed = min<float>(requestedSpeed, sqrtf(accelerations[Z_AXIS]/(2.0 * maxCurvature)));
+		}
+	}
+#endif
+
+	// Limit the speed of printing moves so that the extrusion doesn't exceed the maximum volumetric flow rate of the tool.
+	// The lookahead works from the requested speed, so it takes account of this automatically.
+	if (flags.isPrintingMove && tool != nullptr && tool->GetMaxFilamentSpeed() > 0.0)
+	{
+		float extrusionPerMm = 0.0;
+		for (size_t drive = numTotalAxes; drive < MaxTotalDrivers; ++drive)
+		{
+			if (directionVector[drive] > 0.0)
+			{
+				extrusionPerMm += directionVector[drive];
+			}
+		}
+		if (requestedSpeed * extrusionPerMm > tool->GetMaxFilamentSpeed())
+		{
+			requestedSpeed = tool->GetMaxFilamentSpeed()/extrusionPerMm;
+		}
+	}
+
+#if SUPPORT_MOTION_SHAPING
+	// S-curve acceleration ramps the acceleration up and down, so the peak acceleration in a phase lasting T with jerk time Tj is T/(T - Tj) times the average.
+	// Input shaping shortens the acceleration pulse by the extra time of the shaper, which has the same effect.
+	// Plan with a lower average acceleration so that a phase from rest to the requested speed has room for both without exceeding the limit.
+	// Prepare shortens the jerk time of any phase that would still exceed it, and DriveMovement doesn't apply the shaper to phases that are too short.
+	maxShapedAcceleration = acceleration;
+	if (!flags.usesEndstops && !flags.isDeltaMovement)
+	{
+		// Only the motors that move matter. Motors that follow an arc or the height map use S-curve acceleration but no input shaper,
+		// and extruders that use pressure advance use neither.
+		bool usesSCurve = false;
+		float shaperExtraClocks = 0.0;
+		for (size_t drive = 0; drive < numTotalAxes; ++drive)
+		{
+			if (   (flags.isArc && (k.GetMotorCoefficient(X_AXIS, drive) != 0.0 || k.GetMotorCoefficient(Y_AXIS, drive) != 0.0))
+				|| (flags.followsMesh && drive == Z_AXIS)
+			   )
+			{
+				usesSCurve = true;
+			}
+			else if (endPoint[drive] != positionNow[drive])
+			{
+				usesSCurve = true;
+				const AxisShaper * const shaper = move.GetMotorShaper(drive);
+				if (shaper != nullptr)
+				{
+					shaperExtraClocks = max<float>(shaperExtraClocks, shaper->GetExtraClocks());
+				}
+			}
+		}
+		for (size_t drive = numTotalAxes; drive < MaxTotalDrivers && !usesSCurve; ++drive)
+		{
+			if (directionVector[drive] != 0.0)
+			{
+				const size_t extruder = drive - numTotalAxes;
+				usesSCurve = !flags.usePressureAdvance || directionVector[drive] < 0.0
+							|| (reprap.GetPlatform().GetPressureAdvance(extruder) <= 0.0 && reprap.GetPlatform().GetPressureAdvanceQuadratic(extruder) <= 0.0);
+			}
+		}
+
+		const float shapingTime = ((usesSCurve) ? move.GetSCurveTime() : 0.0) + shaperExtraClocks * (1.0/(float)StepTimer::StepClockRate);
+		if (shapingTime > 0.0)
+		{
+			acceleration = deceleration = (acceleration * requestedSpeed)/(requestedSpeed + acceleration * shapingTime);
+		}
+	}
+#endif
+
 	// 7. Calculate the provisional accelerate and decelerate distances and the top speed
 	endSpeed = 0.0;							// until the next move asks us to adjust it
 
@@ -525,6 +861,8 @@ bool DDA::InitLeadscrewMove(DDARing& ring, float feedrate, const float adjustmen
 	// 3. Store some values
 	flags.isLeadscrewAdjustmentMove = true;
 	flags.isDeltaMovement = false;
+	flags.isArc = false;
+	flags.followsMesh = false;
 	flags.isPrintingMove = false;
 	flags.xyMoving = false;
 	flags.canPauseAfter = true;
@@ -539,6 +877,9 @@ bool DDA::InitLeadscrewMove(DDARing& ring, float feedrate, const float adjustmen
 	filePos = prev->filePos;
 	flags.endCoordinatesValid = prev->flags.endCoordinatesValid;
 	acceleration = deceleration = reprap.GetPlatform().Accelerations()[Z_AXIS];
+#if SUPPORT_MOTION_SHAPING
+	maxShapedAcceleration = acceleration;
+#endif
 
 #if SUPPORT_LASER && SUPPORT_IOBITS
 	if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
@@ -646,9 +987,18 @@ pre(state == provisional)
 				   )
 				{
 					laDDA->MatchSpeeds();
-					const float maxStartSpeed = sqrtf(fsquare(laDDA->beforePrepare.targetNextSpeed) + (2 * laDDA->deceleration * laDDA->totalDistance));
-					laDDA->prev->beforePrepare.targetNextSpeed = min<float>(maxStartSpeed, laDDA->requestedSpeed);
-					// leave 'recurse' true
+					const float maxStartSpeed = min<float>(sqrtf(fsquare(laDDA->beforePrepare.targetNextSpeed) + (2 * laDDA->deceleration * laDDA->totalDistance)), laDDA->requestedSpeed);
+					if (laDDA->prev->endSpeed >= maxStartSpeed)
+					{
+						// The previous move already ends at the highest speed that this move can use, so there is no point in revisiting it or any earlier moves.
+						// This stops long chains of short deceleration-only moves being walked back every time a new move is added.
+						goingUp = false;
+					}
+					else
+					{
+						laDDA->prev->beforePrepare.targetNextSpeed = maxStartSpeed;
+						// leave 'recurse' true
+					}
 				}
 				else
 				{
@@ -757,7 +1107,7 @@ float DDA::AdvanceBabyStepping(DDARing& ring, size_t axis, float amount)
 	while(cdda != this)
 	{
 		float babySteppingToDo = 0.0;
-		if (amount != 0.0 && cdda->flags.xyMoving)
+		if (amount != 0.0 && cdda->flags.xyMoving && !cdda->flags.isArc)
 		{
 			// Limit the babystepping Z speed to the lower of 0.1 times the original XYZ speed and 0.5 times the Z jerk
 			const float maxBabySteppingAmount = cdda->totalDistance * min<float>(0.1, 0.5 * reprap.GetPlatform().GetInstantDv(Z_AXIS)/cdda->topSpeed);
@@ -886,13 +1236,44 @@ void DDA::RecalculateMove(DDARing& ring)
 // Decide what speed we would really like this move to end at.
 // On entry, targetNextSpeed is the speed we would like the next move after this one to start at and this one to end at
 // On return, targetNextSpeed is the actual speed we can achieve without exceeding the jerk limits.
+// If junction deviation is configured and both moves include XY movement, the XYZ speed at the junction is limited by the junction deviation instead of the XYZ jerk limits.
 void DDA::MatchSpeeds()
 {
-	for (size_t drive = 0; drive < MaxTotalDrivers; ++drive)
+	size_t firstJerkDrive = 0;
+	const float junctionDeviation = reprap.GetMove().GetJunctionDeviation();
+	if (junctionDeviation > 0.0 && flags.xyMoving && next->flags.xyMoving)
+	{
+		// The XYZ parts of both direction vectors have unit length, so the dot product is the cosine of the angle between the two moves.
+		// Treat the corner as an arc that deviates from the corner point by the junction deviation and limit the centripetal acceleration to the acceleration we are using.
+		const float cosTheta = -(  directionVector[X_AXIS] * next->GetStartDirection(X_AXIS)
+								 + directionVector[Y_AXIS] * next->GetStartDirection(Y_AXIS)
+								 + directionVector[Z_AXIS] * next->GetStartDirection(Z_AXIS));
+		if (cosTheta > 0.999999)
+		{
+			// The move reverses direction, so we can't use the junction deviation model. Use the jerk limits instead.
+		}
+		else
+		{
+			if (cosTheta > -0.999999)								// if the moves are not in a straight line
+			{
+				const float sinHalfTheta = sqrtf(0.5 * (1.0 - cosTheta));
+				const float junctionAcceleration = min<float>(deceleration, next->acceleration);
+				const float maxJunctionSpeed = sqrtf((junctionAcceleration * junctionDeviation * sinHalfTheta)/(1.0 - sinHalfTheta));
+				if (beforePrepare.targetNextSpeed > maxJunctionSpeed)
+				{
+					beforePrepare.targetNextSpeed = maxJunctionSpeed;
+				}
+			}
+			firstJerkDrive = XYZ_AXES;								// the jerk limits still apply to other axes and extruders
+		}
+	}
+
+	for (size_t drive = firstJerkDrive; drive < MaxTotalDrivers; ++drive)
 	{
-		if (directionVector[drive] != 0.0 || next->directionVector[drive] != 0.0)
+		const float nextDirection = next->GetStartDirection(drive);
+		if (directionVector[drive] != 0.0 || nextDirection != 0.0)
 		{
-			const float totalFraction = fabsf(directionVector[drive] - next->directionVector[drive]);
+			const float totalFraction = fabsf(directionVector[drive] - nextDirection);
 			const float jerk = totalFraction * beforePrepare.targetNextSpeed;
 			const float allowedJerk = reprap.GetPlatform().GetInstantDv(drive);
 			if (jerk > allowedJerk)
@@ -1092,9 +1473,10 @@ inline void DDA::AdjustAcceleration()
 
 // Prepare this DDA for execution.
 // This must not be called with interrupts disabled, because it calls Platform::EnableDrive.
-void DDA::Prepare(uint8_t simMode, float extrusionPending[])
+void DDA::Prepare(uint8_t simMode, float extrusionPending[], float pressureAdvanceLag[])
 {
 	if (   flags.xyMoving
+		&& !flags.isArc
 		&& reprap.GetMove().IsDRCenabled()
 		&& topSpeed > startSpeed && topSpeed > endSpeed
 		&& (fabsf(directionVector[X_AXIS]) > 0.5 || fabsf(directionVector[Y_AXIS]) > 0.5)
@@ -1116,7 +1498,9 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 	params.decelDistance = beforePrepare.decelDistance;
 	params.decelStartDistance = totalDistance - beforePrepare.decelDistance;
 
-	if (simMode == 0)
+	// In step timing simulation mode we do all the calculations, but we must not enable or move any motors
+	const bool live = (simMode == 0);
+	if (live || simMode == StepTimingSimulationMode)
 	{
 		if (flags.isDeltaMovement)
 		{
@@ -1154,10 +1538,51 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 		afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks = params.topSpeedTimesCdivD + (uint32_t)roundU32(decelStartTime * StepTimer::StepClockRate);
 		afterPrepare.extraAccelerationClocks = roundS32((accelStopTime - (beforePrepare.accelDistance/topSpeed)) * StepTimer::StepClockRate);
 
-		activeDMs = completedDMs = nullptr;
+#if SUPPORT_MOTION_SHAPING
+		// Decide whether to use S-curve acceleration and input shaping. We don't use them for homing and probing moves, because ReduceHomingSpeed assumes constant acceleration.
+		const float sCurveClocks = reprap.GetMove().GetSCurveTime() * StepTimer::StepClockRate;
+		flags.shapedAcceleration = (sCurveClocks > 0.0 || reprap.GetMove().IsInputShapingEnabled()) && !flags.usesEndstops && !flags.isDeltaMovement && !flags.isLeadscrewAdjustmentMove;
+#else
+		flags.shapedAcceleration = false;
+#endif
+#if SUPPORT_MOTION_SHAPING || SUPPORT_NATIVE_ARCS
+		// The shaped acceleration, arc and mesh-following step calculations use floating point phase times and distances
+		if (flags.shapedAcceleration || flags.isArc || flags.followsMesh)
+		{
+			afterPrepare.accelClocks = accelStopTime * StepTimer::StepClockRate;
+			afterPrepare.decelClocks = ((topSpeed - endSpeed)/deceleration) * StepTimer::StepClockRate;
+			afterPrepare.decelStartClocks = decelStartTime * StepTimer::StepClockRate;
+			afterPrepare.decelStartDistance = params.decelStartDistance;
+			afterPrepare.accelStopDistance = params.accelDistance;
+# if SUPPORT_MOTION_SHAPING
+			// The peak acceleration is speedChange/(phaseClocks - jerkClocks), so limit the jerk time to keep it within the acceleration limit of the move
+			const float minAccelPulseClocks = ((topSpeed - startSpeed)/maxShapedAcceleration) * StepTimer::StepClockRate;
+			const float minDecelPulseClocks = ((topSpeed - endSpeed)/maxShapedAcceleration) * StepTimer::StepClockRate;
+			afterPrepare.accelJerkClocks = max<float>(min<float>(min<float>(sCurveClocks, 0.5 * afterPrepare.accelClocks), afterPrepare.accelClocks - minAccelPulseClocks), 0.0);
+			afterPrepare.decelJerkClocks = max<float>(min<float>(min<float>(sCurveClocks, 0.5 * afterPrepare.decelClocks), afterPrepare.decelClocks - minDecelPulseClocks), 0.0);
+
+			// Calculate the peak acceleration and jerk here so that the step time calculation doesn't need to divide
+			constexpr float SecondsPerStepClock = 1.0/(float)StepTimer::StepClockRate;
+			afterPrepare.accelPeak = (afterPrepare.accelClocks > 0.0)
+										? ((topSpeed - startSpeed) * SecondsPerStepClock)/(afterPrepare.accelClocks - afterPrepare.accelJerkClocks)
+										: 0.0;
+			afterPrepare.decelPeak = (afterPrepare.decelClocks > 0.0)
+										? ((endSpeed - topSpeed) * SecondsPerStepClock)/(afterPrepare.decelClocks - afterPrepare.decelJerkClocks)
+										: 0.0;
+			afterPrepare.accelJerk = (afterPrepare.accelJerkClocks > 0.0) ? afterPrepare.accelPeak/afterPrepare.accelJerkClocks : 0.0;
+			afterPrepare.decelJerk = (afterPrepare.decelJerkClocks > 0.0) ? afterPrepare.decelPeak/afterPrepare.decelJerkClocks : 0.0;
+# endif
+		}
+#endif
+
+		ClearActiveDMs();
+		completedDMs = nullptr;
 
 #if SUPPORT_CAN_EXPANSION
-		CanInterface::StartMovement(*this);
+		if (live)
+		{
+			CanInterface::StartMovement(*this);
+		}
 #endif
 
 		// Handle all drivers
@@ -1176,7 +1601,10 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 					pdm->direction = (delta >= 0);
 					if (drive < NumDirectDrivers)							// if the drive is local
 					{
-						reprap.GetPlatform().EnableDrive(Z_AXIS);			// ensure all Z motors are enabled
+						if (live)
+						{
+							reprap.GetPlatform().EnableDrive(Z_AXIS);		// ensure all Z motors are enabled
+						}
 						if (pdm->PrepareCartesianAxis(*this, params))
 						{
 							// Check for sensible values, print them if they look dubious
@@ -1215,7 +1643,10 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 				if (platform.GetDriversBitmap(drive) != 0)					// if any of the drives is local
 				{
 #if !SUPPORT_CAN_EXPANSION
-					reprap.GetPlatform().EnableDrive(drive);
+					if (live)
+					{
+						reprap.GetPlatform().EnableDrive(drive);
+					}
 #endif
 					if (pdm->PrepareDeltaAxis(*this, params))
 					{
@@ -1241,21 +1672,122 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 				}
 
 #if SUPPORT_CAN_EXPANSION
-				const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
-				for (size_t i = 0; i < config.numDrivers; ++i)
+				if (live)
 				{
-					const size_t driver = config.driverNumbers[i];
-					if (driver >= NumDirectDrivers)
+					const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
+					for (size_t i = 0; i < config.numDrivers; ++i)
 					{
-						CanInterface::AddMovement(*this, params, driver - NumDirectDrivers, pdm->GetSteps());
+						const size_t driver = config.driverNumbers[i];
+						if (driver >= NumDirectDrivers)
+						{
+							CanInterface::AddMovement(*this, params, driver - NumDirectDrivers, pdm->GetSteps());
+						}
+						else
+						{
+							platform.EnableDriver(driver);
+						}
+					}
+				}
+#endif
+			}
+#if SUPPORT_NATIVE_ARCS
+			else if (   flags.isArc && drive < numTotalAxes
+					 && (reprap.GetMove().GetKinematics().GetMotorCoefficient(X_AXIS, drive) != 0.0 || reprap.GetMove().GetKinematics().GetMotorCoefficient(Y_AXIS, drive) != 0.0)
+					)
+			{
+				// It's a drive that follows the arc. It may move and reverse direction even if its start and end positions are the same.
+				const int32_t delta = endPoint[drive] - prev->endPoint[drive];
+				if (platform.GetDriversBitmap(drive) != 0)						// if any of the drives is local
+				{
+# if !SUPPORT_CAN_EXPANSION
+					if (live)
+					{
+						reprap.GetPlatform().EnableDrive(drive);
+					}
+# endif
+					DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::moving);
+					pdm->totalSteps = labs(delta);
+					pdm->direction = (delta >= 0);
+					if (pdm->PrepareArcAxis(*this))
+					{
+						// Check for sensible values, print them if they look dubious
+						if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
+						{
+							DebugPrintAll("pa");
+						}
+						InsertDM(pdm);
 					}
 					else
 					{
-						platform.EnableDriver(driver);
+						pdm->state = DMState::idle;
+						pdm->nextDM = completedDMs;
+						completedDMs = pdm;
 					}
 				}
+
+# if SUPPORT_CAN_EXPANSION
+				if (live)
+				{
+					// Move::CanUseNativeArcs doesn't allow arc moves if any axis drivers are remote
+					const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
+					for (size_t i = 0; i < config.numDrivers; ++i)
+					{
+						platform.EnableDriver(config.driverNumbers[i]);
+					}
+				}
+# endif
+				SetBit(axisMotorsEnabled, drive);
+				additionalAxisMotorsToEnable |= reprap.GetMove().GetKinematics().GetConnectedAxes(drive);
+			}
 #endif
+#if SUPPORT_SEGMENT_FREE_MESH
+			else if (flags.followsMesh && drive == Z_AXIS)
+			{
+				// It's the Z motor following the height map. It may move and reverse direction even if its start and end positions are the same.
+				const int32_t delta = endPoint[drive] - prev->endPoint[drive];
+				if (platform.GetDriversBitmap(drive) != 0)						// if any of the drives is local
+				{
+# if !SUPPORT_CAN_EXPANSION
+					if (live)
+					{
+						reprap.GetPlatform().EnableDrive(drive);
+					}
+# endif
+					DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::moving);
+					pdm->totalSteps = labs(delta);
+					pdm->direction = (delta >= 0);
+					if (pdm->PrepareMeshAxis(*this))
+					{
+						// Check for sensible values, print them if they look dubious
+						if (reprap.Debug(moduleDda) && pdm->totalSteps > 1000000)
+						{
+							DebugPrintAll("pm");
+						}
+						InsertDM(pdm);
+					}
+					else
+					{
+						pdm->state = DMState::idle;
+						pdm->nextDM = completedDMs;
+						completedDMs = pdm;
+					}
+				}
+
+# if SUPPORT_CAN_EXPANSION
+				if (live)
+				{
+					// Move::CanUseSegmentFreeMesh doesn't allow this if any Z drivers are remote
+					const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
+					for (size_t i = 0; i < config.numDrivers; ++i)
+					{
+						platform.EnableDriver(config.driverNumbers[i]);
+					}
+				}
+# endif
+				SetBit(axisMotorsEnabled, drive);
+				additionalAxisMotorsToEnable |= reprap.GetMove().GetKinematics().GetConnectedAxes(drive);
 			}
+#endif
 			else if (drive < numTotalAxes)
 			{
 				// It's a linear drive
@@ -1278,7 +1810,10 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 					if (platform.GetDriversBitmap(drive) != 0)					// if any of the drives is local
 					{
 #if !SUPPORT_CAN_EXPANSION
-						reprap.GetPlatform().EnableDrive(drive);
+						if (live)
+						{
+							reprap.GetPlatform().EnableDrive(drive);
+						}
 #endif
 						DriveMovement* const pdm = DriveMovement::Allocate(drive, DMState::moving);
 						pdm->totalSteps = labs(delta);
@@ -1301,17 +1836,20 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 					}
 
 #if SUPPORT_CAN_EXPANSION
-					const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
-					for (size_t i = 0; i < config.numDrivers; ++i)
+					if (live)
 					{
-						const size_t driver = config.driverNumbers[i];
-						if (driver >= NumDirectDrivers)
-						{
-							CanInterface::AddMovement(*this, params, driver - NumDirectDrivers, delta);
-						}
-						else
+						const AxisDriversConfig& config = platform.GetAxisDriversConfig(drive);
+						for (size_t i = 0; i < config.numDrivers; ++i)
 						{
-							platform.EnableDriver(driver);
+							const size_t driver = config.driverNumbers[i];
+							if (driver >= NumDirectDrivers)
+							{
+								CanInterface::AddMovement(*this, params, driver - NumDirectDrivers, delta);
+							}
+							else
+							{
+								platform.EnableDriver(driver);
+							}
 						}
 					}
 #endif
@@ -1328,7 +1866,10 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 					if (platform.GetDriversBitmap(drive) != 0)					// if any of the drives is local
 					{
 #if !SUPPORT_CAN_EXPANSION
-						reprap.GetPlatform().EnableDrive(drive);
+						if (live)
+						{
+							reprap.GetPlatform().EnableDrive(drive);
+						}
 #endif
 						// If there is any extruder jerk in this move, in theory that means we need to instantly extrude or retract some amount of filament.
 						// Pass the speed change to PrepareExtruder
@@ -1343,7 +1884,7 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 							speedChange = 0.0;
 						}
 
-						if (pdm->PrepareExtruder(*this, params, extrusionPending[drive - numTotalAxes], speedChange, flags.usePressureAdvance))
+						if (pdm->PrepareExtruder(*this, params, extrusionPending[drive - numTotalAxes], pressureAdvanceLag[drive - numTotalAxes], speedChange, flags.usePressureAdvance))
 						{
 							// Check for sensible values, print them if they look dubious
 							if (   reprap.Debug(moduleDda)
@@ -1376,7 +1917,11 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 
 #if SUPPORT_CAN_EXPANSION
 					const uint8_t driver = platform.GetExtruderDriver(drive - numTotalAxes);
-					if (driver >= NumDirectDrivers)
+					if (!live)
+					{
+						// Simulating, so don't send anything to the expansion boards or enable any drivers
+					}
+					else if (driver >= NumDirectDrivers)
 					{
 						CanInterface::AddMovement(*this, params, driver - NumDirectDrivers, pdm->GetSteps());
 					}
@@ -1390,7 +1935,7 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 		}
 
 		// On CoreXY and similar architectures, we also need to enable the motors controlling any connected axes
-		additionalAxisMotorsToEnable &= ~axisMotorsEnabled;
+		additionalAxisMotorsToEnable = (live) ? additionalAxisMotorsToEnable & ~axisMotorsEnabled : 0;
 		for (size_t drive = 0; additionalAxisMotorsToEnable != 0; ++drive)
 		{
 			if (IsBitSet(additionalAxisMotorsToEnable, drive))
@@ -1425,7 +1970,10 @@ void DDA::Prepare(uint8_t simMode, float extrusionPending[])
 							: StepTimer::GetInterruptClocks() + MovementStartDelayClocks;	// else this move is the first so start it after a short delay
 
 #if SUPPORT_CAN_EXPANSION
-		CanInterface::FinishMovement(afterPrepare.moveStartTime);
+		if (live)
+		{
+			CanInterface::FinishMovement(afterPrepare.moveStartTime);
+		}
 #endif
 		if (reprap.Debug(moduleDda) && reprap.Debug(moduleMove))		// temp show the prepared DDA if debug enabled for both modules
 		{
@@ -1665,7 +2213,8 @@ void DDA::CheckEndstops(Platform& platform)
 // The GCC optimize pragma appears to be broken, if we try to force O3 optimisation here then functions are never inlined
 
 // Start executing this move, returning true if Step() needs to be called immediately. Must be called with interrupts disabled or basepri >= set interrupt priority, to avoid a race condition.
-void DDA::Start(Platform& p, uint32_t tim)
+// If controlsOutputs is false then this move is in an auxiliary DDA ring, so we leave the laser and the ancillary PWM to the main ring.
+void DDA::Start(Platform& p, uint32_t tim, bool controlsOutputs)
 pre(state == frozen)
 {
 	if ((int32_t)(tim - afterPrepare.moveStartTime ) > 25)
@@ -1684,19 +2233,25 @@ pre(state == frozen)
 
 #if SUPPORT_LASER
 	// Deal with laser power
-	if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
+	if (controlsOutputs && reprap.GetGCodes().GetMachineType() == MachineType::laser)
 	{
 		// Ideally we should ramp up the laser power as the machine accelerates, but for now we don't.
 		p.SetLaserPwm(laserPwmOrIoBits.laserPwm);
 	}
 #endif
 
-	if (activeDMs != nullptr)
+	if (HaveActiveDMs())
 	{
 		unsigned int extrusions = 0, retractions = 0;			// bitmaps of extruding and retracting drives
 		const size_t numAxes = reprap.GetGCodes().GetTotalAxes();
+#if DDA_USE_DM_HEAP
+		for (size_t i = 0; i < numActiveDMs; ++i)
+		{
+			const DriveMovement * const pdm = activeDMs[i];
+#else
 		for (const DriveMovement* pdm = activeDMs; pdm != nullptr; pdm = pdm->nextDM)
 		{
+#endif
 			const size_t drive = pdm->drive;
 			p.SetDirection(drive, pdm->direction);
 			if (drive >= numAxes && drive < MaxTotalDrivers)	// if it's an extruder
@@ -1717,6 +2272,33 @@ pre(state == frozen)
 		{
 			// Check for trying to extrude or retract when the hot end temperature is too low
 			const unsigned int prohibitedMovements = reprap.GetProhibitedExtruderMovements(extrusions, retractions);
+#if DDA_USE_DM_HEAP
+			for (size_t i = 0; i < numActiveDMs; )
+			{
+				const size_t drive = activeDMs[i]->drive;
+				if (drive >= numAxes && drive < NumDirectDrivers)
+				{
+					if ((prohibitedMovements & (1 << (drive - numAxes))) != 0)
+					{
+						// Removing this entry moves a later one into its place, so start again from the beginning
+						DriveMovement * const dm = RemoveActiveDM(i);
+						dm->nextDM = completedDMs;
+						completedDMs = dm;
+						i = 0;
+						extruding = false;
+					}
+					else
+					{
+						extruding = true;
+						++i;
+					}
+				}
+				else
+				{
+					++i;
+				}
+			}
+#else
 			for (DriveMovement **dmpp = &activeDMs; *dmpp != nullptr; )
 			{
 				DriveMovement* const dm = *dmpp;
@@ -1740,9 +2322,14 @@ pre(state == frozen)
 					dmpp = &(dm->nextDM);
 				}
 			}
+#endif
 		}
 
-		if (extruding)
+		if (!controlsOutputs)
+		{
+			// Moves in auxiliary rings don't extrude
+		}
+		else if (extruding)
 		{
 			p.ExtrudeOn();
 		}
@@ -1770,14 +2357,42 @@ void DDA::StepDrivers(Platform& p)
 	}
 
 	uint32_t driversStepping = 0;
-	DriveMovement* dm = activeDMs;
 	uint32_t now = StepTimer::GetInterruptClocks();
 	const uint32_t elapsedTime = (now - afterPrepare.moveStartTime) + MinInterruptInterval;
+#if SUPPORT_STEP_TIMING_STATS
+	StepTimingStats& stats = reprap.GetMove().GetStepTimingStats();
+#endif
+#if DDA_USE_DM_HEAP
+	// 2. Take the drives that are due out of the heap and chain them together
+	DriveMovement *dmToInsert = nullptr;							// head of the chain we need to re-insert
+	DriveMovement * const dm = nullptr;								// end of the chain we need to re-insert
+	while (numActiveDMs != 0 && elapsedTime >= activeDMs[0]->nextStepTime)	// if the next step is due
+	{
+		DriveMovement * const dueDM = RemoveActiveDM(0);
+		driversStepping |= p.GetDriversBitmap(dueDM->drive);
+# if SUPPORT_STEP_TIMING_STATS
+		if (stats.IsEnabled())
+		{
+			stats.RecordStep(dueDM->drive, (int32_t)(elapsedTime - MinInterruptInterval - dueDM->nextStepTime));
+		}
+# endif
+		dueDM->nextDM = dmToInsert;
+		dmToInsert = dueDM;
+	}
+#else
+	DriveMovement* dm = activeDMs;
 	while (dm != nullptr && elapsedTime >= dm->nextStepTime)		// if the next step is due
 	{
 		driversStepping |= p.GetDriversBitmap(dm->drive);
+# if SUPPORT_STEP_TIMING_STATS
+		if (stats.IsEnabled())
+		{
+			stats.RecordStep(dm->drive, (int32_t)(elapsedTime - MinInterruptInterval - dm->nextStepTime));
+		}
+# endif
 		dm = dm->nextDM;
 	}
+#endif
 
 	if ((driversStepping & p.GetSlowDriversBitmap()) == 0)	// if not using any external drivers
 	{
@@ -1804,12 +2419,22 @@ void DDA::StepDrivers(Platform& p)
 	// 4. Remove those drives from the list, calculate the next step times, update the direction pins where necessary,
 	//    and re-insert them so as to keep the list in step-time order.
 	//    Note that the call to CalcNextStepTime may change the state of Direction pin.
+#if !DDA_USE_DM_HEAP
 	DriveMovement *dmToInsert = activeDMs;							// head of the chain we need to re-insert
 	activeDMs = dm;													// remove the chain from the list
+#endif
 	while (dmToInsert != dm)										// note that both of these may be nullptr
 	{
 		const bool hasMoreSteps = (dmToInsert->isDelta)
 				? dmToInsert->CalcNextStepTimeDelta(*this, true)
+#if SUPPORT_NATIVE_ARCS
+				: (dmToInsert->isArc)
+				  ? dmToInsert->CalcNextStepTimeArc(*this, true)
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+				: (dmToInsert->isMesh)
+				  ? dmToInsert->CalcNextStepTimeMesh(*this, true)
+#endif
 				: dmToInsert->CalcNextStepTimeCartesian(*this, true);
 		DriveMovement * const nextToInsert = dmToInsert->nextDM;
 		if (hasMoreSteps)
@@ -1828,17 +2453,54 @@ void DDA::StepDrivers(Platform& p)
 	Platform::StepDriversLow();										// set all step pins low
 
 	// If there are no more steps to do and the time for the move has nearly expired, flag the move as complete
-	if (activeDMs == nullptr && StepTimer::GetInterruptClocks() - afterPrepare.moveStartTime + WakeupTime >= clocksNeeded)
+	if (!HaveActiveDMs() && StepTimer::GetInterruptClocks() - afterPrepare.moveStartTime + WakeupTime >= clocksNeeded)
 	{
 		state = completed;
 	}
 }
 
+// Calculate all the step times for this move in the same way that StepDrivers does, but without waiting for them to become due or driving the motors.
+// Used in step timing simulation mode, so that the step generation code can be timed and checked while processing a real GCode file.
+void DDA::SimulateStepGeneration(DDARing& ring)
+{
+	while (HaveActiveDMs())
+	{
+		const uint32_t startClocks = StepTimer::GetInterruptClocks();
+		DriveMovement * const dm = RemoveFirstDM();
+		const uint32_t stepTime = dm->nextStepTime;
+		const bool hasMoreSteps = (dm->isDelta)
+				? dm->CalcNextStepTimeDelta(*this, false)
+#if SUPPORT_NATIVE_ARCS
+				: (dm->isArc)
+				  ? dm->CalcNextStepTimeArc(*this, false)
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+				: (dm->isMesh)
+				  ? dm->CalcNextStepTimeMesh(*this, false)
+#endif
+				: dm->CalcNextStepTimeCartesian(*this, false);
+		if (hasMoreSteps)
+		{
+			InsertDM(dm);
+		}
+		else
+		{
+			dm->nextDM = completedDMs;
+			completedDMs = dm;
+		}
+		ring.RecordSimulatedStep(dm->drive, stepTime, StepTimer::GetInterruptClocks() - startClocks);
+	}
+}
+
 // Return the time that the next interrupt is needed. It may be earlier than the current time.
 std::optional<uint32_t> DDA::GetNextInterruptTime() const
 {
 	return (state == executing)
+#if DDA_USE_DM_HEAP
+			? std::optional<uint32_t>(((numActiveDMs != 0) ? activeDMs[0]->nextStepTime : clocksNeeded - DDA::WakeupTime) + afterPrepare.moveStartTime)
+#else
 			? std::optional<uint32_t>(((activeDMs != nullptr) ? activeDMs->nextStepTime : clocksNeeded - DDA::WakeupTime) + afterPrepare.moveStartTime)
+#endif
 				: std::optional<uint32_t>();
 }
 
@@ -1855,7 +2517,7 @@ void DDA::StopDrive(size_t drive)
 			flags.endCoordinatesValid = false;			// the XYZ position is no longer valid
 		}
 		DeactivateDM(drive);
-		if (activeDMs == nullptr)
+		if (!HaveActiveDMs())
 		{
 			state = completed;
 		}
@@ -21,6 +21,13 @@
 # define DDA_LOG_PROBE_CHANGES	0	// save memory on the wired Duet
 #endif
 
+// Set this to 1 to keep the DMs that have steps pending in a binary heap ordered by step time, instead of in a linked list sorted by step time.
+// Inserting into the list is O(n) in the number of active drives but has a very low overhead, so it is faster unless many drives are moving at once.
+// Use M122 P106 to compare the two on a particular board.
+#ifndef DDA_USE_DM_HEAP
+# define DDA_USE_DM_HEAP	0
+#endif
+
 class DDARing;
 
 // This defines a single coordinated movement of one or several motors
@@ -44,7 +51,7 @@ public:
 	bool InitStandardMove(DDARing& ring, GCodes::RawMove &nextMove, bool doMotorMapping) __attribute__ ((hot));	// Set up a new move, returning true if it represents real movement
 	bool InitLeadscrewMove(DDARing& ring, float feedrate, const float amounts[MaxTotalDrivers]);		// Set up a leadscrew motor move
 
-	void Start(Platform& p, uint32_t tim) __attribute__ ((hot));			// Start executing the DDA, i.e. move the move.
+	void Start(Platform& p, uint32_t tim, bool controlsOutputs) __attribute__ ((hot));	// Start executing the DDA, i.e. move the move.
 	void StepDrivers(Platform& p) __attribute__ ((hot));					// Take one step of the DDA, called by timed interrupt.
 	std::optional<uint32_t> GetNextInterruptTime() const;					// Return the time that the next interrupt is needed
 
@@ -52,7 +59,8 @@ public:
 	void SetPrevious(DDA *p) { prev = p; }
 	void Complete() { state = completed; }
 	bool Free();
-	void Prepare(uint8_t simMode, float extrusionPending[]) __attribute__ ((hot));	// Calculate all the values and freeze this DDA
+	void Prepare(uint8_t simMode, float extrusionPending[], float pressureAdvanceLag[]) __attribute__ ((hot));	// Calculate all the values and freeze this DDA
+	void SimulateStepGeneration(DDARing& ring) __attribute__ ((hot));		// Calculate all the step times without driving the motors, used in simulation mode 3
 	bool HasStepError() const;
 	bool CanPauseAfter() const { return flags.canPauseAfter; }
 	bool IsPrintingMove() const { return flags.isPrintingMove; }			// Return true if this involves both XY movement and extrusion
@@ -142,6 +150,7 @@ public:
 	static constexpr uint32_t WakeupTime = StepTimer::StepClockRate/10000;				// stop resting 100us before the move is due to end
 
 	static void PrintMoves();										// print saved moves for debugging
+	static void TimeStepScheduling(const StringRef& reply);			// time how long it takes to schedule the next step of a drive, for M122 P106
 
 #if DDA_LOG_PROBE_CHANGES
 	static const size_t MaxLoggedProbePositions = 40;
@@ -160,6 +169,12 @@ private:
 	void ReduceHomingSpeed();										// called to reduce homing speed when a near-endstop is triggered
 	void StopDrive(size_t drive);									// stop movement of a drive and recalculate the endpoint
 	void InsertDM(DriveMovement *dm) __attribute__ ((hot));
+	DriveMovement *RemoveFirstDM() __attribute__ ((hot));			// remove and return the DM with the earliest step time
+#if DDA_USE_DM_HEAP
+	DriveMovement *RemoveActiveDM(size_t index) __attribute__ ((hot));
+#endif
+	bool HaveActiveDMs() const;
+	void ClearActiveDMs();
 	void DeactivateDM(size_t drive);
 	void ReleaseDMs();
 	bool IsDecelerationMove() const;								// return true if this move is or have been might have been intended to be a deceleration-only move
@@ -167,6 +182,7 @@ private:
 	void DebugPrintVector(const char *name, const float *vec, size_t len) const;
 	void CheckEndstops(Platform& platform);
 	float NormaliseXYZ();											// Make the direction vector unit-normal in XYZ
+	float GetStartDirection(size_t drive) const;					// Get a component of the direction vector at the start of the move
 	void AdjustAcceleration();										// Adjust the acceleration and deceleration to reduce ringing
 
 	static void DoLookahead(DDARing& ring, DDA *laDDA) __attribute__ ((hot));	// Try to smooth out moves in the queue
@@ -198,7 +214,10 @@ private:
 					 usingStandardFeedrate : 1,		// True if this move uses the standard feed rate
 					 isNonPrintingExtruderMove : 1,	// True if this move is a fast extruder-only move, probably a retract/re-prime
 					 continuousRotationShortcut : 1, // True if continuous rotation axes take shortcuts
-					 usesEndstops : 1;				// True if this move monitors endstops of Z probe
+					 usesEndstops : 1,				// True if this move monitors endstops of Z probe
+					 shapedAcceleration : 1,		// True if the acceleration and deceleration phases of this move are shaped
+					 isArc : 1,						// True if this is an arc move in the XY plane, executed without splitting it into straight segments
+					 followsMesh : 1;				// True if the Z motor follows the height map during this move instead of the move being split into segments
 		};
 		uint16_t all;								// so that we can print all the flags at once for debugging
 	} flags;
@@ -218,6 +237,9 @@ private:
     float totalDistance;					// How long is the move in hypercuboid space
 	float acceleration;						// The acceleration to use
 	float deceleration;						// The deceleration to use
+#if SUPPORT_MOTION_SHAPING
+	float maxShapedAcceleration;			// The acceleration limit of the move, which the peak S-curve acceleration must not exceed
+#endif
     float requestedSpeed;					// The speed that the user asked for
     float virtualExtruderPosition;			// the virtual extruder position at the end of this move, used for pause/resume
 
@@ -252,28 +274,59 @@ private:
 
 			// These are used only in delta calculations
 		    int32_t cKc;						// The Z movement fraction multiplied by Kc and converted to integer
+
+#if SUPPORT_MOTION_SHAPING || SUPPORT_NATIVE_ARCS
+			// These are used only when shaping the acceleration or executing an arc move
+			float accelClocks;					// the duration of the acceleration phase
+			float decelClocks;					// the duration of the deceleration phase
+			float decelStartClocks;				// the time at which the deceleration phase starts
+			float decelStartDistance;			// the distance at which the deceleration phase starts
+			float accelStopDistance;			// the distance at which the acceleration phase ends
+#endif
+#if SUPPORT_MOTION_SHAPING
+			float accelJerkClocks;				// how long the acceleration takes to ramp up or down at the start and end of the acceleration phase
+			float decelJerkClocks;				// how long the deceleration takes to ramp up or down at the start and end of the deceleration phase
+			float accelPeak;					// the peak acceleration of the S-curve acceleration phase in mm per step clock squared
+			float decelPeak;					// the peak acceleration of the S-curve deceleration phase, which is negative
+			float accelJerk;					// the rate of change of acceleration while the acceleration ramps up or down, in mm per step clock cubed
+			float decelJerk;					// the rate of change of acceleration while the deceleration ramps up or down
+#endif
 		} afterPrepare;
 	};
 
+#if SUPPORT_NATIVE_ARCS
+	// Arc parameters, valid only if flags.isArc is set. The motor coefficients are calculated in Prepare, so we don't need to store the arc centre.
+	struct
+	{
+		float radius;						// the radius of the arc in machine coordinates
+		float startAngle;					// the angle of the start point from the centre
+		float totalAngle;					// the angle turned through, positive for anticlockwise
+		float startDirection[2];			// the X and Y components of the normalised direction vector at the start of the arc
+	} arc;
+#endif
+
 #if DDA_LOG_PROBE_CHANGES
 	static bool probeTriggered;
 
 	void LogProbePosition();
 #endif
 
+#if DDA_USE_DM_HEAP
+    DriveMovement* activeDMs[MaxTotalDrivers];	// binary heap of associated DMs that need steps, the one with the earliest step time first. DMs are allocated per drive, so there can be one for every drive.
+    size_t numActiveDMs;						// how many entries of activeDMs are in use
+#else
     DriveMovement* activeDMs;					// list of associated DMs that need steps, in step time order
+#endif
     DriveMovement* completedDMs;				// list of associated DMs that don't need any more steps
 };
 
 // Find the DriveMovement record for a given drive even if it is completed, or return nullptr if there isn't one
 inline DriveMovement *DDA::FindDM(size_t drive) const
 {
-	for (DriveMovement* dm = activeDMs; dm != nullptr; dm = dm->nextDM)
+	DriveMovement * const adm = FindActiveDM(drive);
+	if (adm != nullptr)
 	{
-		if (dm->drive == drive)
-		{
-			return dm;
-		}
+		return adm;
 	}
 	for (DriveMovement* dm = completedDMs; dm != nullptr; dm = dm->nextDM)
 	{
@@ -288,6 +341,15 @@ inline DriveMovement *DDA::FindDM(size_t drive) const
 // Find the active DriveMovement record for a given drive, or return nullptr if there isn't one
 inline DriveMovement *DDA::FindActiveDM(size_t drive) const
 {
+#if DDA_USE_DM_HEAP
+	for (size_t i = 0; i < numActiveDMs; ++i)
+	{
+		if (activeDMs[i]->drive == drive)
+		{
+			return activeDMs[i];
+		}
+	}
+#else
 	for (DriveMovement* dm = activeDMs; dm != nullptr; dm = dm->nextDM)
 	{
 		if (dm->drive == drive)
@@ -295,9 +357,30 @@ inline DriveMovement *DDA::FindActiveDM(size_t drive) const
 			return dm;
 		}
 	}
+#endif
 	return nullptr;
 }
 
+// Return true if any drives have steps pending
+inline bool DDA::HaveActiveDMs() const
+{
+#if DDA_USE_DM_HEAP
+	return numActiveDMs != 0;
+#else
+	return activeDMs != nullptr;
+#endif
+}
+
+// Empty the set of DMs that have steps pending. The caller must already have released or moved them.
+inline void DDA::ClearActiveDMs()
+{
+#if DDA_USE_DM_HEAP
+	numActiveDMs = 0;
+#else
+	activeDMs = nullptr;
+#endif
+}
+
 // Force an end point
 inline void DDA::SetDriveCoordinate(int32_t a, size_t drive)
 {
@@ -305,6 +388,18 @@ inline void DDA::SetDriveCoordinate(int32_t a, size_t drive)
 	flags.endCoordinatesValid = false;
 }
 
+// Get a component of the direction vector at the start of the move. For an arc move the X and Y components of directionVector are the ones at the end of the move.
+inline float DDA::GetStartDirection(size_t drive) const
+{
+#if SUPPORT_NATIVE_ARCS
+	if (flags.isArc && (drive == X_AXIS || drive == Y_AXIS))
+	{
+		return arc.startDirection[drive];
+	}
+#endif
+	return directionVector[drive];
+}
+
 #if HAS_SMART_DRIVERS
 
 // Get the current full step interval for this axis or extruder
@@ -8,6 +8,8 @@
 #include "DDARing.h"
 #include "RepRap.h"
 #include "Move.h"
+#include "Tasks.h"
+#include "GCodes/GCodeBuffer.h"
 
 #if SUPPORT_CAN_EXPANSION
 # include "CAN/CanInterface.h"
@@ -16,14 +18,15 @@
 constexpr uint32_t UsualMinimumPreparedTime = StepTimer::StepClockRate/10;			// 100ms
 constexpr uint32_t AbsoluteMinimumPreparedTime = StepTimer::StepClockRate/20;		// 50ms
 
-DDARing::DDARing() : scheduledMoves(0), completedMoves(0)
+DDARing::DDARing() : numDdasInRing(0), maxQueuedClocks(DefaultMaxQueuedMoveTime * (StepTimer::StepClockRate/1000)), ownAxes(LowestNBits<AxesBitmap>(MaxAxes)), isAuxRing(false), scheduledMoves(0), completedMoves(0)
 {
 }
 
 // This can be called in the constructor for class Move
-void DDARing::Init1(unsigned int numDdas)
+void DDARing::Init1(unsigned int numDdas, bool isAux)
 {
 	numDdasInRing = numDdas;
+	isAuxRing = isAux;
 
 	// Build the DDA ring
 	DDA *dda = new DDA(nullptr);
@@ -41,6 +44,81 @@ void DDARing::Init1(unsigned int numDdas)
 	currentDda = nullptr;
 }
 
+// Process M595. The DDAs and DMs can't be freed once allocated, so the queue can only be made longer.
+// This is normally used in config.g, but it can be used later as long as there is enough spare RAM.
+GCodeResult DDARing::ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& reply)
+{
+	bool seen = false;
+	uint32_t numDdasWanted = numDdasInRing, numDmsWanted = 0;
+	gb.TryGetUIValue('P', numDdasWanted, seen);
+	gb.TryGetUIValue('S', numDmsWanted, seen);
+	if (gb.Seen('T'))
+	{
+		// The maximum queued time can be changed at any time, because it only affects whether we add more moves
+		const uint32_t maxQueuedTime = gb.GetUIValue();
+		if (maxQueuedTime < MinMaxQueuedMoveTime || maxQueuedTime > MaxMaxQueuedMoveTime)
+		{
+			reply.printf("Maximum queued move time must be between %" PRIu32 "ms and %" PRIu32 "ms", MinMaxQueuedMoveTime, MaxMaxQueuedMoveTime);
+			return GCodeResult::error;
+		}
+		maxQueuedClocks = maxQueuedTime * (StepTimer::StepClockRate/1000);
+		if (!seen)
+		{
+			return GCodeResult::ok;
+		}
+	}
+	else if (!seen)
+	{
+		reply.printf("Movement queue length %u, %u DMs (%d free), max queued time %" PRIu32 "ms",
+						numDdasInRing, DriveMovement::NumCreated(), DriveMovement::NumFree(), GetMaxQueuedTime());
+		return GCodeResult::ok;
+	}
+
+	if (numDdasWanted > MaxDdaRingLength)
+	{
+		reply.printf("Movement queue length must not exceed %u", MaxDdaRingLength);
+		return GCodeResult::error;
+	}
+
+	// If the number of DMs wasn't specified, keep the same number of DMs per DDA as we started with
+	if (numDmsWanted == 0)
+	{
+		numDmsWanted = (numDdasWanted * NumDms)/DdaRingLength;
+	}
+	const unsigned int numNewDdas = (numDdasWanted > numDdasInRing) ? numDdasWanted - numDdasInRing : 0;
+	const unsigned int numNewDms = (numDmsWanted > DriveMovement::NumCreated()) ? numDmsWanted - DriveMovement::NumCreated() : 0;
+	if (numNewDdas == 0 && numNewDms == 0)
+	{
+		return GCodeResult::ok;
+	}
+
+	if (numNewDdas * sizeof(DDA) + numNewDms * sizeof(DriveMovement) + MinSpareRamAfterQueueAllocation > Tasks::GetNeverUsedRam())
+	{
+		reply.copy("Not enough free RAM for the requested movement queue length");
+		return GCodeResult::error;
+	}
+
+	// We can only change the ring when no moves are queued or executing
+	if (!reprap.GetGCodes().LockMovementAndWaitForStandstill(gb) || getPointer != addPointer || checkPointer != addPointer)
+	{
+		return GCodeResult::notFinished;
+	}
+
+	// Insert the new DDAs after addPointer, so that they are used after the one that addPointer refers to.
+	// They are empty, so the move in addPointer->prev that the next move will start from is not affected.
+	for (unsigned int i = 0; i < numNewDdas; ++i)
+	{
+		DDA * const oldNext = addPointer->GetNext();
+		DDA * const newDda = new DDA(oldNext);
+		newDda->SetPrevious(addPointer);
+		oldNext->SetPrevious(newDda);
+		addPointer->SetNext(newDda);
+	}
+	numDdasInRing += numNewDdas;
+	DriveMovement::InitialAllocate(numNewDms);
+	return GCodeResult::ok;
+}
+
 // This must be called from Move::Init because it indirectly refers to the GCodes module, which must therefore be initialised first
 void DDARing::Init2()
 {
@@ -64,9 +142,10 @@ void DDARing::Init2()
 	{
 		extrusionAccumulators[i] = 0;
 		extrusionPending[i] = 0.0;
+		pressureAdvanceLag[i] = 0.0;
 	}
 	extrudersPrinting = false;
-	simulationTime = 0.0;
+	ResetSimulationTime();
 }
 
 void DDARing::Exit()
@@ -117,23 +196,27 @@ bool DDARing::CanAddMove() const
 		 && addPointer->GetNext()->GetState() != DDA::provisional		// function Prepare needs to access the endpoints in the previous move, so don't change them
 		)
 	 {
-			// In order to react faster to speed and extrusion rate changes, only add more moves if the total duration of
-			// all un-frozen moves is less than 2 seconds, or the total duration of all but the first un-frozen move is less than 0.5 seconds.
+			// In order to react faster to speed and extrusion rate changes, limit the queue by time rather than by the number of moves.
+			// Only add more moves if the total duration of all moves waiting to be executed is less than the maximum queued time, or the total duration
+			// of all but the oldest of them is less than a quarter of it. The second condition stops a long move that is about to be executed from
+			// starving the lookahead, so that we don't have to decelerate at the end of it just because the moves after it aren't in the queue yet.
+			// When the moves are very short, the ring length limits the number of moves instead.
 			const DDA *dda = addPointer;
-			uint32_t unPreparedTime = 0;
+			uint32_t queuedTime = 0;
 			uint32_t prevMoveTime = 0;
 			for(;;)
 			{
 				dda = dda->GetPrevious();
-				if (dda->GetState() != DDA::provisional)
+				const DDA::DDAState st = dda->GetState();
+				if (st != DDA::provisional && st != DDA::frozen)
 				{
 					break;
 				}
-				unPreparedTime += prevMoveTime;
-				prevMoveTime = dda->GetClocksNeeded();
+				queuedTime += prevMoveTime;
+				prevMoveTime = dda->GetClocksNeeded();			// when we exit the loop this is the duration of the oldest waiting move, which queuedTime doesn't include
 			}
 
-			return (unPreparedTime < StepTimer::StepClockRate/2 || unPreparedTime + prevMoveTime < 2 * StepTimer::StepClockRate);
+			return (queuedTime < maxQueuedClocks/4 || queuedTime + prevMoveTime < maxQueuedClocks);
 	 }
 	 return false;
 }
@@ -171,6 +254,10 @@ void DDARing::Spin(uint8_t simulationMode, bool shouldStartMove)
 		DDA * const cdda = currentDda;								// currentDda is declared volatile, so copy it in the next line
 		if (cdda != nullptr)
 		{
+			if (simulationMode == StepTimingSimulationMode)
+			{
+				cdda->SimulateStepGeneration(*this);
+			}
 			simulationTime += (float)cdda->GetClocksNeeded()/StepTimer::StepClockRate;
 			cdda->Complete();
 			CurrentMoveCompleted();
@@ -200,9 +287,10 @@ void DDARing::Spin(uint8_t simulationMode, bool shouldStartMove)
 					std::optional<uint32_t> nextInterruptTime = GetNextInterruptTime();
 					if (nextInterruptTime.has_value())
 					{
+						// If another ring already has an earlier interrupt scheduled then that one is kept, and the ISR will schedule ours
 						if (StepTimer::ScheduleStepInterrupt(nextInterruptTime.value()))
 						{
-							Interrupt(p);
+							reprap.GetMove().Interrupt();			// this steps all the rings and schedules the next interrupt
 						}
 					}
 					SetBasePriority(0);
@@ -231,6 +319,35 @@ void DDARing::Spin(uint8_t simulationMode, bool shouldStartMove)
 	}
 }
 
+void DDARing::ResetSimulationTime()
+{
+	simulationTime = 0.0;
+	simulatedSteps = simulatedStepClocks = 0;
+	maxSimulatedStepClocks = 0;
+	for (CRC32& sig : simulatedStepSignatures)
+	{
+		sig.Reset();
+	}
+}
+
+// Append the results of step timing simulation to the reply
+void DDARing::ReportSimulatedSteps(const StringRef& reply) const
+{
+	if (simulatedSteps != 0)
+	{
+		const float calcSeconds = (float)simulatedStepClocks/(float)StepTimer::StepClockRate;
+		reply.catf(", steps: %" PRIu64 ", max %.1f steps/sec, worst case %.2fus/step, signatures",
+					simulatedSteps,
+					(calcSeconds > 0.0) ? (double)((float)simulatedSteps/calcSeconds) : 0.0,
+					(double)((float)maxSimulatedStepClocks * 1000000.0/(float)StepTimer::StepClockRate));
+		const size_t numDrives = reprap.GetGCodes().GetTotalAxes() + reprap.GetGCodes().GetNumExtruders();
+		for (size_t drive = 0; drive < min<size_t>(numDrives, MaxTotalDrivers); ++drive)
+		{
+			reply.catf(" %08" PRIx32, simulatedStepSignatures[drive].Get());
+		}
+	}
+}
+
 // Prepare some moves. moveTimeLeft is the total length remaining of moves that are already executing or prepared.
 void DDARing::PrepareMoves(DDA *firstUnpreparedMove, int32_t moveTimeLeft, unsigned int alreadyPrepared, uint8_t simulationMode)
 {
@@ -246,7 +363,7 @@ void DDARing::PrepareMoves(DDA *firstUnpreparedMove, int32_t moveTimeLeft, unsig
 #endif
 		  )
 	{
-		firstUnpreparedMove->Prepare(simulationMode, extrusionPending);
+		firstUnpreparedMove->Prepare(simulationMode, extrusionPending, pressureAdvanceLag);
 		moveTimeLeft += firstUnpreparedMove->GetTimeLeft();
 		++alreadyPrepared;
 		firstUnpreparedMove = firstUnpreparedMove->GetNext();
@@ -275,13 +392,16 @@ void DDARing::TryStartNextMove(Platform& p, uint32_t startTime)
 	}
 	else
 	{
-#if SUPPORT_LASER
-		if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
+		if (!isAuxRing)
 		{
-			p.SetLaserPwm(0);						// turn off the laser
-		}
+#if SUPPORT_LASER
+			if (reprap.GetGCodes().GetMachineType() == MachineType::laser)
+			{
+				p.SetLaserPwm(0);					// turn off the laser
+			}
 #endif
-		p.ExtrudeOff();								// turn off ancillary PWM
+			p.ExtrudeOff();							// turn off ancillary PWM
+		}
 		if (st == DDA::provisional)
 		{
 			++numPrepareUnderruns;					// there are more moves available, but they are not prepared yet. Signal an underrun.
@@ -654,6 +774,35 @@ bool DDARing::LowPowerOrStallPause(RestorePoint& rp)
 	return true;
 }
 
+# if SUPPORT_ASYNC_MOVES
+
+// Stop the current move immediately and discard the moves that haven't started. Used to stop the independent movement queues when the main one is paused in an emergency.
+// Moves in those queues don't carry a file position that we could replay, so the caller must take the positions of their axes from where they stopped.
+void DDARing::AbortMoves()
+{
+	cpu_irq_disable();
+	DDA * const dda = currentDda;
+	if (dda != nullptr)
+	{
+		dda->MoveAborted();
+		CurrentMoveCompleted();							// updates live endpoints, ddaRingGetPointer, currentDda etc.
+		--completedMoves;								// this move wasn't really completed
+		--scheduledMoves;								// ...but it is no longer scheduled either
+	}
+	cpu_irq_enable();
+
+	// Free the DDAs for the moves we are going to skip
+	DDA * const savedDdaRingAddPointer = addPointer;
+	addPointer = getPointer;
+	for (DDA *d = getPointer; d != savedDdaRingAddPointer; d = d->GetNext())
+	{
+		(void)d->Free();
+		scheduledMoves--;
+	}
+}
+
+# endif
+
 #endif
 
 void DDARing::Diagnostics(MessageType mtype, const char *prefix)
@@ -661,6 +810,24 @@ void DDARing::Diagnostics(MessageType mtype, const char *prefix)
 	reprap.GetPlatform().MessageF(mtype, "=== %sDDARing ===\nScheduled moves: %" PRIu32 ", completed moves: %" PRIu32 ", StepErrors: %u, LaErrors: %u, Underruns: %u, %u\n",
 		prefix, scheduledMoves, completedMoves, stepErrors, numLookaheadErrors, numLookaheadUnderruns, numPrepareUnderruns);
 	stepErrors = numLookaheadUnderruns = numPrepareUnderruns = numLookaheadErrors = 0;
+
+	// Report the highest step rate that any drive has reached since we last reported it.
+	// This is the rate we observed, not a theoretical limit. When multi-stepping, the steps between calculated step times are spaced evenly.
+	const uint32_t minStepInterval = DriveMovement::GetMinStepInterval();
+	if (minStepInterval != 0xFFFFFFFF)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Max observed step rate: %" PRIu32 " steps/sec (multi-steps evenly spaced)\n", StepTimer::StepClockRate/minStepInterval);
+	}
+	DriveMovement::ResetMinStepInterval();
+
+#if SUPPORT_MOTION_SHAPING
+	// Report how many acceleration and deceleration phases were too short to apply the input shaper to without exceeding the acceleration limit
+	if (reprap.GetMove().IsInputShapingEnabled())
+	{
+		reprap.GetPlatform().MessageF(mtype, "Phases too short to shape: %" PRIu32 "\n", DriveMovement::GetNumUnshapedPhases());
+	}
+	DriveMovement::ResetNumUnshapedPhases();
+#endif
 }
 
 // End
@@ -11,15 +11,22 @@
 #define SRC_MOVEMENT_DDARING_H_
 
 #include "DDA.h"
+#include "Storage/CRC32.h"
 
 class DDARing
 {
 public:
 	DDARing();
 
-	void Init1(unsigned int numDdas);
+	void Init1(unsigned int numDdas, bool isAux);
 	void Init2();
 	void Exit();
+	bool IsConfigured() const { return numDdasInRing != 0; }					// Return true if this DDA ring has been set up
+	unsigned int GetNumDdas() const { return numDdasInRing; }
+	AxesBitmap GetOwnAxes() const { return ownAxes; }							// Return the axes that this DDA ring moves
+	void SetOwnAxes(AxesBitmap axes) { ownAxes = axes; }
+	GCodeResult ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& reply);	// Process M595
+	uint32_t GetMaxQueuedTime() const { return maxQueuedClocks/(StepTimer::StepClockRate/1000); }	// Return the maximum duration of queued moves in milliseconds
 
 	void RecycleDDAs();
 	bool CanAddMove() const;
@@ -44,7 +51,9 @@ public:
 	void ResetMoveCounters() { scheduledMoves = completedMoves = 0; }
 
 	float GetSimulationTime() const { return simulationTime; }
-	void ResetSimulationTime() { simulationTime = 0.0; }
+	void ResetSimulationTime();
+	void RecordSimulatedStep(size_t drive, uint32_t stepTime, uint32_t calcClocks);	// Record a step generated in step timing simulation mode
+	void ReportSimulatedSteps(const StringRef& reply) const;					// Append the step timing simulation results to the reply
 
 #if HAS_SMART_DRIVERS
 	uint32_t GetStepInterval(size_t axis, uint32_t microstepShift) const;
@@ -66,6 +75,9 @@ public:
 	bool PauseMoves(RestorePoint& rp);											// Pause the print as soon as we can, returning true if we were able to skip any
 #if HAS_VOLTAGE_MONITOR || HAS_STALL_DETECT
 	bool LowPowerOrStallPause(RestorePoint& rp);								// Pause the print immediately, returning true if we were able to
+# if SUPPORT_ASYNC_MOVES
+	void AbortMoves();															// Stop the current move immediately and discard the moves that haven't started
+# endif
 #endif
 
 	void RecordLookaheadError() { ++numLookaheadErrors; }						// Record a lookahead error
@@ -86,6 +98,9 @@ private:
 	volatile int32_t liveEndPoints[MaxTotalDrivers];							// The XYZ endpoints of the last completed move in motor coordinates
 
 	unsigned int numDdasInRing;
+	uint32_t maxQueuedClocks;													// The maximum duration of un-executed moves in the ring, in step clocks
+	AxesBitmap ownAxes;															// The axes that moves in this ring may move. Other axes are moved by other rings.
+	bool isAuxRing;																// True if this is an auxiliary ring, which leaves the laser and ancillary outputs alone
 
 	uint32_t scheduledMoves;													// Move counters for the code queue
 	volatile uint32_t completedMoves;											// This one is modified by an ISR, hence volatile
@@ -96,7 +111,12 @@ private:
 	unsigned int stepErrors;													// count of step errors, for diagnostics
 
 	float simulationTime;														// Print time since we started simulating
+	uint64_t simulatedSteps;													// Number of steps generated in step timing simulation mode
+	uint64_t simulatedStepClocks;												// Total step clocks taken to calculate them
+	uint32_t maxSimulatedStepClocks;											// The longest time taken to calculate and schedule one step
+	CRC32 simulatedStepSignatures[MaxTotalDrivers];								// Signature of the step times generated for each drive
 	float extrusionPending[MaxExtruders];										// Extrusion not done due to rounding to nearest step
+	float pressureAdvanceLag[MaxExtruders];										// Pressure advance not yet applied because of the smoothing time
 	volatile int32_t extrusionAccumulators[MaxExtruders]; 						// Accumulated extruder motor steps
 	volatile uint32_t extrudersPrintingSince;									// The milliseconds clock time when extrudersPrinting was set to true
 	volatile bool extrudersPrinting;											// Set whenever an extruder starts a printing move, cleared by a non-printing extruder move
@@ -118,7 +138,22 @@ pre(ddaRingGetPointer->GetState() == DDA::frozen)
 		extrudersPrintingSince = millis();
 	}
 	currentDda = cdda;
-	cdda->Start(p, startTime);
+	cdda->Start(p, startTime, !isAuxRing);
+}
+
+// Record a step generated in step timing simulation mode
+inline void DDARing::RecordSimulatedStep(size_t drive, uint32_t stepTime, uint32_t calcClocks)
+{
+	++simulatedSteps;
+	simulatedStepClocks += calcClocks;
+	if (calcClocks > maxSimulatedStepClocks)
+	{
+		maxSimulatedStepClocks = calcClocks;
+	}
+	if (drive < MaxTotalDrivers)												// leadscrew adjustment moves use drive numbers above MaxTotalDrivers
+	{
+		simulatedStepSignatures[drive].Update(reinterpret_cast<const char*>(&stepTime), sizeof(stepTime));
+	}
 }
 
 #if HAS_SMART_DRIVERS
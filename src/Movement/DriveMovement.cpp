@@ -12,12 +12,18 @@
 #include "RepRap.h"
 #include "Math/Isqrt.h"
 #include "Kinematics/LinearDeltaKinematics.h"
+#include "Tools/Tool.h"
 
 // Static members
 
 DriveMovement *DriveMovement::freeList = nullptr;
 int DriveMovement::numFree = 0;
 int DriveMovement::minFree = 0;
+unsigned int DriveMovement::numCreated = 0;
+uint32_t DriveMovement::minStepInterval = 0xFFFFFFFF;
+#if SUPPORT_MOTION_SHAPING
+uint32_t DriveMovement::numUnshapedPhases = 0;
+#endif
 
 void DriveMovement::InitialAllocate(unsigned int num)
 {
@@ -25,6 +31,7 @@ void DriveMovement::InitialAllocate(unsigned int num)
 	{
 		freeList = new DriveMovement(freeList);
 		++numFree;
+		++numCreated;
 		--num;
 	}
 	ResetMinFree();
@@ -64,7 +71,7 @@ bool DriveMovement::PrepareCartesianAxis(const DDA& dda, const PrepParams& param
 
 	// Acceleration phase parameters
 	mp.cart.accelStopStep = (uint32_t)(params.accelDistance * stepsPerMm) + 1;
-	mp.cart.compensationClocks = mp.cart.accelCompensationClocks = 0;
+	mp.cart.compensationClocks = mp.cart.accelCompensationClocks = mp.cart.decelCompensationClocks = 0;
 
 	// Constant speed phase parameters
 	mp.cart.mmPerStepTimesCKdivtopSpeed = roundU32(((float)((uint64_t)StepTimer::StepClockRate * K1))/(stepsPerMm * dda.topSpeed));
@@ -92,6 +99,48 @@ bool DriveMovement::PrepareCartesianAxis(const DDA& dda, const PrepParams& param
 	stepInterval = 999999;							// initialise to a large value so that we will calculate the time for just one step
 	stepsTillRecalc = 0;							// so that we don't skip the calculation
 	isDelta = false;
+	isArc = false;
+	isMesh = false;
+#if SUPPORT_MOTION_SHAPING
+	// Decide whether we can apply the input shaper to each phase. If a phase is too short then we still use S-curve acceleration for it, and record it for diagnostics.
+	const AxisShaper * const shaper = (dda.flags.shapedAcceleration) ? reprap.GetMove().GetMotorShaper(drive) : nullptr;
+	shapeAccel = shapeDecel = false;
+	if (shaper != nullptr)
+	{
+		if (params.accelDistance > 0.0)
+		{
+			mp.cart.accelPulseJerkClocks = ShapedJerkClocks(dda, *shaper, false);
+			shapeAccel = mp.cart.accelPulseJerkClocks >= 0.0;
+			if (shapeAccel)
+			{
+				mp.cart.accelPulsePeak = ((dda.topSpeed - dda.startSpeed) * SecondsPerStepClock)/(dda.afterPrepare.accelClocks - shaper->GetExtraClocks() - mp.cart.accelPulseJerkClocks);
+			}
+			else
+			{
+				++numUnshapedPhases;
+			}
+		}
+		if (params.decelStartDistance < dda.totalDistance)
+		{
+			mp.cart.decelPulseJerkClocks = ShapedJerkClocks(dda, *shaper, true);
+			shapeDecel = mp.cart.decelPulseJerkClocks >= 0.0;
+			if (shapeDecel)
+			{
+				mp.cart.decelPulsePeak = ((dda.endSpeed - dda.topSpeed) * SecondsPerStepClock)/(dda.afterPrepare.decelClocks - shaper->GetExtraClocks() - mp.cart.decelPulseJerkClocks);
+			}
+			else
+			{
+				++numUnshapedPhases;
+			}
+		}
+	}
+	mp.cart.shaper = shaper;
+	shapedPhase = 0;
+	isShaped = shapeAccel || shapeDecel || (dda.flags.shapedAcceleration && reprap.GetMove().GetSCurveTime() > 0.0);
+	mp.cart.mmPerStep = 1.0/stepsPerMm;
+#else
+	isShaped = false;
+#endif
 	return CalcNextStepTimeCartesian(dda, false);
 }
 
@@ -110,6 +159,10 @@ bool DriveMovement::PrepareDeltaAxis(const DDA& dda, const PrepParams& params)
 	mp.delta.twoCsquaredTimesMmPerStepDivA = roundU64((double)(2 * StepTimer::StepClockRateSquared)/((double)stepsPerMm * (double)dda.acceleration));
 	mp.delta.twoCsquaredTimesMmPerStepDivD = roundU64((double)(2 * StepTimer::StepClockRateSquared)/((double)stepsPerMm * (double)dda.deceleration));
 
+	// At the start of the move the distance moved is zero, so the square root in CalcNextStepTimeDeltaFull is equal to the other term. Use that to estimate the first one.
+	mp.delta.lastRoot = abs(mp.delta.minusAaPlusBbTimesKs + (int32_t)(((int64_t)mp.delta.hmz0sK * dda.afterPrepare.cKc)/Kc));
+	mp.delta.rootChangePerStep = 0;
+
 	// Calculate the distance at which we need to reverse direction.
 	if (params.a2plusb2 <= 0.0)
 	{
@@ -183,11 +236,194 @@ bool DriveMovement::PrepareDeltaAxis(const DDA& dda, const PrepParams& params)
 	stepInterval = 999999;							// initialise to a large value so that we will calculate the time for just one step
 	stepsTillRecalc = 0;							// so that we don't skip the calculation
 	isDelta = true;
+	isShaped = false;
+	isArc = false;
+	isMesh = false;
 	return CalcNextStepTimeDelta(dda, false);
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Prepare this DM for a motor that follows an arc move, returning true if there are steps to do.
+// On entry, totalSteps and direction give the net movement. On return, totalSteps is the number of steps including any taken before the motor reverses, and direction is the initial direction.
+bool DriveMovement::PrepareArcAxis(const DDA& dda)
+{
+	// The motor position is a linear combination of the X and Y coordinates, which vary sinusoidally with the angle, and of the coordinates of any other axes, which vary linearly with distance.
+	// We express it in terms of the angle turned since the start so that the position near the start doesn't suffer from cancellation between large terms.
+	const Kinematics& kin = reprap.GetMove().GetKinematics();
+	const float stepsPerMm = reprap.GetPlatform().DriveStepsPerUnit(drive);
+	const float xCoefficient = kin.GetMotorCoefficient(X_AXIS, drive) * dda.arc.radius * stepsPerMm;
+	const float yCoefficient = kin.GetMotorCoefficient(Y_AXIS, drive) * dda.arc.radius * stepsPerMm;
+	const float cosStartAngle = cosf(dda.arc.startAngle), sinStartAngle = sinf(dda.arc.startAngle);
+	mp.arc.a = xCoefficient * cosStartAngle + yCoefficient * sinStartAngle;
+	mp.arc.b = yCoefficient * cosStartAngle - xCoefficient * sinStartAngle;
+	mp.arc.anglePerMm = dda.arc.totalAngle/dda.totalDistance;
+
+	// Choose the linear term so that we finish exactly on the end position. This takes care of the other axes and of the rounding of the end point to a whole number of steps.
+	mp.arc.finalPosition = (direction) ? (int32_t)totalSteps : -(int32_t)totalSteps;
+	mp.arc.k = ((float)mp.arc.finalPosition + 2.0 * mp.arc.a * fsquare(sinf(0.5 * dda.arc.totalAngle)) - mp.arc.b * sinf(dda.arc.totalAngle))/dda.totalDistance;
+
+	// Float rounding error in the position grows with the size of the terms and of the angle, so we can't always get as close to the step position as ArcPositionTolerance
+	const float radiusSteps = sqrtf(fsquare(mp.arc.a) + fsquare(mp.arc.b));
+	mp.arc.tolerance = max<float>(ArcPositionTolerance, ArcRelativeTolerance * (radiusSteps * (2.0 + fabsf(dda.arc.totalAngle)) + fabsf(mp.arc.k) * dda.totalDistance));
+
+	// Find where the motor reverses. The rate of change of position is anglePerMm * R * cos(angle + phase) + k where R = sqrt(a^2 + b^2) and phase = atan2(a, b).
+	mp.arc.numReversals = 0;
+	const float amplitude = radiusSteps * mp.arc.anglePerMm;
+	if (fabsf(amplitude) > fabsf(mp.arc.k))
+	{
+		const float phase = atan2f(mp.arc.a, mp.arc.b);
+		const float halfWidth = acosf(-mp.arc.k/amplitude);
+		const float period = TwoPi/fabsf(mp.arc.anglePerMm);
+		const float reverseAngles[2] = { -phase - halfWidth, -phase + halfWidth };
+		for (float reverseAngle : reverseAngles)
+		{
+			float reverseDistance = fmodf(reverseAngle/mp.arc.anglePerMm, period);
+			if (reverseDistance < 0.0)
+			{
+				reverseDistance += period;
+			}
+			while (reverseDistance < dda.totalDistance && mp.arc.numReversals < MaxArcReversals)
+			{
+				if (reverseDistance > 0.0)
+				{
+					// Insert it in order of distance
+					size_t i = mp.arc.numReversals;
+					while (i != 0 && mp.arc.reverseDistances[i - 1] > reverseDistance)
+					{
+						mp.arc.reverseDistances[i] = mp.arc.reverseDistances[i - 1];
+						--i;
+					}
+					mp.arc.reverseDistances[i] = reverseDistance;
+					++mp.arc.numReversals;
+				}
+				reverseDistance += period;
+			}
+		}
+	}
+
+	// Set up the first interval
+	mp.arc.intervalEnd = (mp.arc.numReversals != 0) ? mp.arc.reverseDistances[0] : dda.totalDistance;
+	float rate;
+	mp.arc.intervalEndPosition = ArcPosition(mp.arc.intervalEnd, rate);
+	(void)ArcPosition(0.0, mp.arc.rate);
+	mp.arc.distance = 0.0;
+	mp.arc.lastPosition = 0.0;
+	mp.arc.position = 0;
+	mp.arc.nextReversal = 0;
+	direction = mp.arc.intervalEndPosition >= 0.0;
+
+	// Count the steps in each interval in the same way that CalcNextStepTimeArcFull generates them
+	bool forwards = direction;
+	float intervalEndPosition = mp.arc.intervalEndPosition;
+	int32_t position = 0;
+	totalSteps = 0;
+	for (size_t i = 0; ; )
+	{
+		// A step is due each time the position passes half way between two step positions
+		const int32_t stepsInInterval = (forwards)
+										? (int32_t)floorf(intervalEndPosition - (float)position + 0.5)
+										: (int32_t)floorf((float)position - intervalEndPosition + 0.5);
+		if (stepsInInterval > 0)
+		{
+			totalSteps += stepsInInterval;
+			position += (forwards) ? stepsInInterval : -stepsInInterval;
+		}
+		++i;
+		if (i > mp.arc.numReversals)
+		{
+			break;
+		}
+		forwards = !forwards;
+		intervalEndPosition = ArcPosition((i < mp.arc.numReversals) ? mp.arc.reverseDistances[i] : dda.totalDistance, rate);
+	}
+
+	// Prepare for the first step
+	nextStep = 0;
+	nextStepTime = 0;
+	stepInterval = 999999;							// initialise to a large value so that we will calculate the time for just one step
+	stepsTillRecalc = 0;							// so that we don't skip the calculation
+	isDelta = false;
+	isArc = true;
+	isMesh = false;
+#if SUPPORT_MOTION_SHAPING
+	isShaped = dda.flags.shapedAcceleration && reprap.GetMove().GetSCurveTime() > 0.0;		// we don't apply input shaping to arc motors
+#else
+	isShaped = false;
+#endif
+	return CalcNextStepTimeArc(dda, false);
+}
+
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+
+// Prepare this DM for a Z motor that follows the height map during a straight move, returning true if there are steps to do.
+// On entry, totalSteps and direction give the net movement, which includes the height corrections at the start and end. On return, direction is the initial direction.
+// We don't count the steps taken before and after reversals, so totalSteps stays as the net movement.
+bool DriveMovement::PrepareMeshAxis(const DDA& dda)
+{
+	// The height map uses head reference point coordinates, so allow for the tool offset
+	const Tool * const tool = dda.GetTool();
+	mp.mesh.dx = dda.directionVector[X_AXIS];
+	mp.mesh.dy = dda.directionVector[Y_AXIS];
+	mp.mesh.startX = dda.endCoordinates[X_AXIS] + Tool::GetOffset(tool, X_AXIS) - mp.mesh.dx * dda.totalDistance;
+	mp.mesh.startY = dda.endCoordinates[Y_AXIS] + Tool::GetOffset(tool, Y_AXIS) - mp.mesh.dy * dda.totalDistance;
+	mp.mesh.s = reprap.GetPlatform().DriveStepsPerUnit(drive) * reprap.GetMove().GetKinematics().GetMotorCoefficient(Z_AXIS, drive);
+
+	// Choose the linear term so that we finish exactly on the end position. This takes care of any Z movement, of planar compensation, and of rounding the end point.
+	const HeightMap& heightMap = reprap.GetMove().AccessHeightMap();
+	float a, b, c, cellLength;
+	heightMap.GetLineCoefficients(mp.mesh.startX, mp.mesh.startY, mp.mesh.dx, mp.mesh.dy, dda.totalDistance, a, b, c, cellLength);
+	const float endHeight = a;
+	heightMap.GetLineCoefficients(mp.mesh.startX, mp.mesh.startY, mp.mesh.dx, mp.mesh.dy, 0.0, a, b, c, cellLength);
+	mp.mesh.h0 = a;
+	mp.mesh.finalPosition = (direction) ? (int32_t)totalSteps : -(int32_t)totalSteps;
+	mp.mesh.k = ((float)mp.mesh.finalPosition - mp.mesh.s * (endHeight - mp.mesh.h0))/dda.totalDistance;
+
+	// Set up the first cell and the first piece of it
+	StartMeshCell(dda, 0.0);
+	mp.mesh.distance = 0.0;
+	mp.mesh.position = 0;
+	direction = StartMeshPiece(0.0);
+
+	// Prepare for the first step
+	nextStep = 0;
+	nextStepTime = 0;
+	stepInterval = 999999;							// initialise to a large value so that we will calculate the time for just one step
+	stepsTillRecalc = 0;							// so that we don't skip the calculation
+	isDelta = false;
+	isArc = false;
+	isMesh = true;
+#if SUPPORT_MOTION_SHAPING
+	isShaped = dda.flags.shapedAcceleration && reprap.GetMove().GetSCurveTime() > 0.0;		// we don't apply input shaping to motors that follow the height map
+#else
+	isShaped = false;
+#endif
+	return CalcNextStepTimeMesh(dda, false);
+}
+
+#endif
+
+// Apply a first-order lag with time constant 'smoothingTime' to a pressure advance whose target changes by 'targetChange' at a constant rate over 'phaseTime' seconds.
+// 'lag' is the advance that the lag has held back at the start of the phase. Update it to the advance held back at the end of the phase and return the change in the advance applied.
+static float LaggedAdvanceChange(float targetChange, float phaseTime, float smoothingTime, float& lag)
+{
+	if (phaseTime <= 0.0)
+	{
+		lag += targetChange;
+		return 0.0;
+	}
+	const float settledLag = (targetChange * smoothingTime)/phaseTime;		// the lag that a constant rate of change of the target settles to
+	const float newLag = settledLag + (lag - settledLag) * expf(-phaseTime/smoothingTime);
+	const float change = targetChange + lag - newLag;
+	lag = newLag;
+	return change;
+}
+
 // Prepare this DM for an extruder move, returning true if there are steps to do
-bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, float& extrusionPending, float speedChange, bool doCompensation)
+// 'pressureAdvanceLag' is the pressure advance in mm of filament that the smoothing time has held back in previous moves. We update it for the next move.
+bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, float& extrusionPending, float& pressureAdvanceLag, float speedChange, bool doCompensation)
 {
 	// Calculate the requested extrusion amount and a few other things
 	float dv = dda.directionVector[drive];
@@ -210,6 +446,14 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 
 	// Add on any fractional extrusion pending from the previous move
 	extrusionRequired += extrusionPending;
+	const float smoothingTime = (doCompensation) ? reprap.GetPlatform().GetPressureAdvanceSmoothingTime(extruder) : 0.0;
+	if (smoothingTime <= 0.0 || extrusionRequired < 0.0)
+	{
+		// We are not smoothing pressure advance in this move, so apply any advance that the smoothing time held back in previous moves
+		extrusionRequired += pressureAdvanceLag;
+		pressureAdvanceLag = 0.0;
+	}
+	const bool compensate = doCompensation && extrusionRequired >= 0.0;
 	dv = extrusionRequired/dda.totalDistance;
 	direction = (dv >= 0.0);
 
@@ -217,15 +461,65 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 	const float effectiveStepsPerMm = fabsf(dv) * rawStepsPerMm;
 
 	float compensationTime;
+	float decelCompensationTime;
 	float accelCompensationDistance;
+	float steadyCompensationDistance = 0.0;							// the advance applied during the steady speed phase, which is nonzero only when smoothing
+	float steadySpeedIncrease = 0.0;
 
-	if (doCompensation && direction)
+	if (compensate)
 	{
-		// Calculate the pressure advance parameters
-		compensationTime = reprap.GetPlatform().GetPressureAdvance(extruder);
+		// Calculate the pressure advance parameters. The advance is K*v + Q*v^2 where v is the extrusion speed. Within each phase we use the average gradient
+		// of that function as the compensation time, which makes the advance exact at the start and end of each phase.
+		const Platform& platform = reprap.GetPlatform();
+		const float linearAdvance = platform.GetPressureAdvance(extruder);
+		const float quadraticAdvance = platform.GetPressureAdvanceQuadratic(extruder) * dv;
+		compensationTime = linearAdvance + quadraticAdvance * (dda.startSpeed + dda.topSpeed);
+		decelCompensationTime = linearAdvance + quadraticAdvance * (dda.topSpeed + dda.endSpeed);
+
+		// If there is a smoothing time then the advance follows that target through a first-order lag, carrying what it holds back from one move to the next.
+		// We calculate the lagged advance exactly at each phase boundary and apply the change within each phase at a constant rate, so the step time equations below still hold.
+		if (smoothingTime > 0.0 && dv > 0.0)
+		{
+			const float accelTime = (dda.topSpeed - dda.startSpeed)/dda.acceleration;
+			const float steadyTime = (params.decelStartDistance - params.accelDistance)/dda.topSpeed;
+			const float decelTime = (dda.topSpeed - dda.endSpeed)/dda.deceleration;
+			float lag = pressureAdvanceLag/dv;							// work in mm of movement within this move
+
+			// The step time equations need the advance not to fall during acceleration or rise during deceleration, and the steady phase must not slow down too much.
+			// If the lag would need that then we hold the excess back until later.
+			float accelAdvance = LaggedAdvanceChange(compensationTime * (dda.topSpeed - dda.startSpeed), accelTime, smoothingTime, lag);
+			if (accelAdvance < 0.0)
+			{
+				lag += accelAdvance;
+				accelAdvance = 0.0;
+			}
+			steadyCompensationDistance = LaggedAdvanceChange(0.0, steadyTime, smoothingTime, lag);
+			const float minSteadyCompensationDistance = -0.5 * dda.topSpeed * steadyTime;
+			if (steadyCompensationDistance < minSteadyCompensationDistance)
+			{
+				lag += steadyCompensationDistance - minSteadyCompensationDistance;
+				steadyCompensationDistance = minSteadyCompensationDistance;
+			}
+			float decelAdvance = LaggedAdvanceChange(-decelCompensationTime * (dda.topSpeed - dda.endSpeed), decelTime, smoothingTime, lag);
+			if (decelAdvance > 0.0)
+			{
+				lag += decelAdvance;
+				decelAdvance = 0.0;
+			}
+			pressureAdvanceLag = lag * dv;
+
+			compensationTime = (accelTime > 0.0) ? accelAdvance/(dda.topSpeed - dda.startSpeed) : 0.0;
+			decelCompensationTime = (decelTime > 0.0) ? -decelAdvance/(dda.topSpeed - dda.endSpeed) : 0.0;
+			if (steadyTime > 0.0)
+			{
+				steadySpeedIncrease = steadyCompensationDistance/steadyTime;
+			}
+		}
+
 		const float compensationClocks = compensationTime * (float)StepTimer::StepClockRate;
 		mp.cart.compensationClocks = roundU32(compensationClocks);
-		mp.cart.accelCompensationClocks = roundU32(compensationClocks * params.compFactor);
+		mp.cart.accelCompensationClocks = roundS32(compensationClocks * params.compFactor);
+		mp.cart.decelCompensationClocks = roundU32(decelCompensationTime * (float)StepTimer::StepClockRate);
 
 #ifdef COMPENSATE_SPEED_CHANGES
 		// If there is a speed change at the start of the move, theoretically we should instantly advance or retard the filament by the associated compensation amount.
@@ -234,16 +528,23 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 		stepsPerMm *= factor;
 #endif
 		// Calculate the net total extrusion to allow for compensation. It may be negative.
-		extrusionRequired += (dda.endSpeed - dda.startSpeed) * compensationTime * dv;
+		extrusionRequired += ((dda.topSpeed - dda.startSpeed) * compensationTime + steadyCompensationDistance - (dda.topSpeed - dda.endSpeed) * decelCompensationTime) * dv;
 
 		// Calculate the acceleration phase parameters
 		accelCompensationDistance = compensationTime * (dda.topSpeed - dda.startSpeed);
 		mp.cart.accelStopStep = (uint32_t)((params.accelDistance + accelCompensationDistance) * effectiveStepsPerMm) + 1;
+
+		// If smoothing changes the steady phase speed, adjust the steady phase time offset so that the phase still starts when the acceleration ends
+		if (steadySpeedIncrease != 0.0)
+		{
+			mp.cart.accelCompensationClocks = roundS32(((params.accelDistance + accelCompensationDistance)/(dda.topSpeed + steadySpeedIncrease) - params.accelDistance/dda.topSpeed)
+														* (float)StepTimer::StepClockRate);
+		}
 	}
 	else
 	{
-		accelCompensationDistance = compensationTime = 0.0;
-		mp.cart.compensationClocks = mp.cart.accelCompensationClocks = 0;
+		accelCompensationDistance = compensationTime = decelCompensationTime = 0.0;
+		mp.cart.compensationClocks = mp.cart.accelCompensationClocks = mp.cart.decelCompensationClocks = 0;
 
 		// Calculate the acceleration phase parameters
 		mp.cart.accelStopStep = (uint32_t)(params.accelDistance * effectiveStepsPerMm) + 1;
@@ -262,7 +563,7 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 	mp.cart.twoCsquaredTimesMmPerStepDivD = roundU64((double)(StepTimer::StepClockRateSquared * 2)/((double)effectiveStepsPerMm * (double)dda.deceleration));
 
 	// Constant speed phase parameters
-	mp.cart.mmPerStepTimesCKdivtopSpeed = (uint32_t)((float)((uint64_t)StepTimer::StepClockRate * K1)/(effectiveStepsPerMm * dda.topSpeed));
+	mp.cart.mmPerStepTimesCKdivtopSpeed = (uint32_t)((float)((uint64_t)StepTimer::StepClockRate * K1)/(effectiveStepsPerMm * (dda.topSpeed + steadySpeedIncrease)));
 
 	// Calculate the deceleration and reverse phase parameters and update totalSteps
 	// First check whether there is any deceleration at all, otherwise we may get strange results because of rounding errors
@@ -275,14 +576,15 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 	}
 	else
 	{
-		mp.cart.decelStartStep = (uint32_t)((params.decelStartDistance + accelCompensationDistance) * effectiveStepsPerMm) + 1;
-		const int32_t initialDecelSpeedTimesCdivD = (int32_t)params.topSpeedTimesCdivD - (int32_t)mp.cart.compensationClocks;	// signed because it may be negative and we square it
+		const float decelStartCompensationDistance = accelCompensationDistance + steadyCompensationDistance;
+		mp.cart.decelStartStep = (uint32_t)((params.decelStartDistance + decelStartCompensationDistance) * effectiveStepsPerMm) + 1;
+		const int32_t initialDecelSpeedTimesCdivD = (int32_t)params.topSpeedTimesCdivD - (int32_t)mp.cart.decelCompensationClocks;	// signed because it may be negative and we square it
 		const uint64_t initialDecelSpeedTimesCdivDSquared = isquare64(initialDecelSpeedTimesCdivD);
 		twoDistanceToStopTimesCsquaredDivD =
-			initialDecelSpeedTimesCdivDSquared + roundU64(((params.decelStartDistance + accelCompensationDistance) * (float)(StepTimer::StepClockRateSquared * 2))/dda.deceleration);
+			initialDecelSpeedTimesCdivDSquared + roundU64(((params.decelStartDistance + decelStartCompensationDistance) * (float)(StepTimer::StepClockRateSquared * 2))/dda.deceleration);
 
 		// See whether there is a reverse phase
-		const float compensationSpeedChange = dda.deceleration * compensationTime;
+		const float compensationSpeedChange = dda.deceleration * decelCompensationTime;
 		const uint32_t stepsBeforeReverse = (compensationSpeedChange > dda.topSpeed)
 											? mp.cart.decelStartStep - 1
 											: twoDistanceToStopTimesCsquaredDivD/mp.cart.twoCsquaredTimesMmPerStepDivD;
@@ -312,6 +614,17 @@ bool DriveMovement::PrepareExtruder(const DDA& dda, const PrepParams& params, fl
 	stepInterval = 999999;							// initialise to a large value so that we will calculate the time for just one step
 	stepsTillRecalc = 0;							// so that we don't skip the calculation
 	isDelta = false;
+	isArc = false;
+	isMesh = false;
+#if SUPPORT_MOTION_SHAPING
+	isShaped = dda.flags.shapedAcceleration && mp.cart.compensationClocks == 0 && mp.cart.decelCompensationClocks == 0 && steadyCompensationDistance == 0.0
+				&& reprap.GetMove().GetSCurveTime() > 0.0;	// pressure advance assumes constant acceleration
+	mp.cart.mmPerStep = 1.0/effectiveStepsPerMm;
+	mp.cart.shaper = nullptr;											// we don't apply input shaping to extruders
+	shapeAccel = shapeDecel = false;
+#else
+	isShaped = false;
+#endif
 	return CalcNextStepTimeCartesian(dda, false);
 }
 
@@ -326,6 +639,26 @@ void DriveMovement::DebugPrint() const
 					c, (state == DMState::stepError) ? " ERR:" : ":", (direction) ? 'F' : 'B', totalSteps, nextStep, reverseStartStep, stepInterval,
 					twoDistanceToStopTimesCsquaredDivD);
 
+#if SUPPORT_NATIVE_ARCS
+		if (isArc)
+		{
+			debugPrintf("a=%f b=%f k=%f apm=%f tol=%f nrev=%u pos=%" PRIi32 " fpos=%" PRIi32 "\n",
+						(double)mp.arc.a, (double)mp.arc.b, (double)mp.arc.k, (double)mp.arc.anglePerMm, (double)mp.arc.tolerance,
+						mp.arc.numReversals, mp.arc.position, mp.arc.finalPosition
+						);
+		}
+		else
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+		if (isMesh)
+		{
+			debugPrintf("x0=%f y0=%f dx=%f dy=%f k=%f s=%f h0=%f pos=%" PRIi32 " fpos=%" PRIi32 "\n",
+						(double)mp.mesh.startX, (double)mp.mesh.startY, (double)mp.mesh.dx, (double)mp.mesh.dy, (double)mp.mesh.k, (double)mp.mesh.s, (double)mp.mesh.h0,
+						mp.mesh.position, mp.mesh.finalPosition
+						);
+		}
+		else
+#endif
 		if (isDelta)
 		{
 			debugPrintf("hmz0sK=%" PRIi32 " minusAaPlusBbTimesKs=%" PRIi32 " dSquaredMinusAsquaredMinusBsquared=%" PRId64 "\n"
@@ -337,9 +670,9 @@ void DriveMovement::DebugPrint() const
 		else
 		{
 			debugPrintf("accelStopStep=%" PRIu32 " decelStartStep=%" PRIu32 " 2c2mmsda=%" PRIu64 " 2c2mmsdd=%" PRIu64 "\n"
-						"mmPerStepTimesCdivtopSpeed=%" PRIu32 " fmsdmtstdca2=%" PRId64 " cc=%" PRIu32 " acc=%" PRIu32 "\n",
+						"mmPerStepTimesCdivtopSpeed=%" PRIu32 " fmsdmtstdca2=%" PRId64 " cc=%" PRIu32 " acc=%" PRIi32 " dcc=%" PRIu32 "\n",
 						mp.cart.accelStopStep, mp.cart.decelStartStep, mp.cart.twoCsquaredTimesMmPerStepDivA, mp.cart.twoCsquaredTimesMmPerStepDivD,
-						mp.cart.mmPerStepTimesCKdivtopSpeed, mp.cart.fourMaxStepDistanceMinusTwoDistanceToStopTimesCsquaredDivD, mp.cart.compensationClocks, mp.cart.accelCompensationClocks
+						mp.cart.mmPerStepTimesCKdivtopSpeed, mp.cart.fourMaxStepDistanceMinusTwoDistanceToStopTimesCsquaredDivD, mp.cart.compensationClocks, mp.cart.accelCompensationClocks, mp.cart.decelCompensationClocks
 						);
 		}
 	}
@@ -349,6 +682,195 @@ void DriveMovement::DebugPrint() const
 	}
 }
 
+#if SUPPORT_MOTION_SHAPING || SUPPORT_NATIVE_ARCS
+constexpr float SecondsPerStepClock = 1.0/(float)StepTimer::StepClockRate;
+#endif
+
+#if SUPPORT_MOTION_SHAPING
+constexpr unsigned int MaxPieceTimeIterations = 24;		// enough to bisect down to the tolerance from a poor estimate in a piece lasting several seconds
+constexpr float PieceTimeTolerance = 0.1;				// the tolerance in step clocks when solving for the time of a step within a piece
+#endif
+
+#if SUPPORT_MOTION_SHAPING
+
+// Return the time at which we reach the specified distance into a piece of motion that starts with speed v, acceleration a and constant jerk j, and lasts for maxT.
+// The distance is v.t + a.t^2/2 + j.t^3/6. We solve it by Newton-Raphson iteration starting from an estimate of the time, which is normally the time of the previous step
+// plus the previous step interval, so one or two iterations reach the tolerance. We keep the root bracketed and bisect if an iteration leaves the bracket, so a poor
+// estimate costs more iterations but still converges. The speed must not be negative during the piece. Times are in step clocks and speeds in mm per step clock.
+static float CubicPieceTime(float distance, float v, float a, float j, float maxT, float estimate)
+{
+	if (distance <= 0.0)
+	{
+		return 0.0;
+	}
+
+	float low = 0.0, high = maxT;
+	float t = (estimate > 0.0 && estimate < maxT) ? estimate : 0.5 * maxT;
+	for (unsigned int i = 0; i < MaxPieceTimeIterations; ++i)
+	{
+		const float error = t * (v + t * (0.5 * a + t * j * (1.0/6.0))) - distance;
+		if (error > 0.0)
+		{
+			high = t;
+		}
+		else
+		{
+			low = t;
+		}
+		const float speed = v + t * (a + 0.5 * j * t);
+		const float newT = (speed > 0.0) ? t - error/speed : 0.5 * (low + high);
+		const float nextT = (newT >= low && newT <= high) ? newT : 0.5 * (low + high);
+		if (fabsf(nextT - t) < PieceTimeTolerance)
+		{
+			return nextT;
+		}
+		t = nextT;
+	}
+	return t;
+}
+
+// Return the time at which we reach the specified distance into an S-curve acceleration or deceleration phase with no input shaping.
+// The acceleration ramps up linearly over the jerk time, stays constant, then ramps down linearly to zero at the end of the phase, so we solve within the piece that holds the distance.
+// The ramp-down piece is measured back from the end of the phase, where the speed is known exactly. The estimate is the expected time into the phase.
+static float SCurvePhaseTime(const DDA& dda, float distance, bool decel, float estimate)
+{
+	const float startSpeed = ((decel) ? dda.topSpeed : dda.startSpeed) * SecondsPerStepClock;
+	const float endSpeed = ((decel) ? dda.endSpeed : dda.topSpeed) * SecondsPerStepClock;
+	const float phaseClocks = (decel) ? dda.afterPrepare.decelClocks : dda.afterPrepare.accelClocks;
+	const float jerkClocks = (decel) ? dda.afterPrepare.decelJerkClocks : dda.afterPrepare.accelJerkClocks;
+	const float peakAcceleration = (decel) ? dda.afterPrepare.decelPeak : dda.afterPrepare.accelPeak;
+	if (jerkClocks <= 0.0)
+	{
+		return CubicPieceTime(distance, startSpeed, peakAcceleration, 0.0, phaseClocks, estimate);
+	}
+
+	const float jerk = (decel) ? dda.afterPrepare.decelJerk : dda.afterPrepare.accelJerk;
+	const float rampUpDistance = jerkClocks * (startSpeed + peakAcceleration * jerkClocks * (1.0/6.0));
+	if (distance <= rampUpDistance)
+	{
+		return CubicPieceTime(distance, startSpeed, 0.0, jerk, jerkClocks, estimate);
+	}
+
+	const float distanceToGo = 0.5 * (startSpeed + endSpeed) * phaseClocks - distance;
+	const float rampDownDistance = jerkClocks * (endSpeed - peakAcceleration * jerkClocks * (1.0/6.0));
+	if (distanceToGo <= rampDownDistance)
+	{
+		return phaseClocks - CubicPieceTime(distanceToGo, endSpeed, 0.0, -jerk, jerkClocks, phaseClocks - estimate);
+	}
+
+	return jerkClocks + CubicPieceTime(distance - rampUpDistance, startSpeed + 0.5 * peakAcceleration * jerkClocks, peakAcceleration, 0.0, phaseClocks - 2.0 * jerkClocks, estimate - jerkClocks);
+}
+
+// Return the jerk time of the unshaped acceleration pulse of a phase of an input shaped move, or a negative value if the phase is too short to apply the shaper to.
+// To keep the phase duration, speed change and distance the same as without shaping, the pulse is shorter than the phase by the extra time of the shaper.
+// Its peak acceleration is speedChange/(pulseClocks - jerkClocks), which must not exceed the acceleration limit of the move. We allow a little for rounding error.
+/*static*/ float DriveMovement::ShapedJerkClocks(const DDA& dda, const AxisShaper& shaper, bool decel)
+{
+	const float pulseClocks = ((decel) ? dda.afterPrepare.decelClocks : dda.afterPrepare.accelClocks) - shaper.GetExtraClocks();
+	const float minPulseClocks = (fabsf((decel) ? dda.topSpeed - dda.endSpeed : dda.topSpeed - dda.startSpeed)/dda.maxShapedAcceleration) * StepTimer::StepClockRate;
+	if (pulseClocks <= 0.0 || pulseClocks < 0.98 * minPulseClocks)
+	{
+		return -1.0;
+	}
+	const float jerkClocks = (decel) ? dda.afterPrepare.decelJerkClocks : dda.afterPrepare.accelJerkClocks;
+	return max<float>(min<float>(min<float>(jerkClocks, 0.5 * pulseClocks), pulseClocks - minPulseClocks), 0.0);
+}
+
+// Set up the next piece of the shaped acceleration or deceleration phase, starting at mp.cart.pieceStart.
+// The shaped acceleration is the unshaped S-curve pulse convolved with the shaper impulses, so it changes linearly between the times at which
+// an impulse copy of the pulse starts, ends or starts or stops ramping. The piece ends at the next of those times.
+void DriveMovement::StartShapedPiece(const DDA& dda, bool decel)
+{
+	const AxisShaper& shaper = *mp.cart.shaper;
+	const float phaseClocks = (decel) ? dda.afterPrepare.decelClocks : dda.afterPrepare.accelClocks;
+	const float pulseClocks = phaseClocks - shaper.GetExtraClocks();
+	const float jerkClocks = (decel) ? mp.cart.decelPulseJerkClocks : mp.cart.accelPulseJerkClocks;
+	const float peakAcceleration = (decel) ? mp.cart.decelPulsePeak : mp.cart.accelPulsePeak;
+
+	float pieceEnd = phaseClocks;
+	for (unsigned int i = 0; i < shaper.GetNumImpulses(); ++i)
+	{
+		const float pulseStart = shaper.GetStartOffsetClocks() + shaper.GetDelayClocks(i);
+		const float breakpoints[4] = { pulseStart, pulseStart + jerkClocks, pulseStart + pulseClocks - jerkClocks, pulseStart + pulseClocks };
+		for (float t : breakpoints)
+		{
+			if (t > mp.cart.pieceStart && t < pieceEnd)
+			{
+				pieceEnd = t;
+			}
+		}
+	}
+	mp.cart.pieceEnd = pieceEnd;
+
+	// Evaluate the acceleration and jerk in the middle of the piece, so that a pulse with no ramps doesn't give us the value either side of a step change
+	const float midPiece = 0.5 * (mp.cart.pieceStart + pieceEnd);
+	float acceleration = 0.0, jerk = 0.0;
+	for (unsigned int i = 0; i < shaper.GetNumImpulses(); ++i)
+	{
+		const float t = midPiece - shaper.GetStartOffsetClocks() - shaper.GetDelayClocks(i);
+		if (t > 0.0 && t < pulseClocks)
+		{
+			if (t < jerkClocks)
+			{
+				acceleration += shaper.GetAmplitude(i) * t/jerkClocks;
+				jerk += shaper.GetAmplitude(i)/jerkClocks;
+			}
+			else if (t > pulseClocks - jerkClocks)
+			{
+				acceleration += shaper.GetAmplitude(i) * (pulseClocks - t)/jerkClocks;
+				jerk -= shaper.GetAmplitude(i)/jerkClocks;
+			}
+			else
+			{
+				acceleration += shaper.GetAmplitude(i);
+			}
+		}
+	}
+	mp.cart.pieceJerk = peakAcceleration * jerk;
+	mp.cart.pieceAcceleration = peakAcceleration * acceleration - mp.cart.pieceJerk * (midPiece - mp.cart.pieceStart);
+}
+
+// Return the time at which we reach the specified distance into an acceleration or deceleration phase with shaped acceleration. The estimate is the expected time into the phase.
+// If there is an input shaper for the phase, step through the pieces of the shaped acceleration and solve within the piece that contains the distance.
+// The distance only increases during a phase, so each piece is set up just once.
+float DriveMovement::ShapedPhaseTime(const DDA& dda, float distance, bool decel, float estimate)
+{
+	if (!((decel) ? shapeDecel : shapeAccel))
+	{
+		return SCurvePhaseTime(dda, distance, decel, estimate);
+	}
+
+	const unsigned int phase = (decel) ? 2 : 1;
+	if (shapedPhase != phase || distance < mp.cart.pieceDistance)
+	{
+		// Start the phase with a piece of zero length, so that the first piece gets set up below
+		shapedPhase = phase;
+		mp.cart.pieceStart = mp.cart.pieceEnd = mp.cart.pieceDistance = 0.0;
+		mp.cart.pieceSpeed = ((decel) ? dda.topSpeed : dda.startSpeed) * SecondsPerStepClock;
+		mp.cart.pieceAcceleration = mp.cart.pieceJerk = 0.0;
+	}
+
+	const float phaseClocks = (decel) ? dda.afterPrepare.decelClocks : dda.afterPrepare.accelClocks;
+	for (;;)
+	{
+		const float pieceClocks = mp.cart.pieceEnd - mp.cart.pieceStart;
+		const float pieceEndDistance = mp.cart.pieceDistance
+										+ pieceClocks * (mp.cart.pieceSpeed + pieceClocks * (0.5 * mp.cart.pieceAcceleration + pieceClocks * mp.cart.pieceJerk * (1.0/6.0)));
+		if (distance <= pieceEndDistance || mp.cart.pieceEnd >= phaseClocks)
+		{
+			break;
+		}
+		mp.cart.pieceSpeed += pieceClocks * (mp.cart.pieceAcceleration + 0.5 * pieceClocks * mp.cart.pieceJerk);
+		mp.cart.pieceDistance = pieceEndDistance;
+		mp.cart.pieceStart = mp.cart.pieceEnd;
+		StartShapedPiece(dda, decel);
+	}
+	return mp.cart.pieceStart
+			+ CubicPieceTime(distance - mp.cart.pieceDistance, mp.cart.pieceSpeed, mp.cart.pieceAcceleration, mp.cart.pieceJerk, mp.cart.pieceEnd - mp.cart.pieceStart, estimate - mp.cart.pieceStart);
+}
+
+#endif
+
 // Calculate and store the time since the start of the move when the next step for the specified DriveMovement is due.
 // Return true if there are more steps to do.
 // This is also used for extruders on delta machines.
@@ -364,7 +886,11 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 										? reverseStartStep
 										: totalSteps
 									  ) - nextStep;
-		if (stepInterval < DDA::MinCalcIntervalCartesian/4 && stepsToLimit > 8)
+		if (stepInterval < DDA::MinCalcIntervalCartesian/8 && stepsToLimit > 16)
+		{
+			shiftFactor = 4;		// hexadecimal stepping
+		}
+		else if (stepInterval < DDA::MinCalcIntervalCartesian/4 && stepsToLimit > 8)
 		{
 			shiftFactor = 3;		// octal stepping
 		}
@@ -381,12 +907,35 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	stepsTillRecalc = (1u << shiftFactor) - 1u;					// store number of additional steps to generate
 
 	const uint32_t nextCalcStep = nextStep + stepsTillRecalc;
+#if INCREMENTAL_SQRT
+	// If the step rate is high and the previous step was calculated in the same phase, then the time of the previous step plus the previous step interval
+	// is a good estimate of the square root we need. nextStepTime is the calculated time of step (nextStep - 1) at this point.
+	const uint32_t estimatedTimeIncrement = (stepInterval < DDA::MinCalcIntervalCartesian) ? stepInterval << shiftFactor : 0;
+#endif
 	uint32_t nextCalcStepTime;
 	if (nextCalcStep < mp.cart.accelStopStep)
 	{
 		// acceleration phase
-		const uint32_t adjustedStartSpeedTimesCdivA = dda.afterPrepare.startSpeedTimesCdivA + mp.cart.compensationClocks;
-		nextCalcStepTime = isqrt64(isquare64(adjustedStartSpeedTimesCdivA) + (mp.cart.twoCsquaredTimesMmPerStepDivA * nextCalcStep)) - adjustedStartSpeedTimesCdivA;
+#if SUPPORT_MOTION_SHAPING
+		if (isShaped)
+		{
+			const float estimate = (float)nextStepTime + (float)(stepInterval << shiftFactor);
+			nextCalcStepTime = (uint32_t)ShapedPhaseTime(dda, nextCalcStep * mp.cart.mmPerStep, false, estimate);
+		}
+		else
+#endif
+		{
+			const uint32_t adjustedStartSpeedTimesCdivA = dda.afterPrepare.startSpeedTimesCdivA + mp.cart.compensationClocks;
+			const uint64_t temp = isquare64(adjustedStartSpeedTimesCdivA) + (mp.cart.twoCsquaredTimesMmPerStepDivA * nextCalcStep);
+#if INCREMENTAL_SQRT
+			nextCalcStepTime = ((estimatedTimeIncrement != 0)
+									? isqrt64FromEstimate(temp, nextStepTime + adjustedStartSpeedTimesCdivA + estimatedTimeIncrement)
+									: isqrt64(temp)
+							   ) - adjustedStartSpeedTimesCdivA;
+#else
+			nextCalcStepTime = isqrt64(temp) - adjustedStartSpeedTimesCdivA;
+#endif
+		}
 	}
 	else if (nextCalcStep < mp.cart.decelStartStep)
 	{
@@ -399,12 +948,43 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	else if (nextCalcStep < reverseStartStep)
 	{
 		// deceleration phase, not reversed yet
-		const uint64_t temp = mp.cart.twoCsquaredTimesMmPerStepDivD * nextCalcStep;
-		const uint32_t adjustedTopSpeedTimesCdivDPlusDecelStartClocks = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - mp.cart.compensationClocks;
-		// Allow for possible rounding error when the end speed is zero or very small
-		nextCalcStepTime = (temp < twoDistanceToStopTimesCsquaredDivD)
-						? adjustedTopSpeedTimesCdivDPlusDecelStartClocks - isqrt64(twoDistanceToStopTimesCsquaredDivD - temp)
-						: adjustedTopSpeedTimesCdivDPlusDecelStartClocks;
+#if SUPPORT_MOTION_SHAPING
+		if (isShaped)
+		{
+			// Rounding error may make the last steps fall slightly after the end of the move, which would be reported as a step error
+			const float estimate = (float)nextStepTime + (float)(stepInterval << shiftFactor) - dda.afterPrepare.decelStartClocks;
+			const float phaseTime = ShapedPhaseTime(dda, nextCalcStep * mp.cart.mmPerStep - dda.afterPrepare.decelStartDistance, true, estimate);
+			nextCalcStepTime = min<uint32_t>((uint32_t)(dda.afterPrepare.decelStartClocks + phaseTime), dda.clocksNeeded);
+		}
+		else
+#endif
+		{
+			const uint64_t temp = mp.cart.twoCsquaredTimesMmPerStepDivD * nextCalcStep;
+			const uint32_t adjustedTopSpeedTimesCdivDPlusDecelStartClocks = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - mp.cart.decelCompensationClocks;
+			// Allow for possible rounding error when the end speed is zero or very small
+#if INCREMENTAL_SQRT
+			if (temp >= twoDistanceToStopTimesCsquaredDivD)
+			{
+				nextCalcStepTime = adjustedTopSpeedTimesCdivDPlusDecelStartClocks;
+			}
+			else if (   estimatedTimeIncrement != 0
+					 && nextCalcStep - (1u << shiftFactor) >= mp.cart.decelStartStep
+					 && nextStepTime + estimatedTimeIncrement <= adjustedTopSpeedTimesCdivDPlusDecelStartClocks
+					)
+			{
+				nextCalcStepTime = adjustedTopSpeedTimesCdivDPlusDecelStartClocks
+									- isqrt64FromEstimate(twoDistanceToStopTimesCsquaredDivD - temp, adjustedTopSpeedTimesCdivDPlusDecelStartClocks - nextStepTime - estimatedTimeIncrement);
+			}
+			else
+			{
+				nextCalcStepTime = adjustedTopSpeedTimesCdivDPlusDecelStartClocks - isqrt64(twoDistanceToStopTimesCsquaredDivD - temp);
+			}
+#else
+			nextCalcStepTime = (temp < twoDistanceToStopTimesCsquaredDivD)
+							? adjustedTopSpeedTimesCdivDPlusDecelStartClocks - isqrt64(twoDistanceToStopTimesCsquaredDivD - temp)
+							: adjustedTopSpeedTimesCdivDPlusDecelStartClocks;
+#endif
+		}
 	}
 	else
 	{
@@ -417,15 +997,27 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 				reprap.GetPlatform().SetDirection(drive, direction);
 			}
 		}
-		const uint32_t adjustedTopSpeedTimesCdivDPlusDecelStartClocks = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - mp.cart.compensationClocks;
+		const uint32_t adjustedTopSpeedTimesCdivDPlusDecelStartClocks = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - mp.cart.decelCompensationClocks;
+		const uint64_t temp = (int64_t)(mp.cart.twoCsquaredTimesMmPerStepDivD * nextCalcStep) - mp.cart.fourMaxStepDistanceMinusTwoDistanceToStopTimesCsquaredDivD;
+#if INCREMENTAL_SQRT
 		nextCalcStepTime = adjustedTopSpeedTimesCdivDPlusDecelStartClocks
-							+ isqrt64((int64_t)(mp.cart.twoCsquaredTimesMmPerStepDivD * nextCalcStep) - mp.cart.fourMaxStepDistanceMinusTwoDistanceToStopTimesCsquaredDivD);
+							+ ((estimatedTimeIncrement != 0 && nextCalcStep - (1u << shiftFactor) >= reverseStartStep && nextStepTime >= adjustedTopSpeedTimesCdivDPlusDecelStartClocks)
+								? isqrt64FromEstimate(temp, nextStepTime - adjustedTopSpeedTimesCdivDPlusDecelStartClocks + estimatedTimeIncrement)
+								: isqrt64(temp)
+							  );
+#else
+		nextCalcStepTime = adjustedTopSpeedTimesCdivDPlusDecelStartClocks + isqrt64(temp);
+#endif
 	}
 
 	// When crossing between movement phases with high microstepping, due to rounding errors the next step may appear to be due before the last one
 	stepInterval = (nextCalcStepTime > nextStepTime)
 					? (nextCalcStepTime - nextStepTime) >> shiftFactor	// calculate the time per step, ready for next time
 					: 0;
+	if (live && stepInterval < minStepInterval && stepInterval != 0)
+	{
+		minStepInterval = stepInterval;
+	}
 #if EVEN_STEPS
 	nextStepTime = nextCalcStepTime - (stepsTillRecalc * stepInterval);
 #else
@@ -511,7 +1103,23 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	const int32_t t1 = mp.delta.minusAaPlusBbTimesKs + hmz0scK;
 	// Due to rounding error we can end up trying to take the square root of a negative number if we do not take precautions here
 	const int64_t t2a = mp.delta.dSquaredMinusAsquaredMinusBsquaredTimesKsquaredSsquared - (int64_t)isquare64(mp.delta.hmz0sK) + (int64_t)isquare64(t1);
+#if INCREMENTAL_SQRT
+	// The square root changes smoothly from one step to the next, so extrapolating from the previous two values usually gives an estimate within a unit or two
+	int32_t t2;
+	if (t2a > 0)
+	{
+		const int32_t estimate = mp.delta.lastRoot + mp.delta.rootChangePerStep * (int32_t)(1u << shiftFactor);
+		t2 = (estimate > 0) ? (int32_t)isqrt64FromEstimate((uint64_t)t2a, (uint32_t)estimate) : (int32_t)isqrt64(t2a);
+	}
+	else
+	{
+		t2 = 0;
+	}
+	mp.delta.rootChangePerStep = (t2 - mp.delta.lastRoot)/(int32_t)(1u << shiftFactor);
+	mp.delta.lastRoot = t2;
+#else
 	const int32_t t2 = (t2a > 0) ? isqrt64(t2a) : 0;
+#endif
 	const int32_t dsK = (direction) ? t1 - t2 : t1 + t2;
 
 	// Now feed dsK into a modified version of the step algorithm for Cartesian motion without elasticity compensation
@@ -522,11 +1130,23 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 		return false;
 	}
 
+#if INCREMENTAL_SQRT
+	// As for Cartesian motion, the time of the previous step plus the previous step interval is a good estimate of the square root we need when the step rate is high
+	const uint32_t estimatedTimeIncrement = (stepInterval < DDA::MinCalcIntervalDelta) ? stepInterval << shiftFactor : 0;
+#endif
 	uint32_t nextCalcStepTime;
 	if ((uint32_t)dsK < mp.delta.accelStopDsK)
 	{
 		// Acceleration phase
-		nextCalcStepTime = isqrt64(isquare64(dda.afterPrepare.startSpeedTimesCdivA) + (mp.delta.twoCsquaredTimesMmPerStepDivA * (uint32_t)dsK)/K2) - dda.afterPrepare.startSpeedTimesCdivA;
+		const uint64_t temp = isquare64(dda.afterPrepare.startSpeedTimesCdivA) + (mp.delta.twoCsquaredTimesMmPerStepDivA * (uint32_t)dsK)/K2;
+#if INCREMENTAL_SQRT
+		nextCalcStepTime = ((estimatedTimeIncrement != 0)
+								? isqrt64FromEstimate(temp, nextStepTime + dda.afterPrepare.startSpeedTimesCdivA + estimatedTimeIncrement)
+								: isqrt64(temp)
+						   ) - dda.afterPrepare.startSpeedTimesCdivA;
+#else
+		nextCalcStepTime = isqrt64(temp) - dda.afterPrepare.startSpeedTimesCdivA;
+#endif
 	}
 	else if ((uint32_t)dsK < mp.delta.decelStartDsK)
 	{
@@ -539,15 +1159,35 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	{
 		const uint64_t temp = (mp.delta.twoCsquaredTimesMmPerStepDivD * (uint32_t)dsK)/K2;
 		// Because of possible rounding error when the end speed is zero or very small, we need to check that the square root will work OK
+#if INCREMENTAL_SQRT
+		if (temp >= twoDistanceToStopTimesCsquaredDivD)
+		{
+			nextCalcStepTime = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks;
+		}
+		else if (estimatedTimeIncrement != 0 && nextStepTime + estimatedTimeIncrement <= dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks)
+		{
+			nextCalcStepTime = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks
+								- isqrt64FromEstimate(twoDistanceToStopTimesCsquaredDivD - temp, dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - nextStepTime - estimatedTimeIncrement);
+		}
+		else
+		{
+			nextCalcStepTime = dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - isqrt64(twoDistanceToStopTimesCsquaredDivD - temp);
+		}
+#else
 		nextCalcStepTime = (temp < twoDistanceToStopTimesCsquaredDivD)
 						? dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks - isqrt64(twoDistanceToStopTimesCsquaredDivD - temp)
 						: dda.afterPrepare.topSpeedTimesCdivDPlusDecelStartClocks;
+#endif
 	}
 
 	// When crossing between movement phases with high microstepping, due to rounding errors the next step may appear to be due before the last one.
 	stepInterval = (nextCalcStepTime > nextStepTime)
 					? (nextCalcStepTime - nextStepTime) >> shiftFactor	// calculate the time per step, ready for next time
 					: 0;
+	if (live && stepInterval < minStepInterval && stepInterval != 0)
+	{
+		minStepInterval = stepInterval;
+	}
 #if EVEN_STEPS
 	nextStepTime = nextCalcStepTime - (stepsTillRecalc * stepInterval);
 #else
@@ -575,6 +1215,353 @@ pre(nextStep < totalSteps; stepsTillRecalc == 0)
 	return true;
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Return the position of an arc motor in steps relative to the start of the move at the specified distance along the path, and the rate of change of position with distance.
+// We use the half angle so that cos(angle) - 1 doesn't lose precision when the angle is small.
+float DriveMovement::ArcPosition(float distance, float& rate) const
+{
+	const float halfAngle = 0.5 * mp.arc.anglePerMm * distance;
+	const float sinHalfAngle = sinf(halfAngle);
+	const float cosHalfAngle = cosf(halfAngle);
+	const float cosAngleMinusOne = -2.0 * fsquare(sinHalfAngle);
+	const float sinAngle = 2.0 * sinHalfAngle * cosHalfAngle;
+	rate = mp.arc.anglePerMm * (mp.arc.b * (1.0 + cosAngleMinusOne) - mp.arc.a * sinAngle) + mp.arc.k;
+	return mp.arc.a * cosAngleMinusOne + mp.arc.b * sinAngle + mp.arc.k * distance;
+}
+
+// Return the distance along the path at which an arc motor reaches the specified position, and the rate of change of position at that distance.
+// The position must lie between the positions at mp.arc.distance and mp.arc.intervalEnd, which the motor moves through monotonically.
+// We use Newton-Raphson iteration starting from an estimate based on the previous step, falling back to bisection if it strays outside the interval.
+// The estimate is usually good enough that one or two iterations reach the tolerance.
+float DriveMovement::ArcDistance(float position, float& rate) const
+{
+	const bool forwards = direction;
+	float low = mp.arc.distance, high = mp.arc.intervalEnd;
+	float distance = (mp.arc.intervalEndPosition != mp.arc.lastPosition)
+						? low + (high - low) * (position - mp.arc.lastPosition)/(mp.arc.intervalEndPosition - mp.arc.lastPosition)
+						: high;
+	if (mp.arc.rate != 0.0 && (mp.arc.rate > 0.0) == forwards)
+	{
+		// Extrapolating from the previous step is usually a much better estimate than interpolating across the whole interval
+		const float estimate = low + (position - mp.arc.lastPosition)/mp.arc.rate;
+		if (estimate > low && estimate < high)
+		{
+			distance = estimate;
+		}
+	}
+
+	rate = mp.arc.rate;
+	for (unsigned int i = 0; i < MaxArcIterations; ++i)
+	{
+		const float error = ArcPosition(distance, rate) - position;
+		if (fabsf(error) < mp.arc.tolerance)
+		{
+			break;
+		}
+		if ((error > 0.0) == forwards)
+		{
+			high = distance;
+		}
+		else
+		{
+			low = distance;
+		}
+		const float newDistance = (rate != 0.0) ? distance - error/rate : low;
+		distance = (newDistance > low && newDistance < high) ? newDistance : 0.5 * (low + high);
+	}
+	return distance;
+}
+
+// Return the time in step clocks since the start of the move at which the move reaches the specified distance along the path.
+// The estimate is the expected time, which we use only if the acceleration is shaped.
+float DriveMovement::PathStepTime(const DDA& dda, float distance, float estimate) const
+{
+	const float topSpeed = dda.topSpeed * SecondsPerStepClock;					// all speeds here are in mm per step clock
+	if (distance < dda.afterPrepare.accelStopDistance)
+	{
+		if (distance <= 0.0)
+		{
+			return 0.0;
+		}
+		const float startSpeed = dda.startSpeed * SecondsPerStepClock;
+#if SUPPORT_MOTION_SHAPING
+		if (isShaped)
+		{
+			return SCurvePhaseTime(dda, distance, false, estimate);
+		}
+#endif
+		const float acceleration = (topSpeed - startSpeed)/dda.afterPrepare.accelClocks;
+		return (2.0 * distance)/(startSpeed + sqrtf(fsquare(startSpeed) + 2.0 * acceleration * distance));		// this form avoids rounding error when the start speed is high
+	}
+
+	if (distance < dda.afterPrepare.decelStartDistance)
+	{
+		return dda.afterPrepare.accelClocks + (distance - dda.afterPrepare.accelStopDistance)/topSpeed;
+	}
+
+	const float decelDistance = distance - dda.afterPrepare.decelStartDistance;
+	if (decelDistance <= 0.0)
+	{
+		return dda.afterPrepare.decelStartClocks;
+	}
+	const float endSpeed = dda.endSpeed * SecondsPerStepClock;
+#if SUPPORT_MOTION_SHAPING
+	if (isShaped)
+	{
+		return dda.afterPrepare.decelStartClocks + SCurvePhaseTime(dda, decelDistance, true, estimate - dda.afterPrepare.decelStartClocks);
+	}
+#endif
+	const float deceleration = (topSpeed - endSpeed)/dda.afterPrepare.decelClocks;
+	return dda.afterPrepare.decelStartClocks
+			+ (2.0 * decelDistance)/(topSpeed + sqrtf(max<float>(fsquare(topSpeed) - 2.0 * deceleration * decelDistance, 0.0)));
+}
+
+// Calculate the time since the start of the move when the next step for an arc motor is due.
+// The motor may reverse during the move, so we search for the next step position within the current interval between reversals,
+// and move on to the next interval when there are no more steps in this one.
+// Return true if there are more steps to do.
+bool DriveMovement::CalcNextStepTimeArcFull(const DDA &dda, bool live)
+pre(stepsTillRecalc == 0)
+{
+	// Work out how many steps to calculate at a time
+	uint32_t shiftFactor = 0;		// assume single stepping
+	if (stepInterval < DDA::MinCalcIntervalCartesian)
+	{
+		if (stepInterval < DDA::MinCalcIntervalCartesian/8)
+		{
+			shiftFactor = 4;		// hexadecimal stepping
+		}
+		else if (stepInterval < DDA::MinCalcIntervalCartesian/4)
+		{
+			shiftFactor = 3;		// octal stepping
+		}
+		else if (stepInterval < DDA::MinCalcIntervalCartesian/2)
+		{
+			shiftFactor = 2;		// quad stepping
+		}
+		else
+		{
+			shiftFactor = 1;		// double stepping
+		}
+	}
+
+	for (;;)
+	{
+		const int32_t stepsToDo = 1 << shiftFactor;
+
+		// A step is due when the position passes half way between two step positions
+		const float nextCalcPosition = (direction)
+										? (float)(mp.arc.position + stepsToDo) - 0.5
+										: (float)(mp.arc.position - stepsToDo) + 0.5;
+		if ((direction) ? mp.arc.intervalEndPosition >= nextCalcPosition : mp.arc.intervalEndPosition <= nextCalcPosition)
+		{
+			float rate;
+			const float distance = ArcDistance(nextCalcPosition, rate);
+			mp.arc.distance = distance;
+			mp.arc.lastPosition = nextCalcPosition;
+			mp.arc.rate = rate;
+			mp.arc.position += (direction) ? stepsToDo : -stepsToDo;
+			stepsTillRecalc = stepsToDo - 1;
+
+			const uint32_t nextCalcStepTime = min<uint32_t>((uint32_t)PathStepTime(dda, distance, (float)nextStepTime + (float)(stepInterval << shiftFactor)), dda.clocksNeeded);
+
+			// When crossing between movement phases with high microstepping, due to rounding errors the next step may appear to be due before the last one
+			stepInterval = (nextCalcStepTime > nextStepTime)
+							? (nextCalcStepTime - nextStepTime) >> shiftFactor	// calculate the time per step, ready for next time
+							: 0;
+			if (live && stepInterval < minStepInterval && stepInterval != 0)
+			{
+				minStepInterval = stepInterval;
+			}
+#if EVEN_STEPS
+			nextStepTime = nextCalcStepTime - (stepsTillRecalc * stepInterval);
+#else
+			nextStepTime = nextCalcStepTime;
+#endif
+			return true;
+		}
+
+		if (shiftFactor != 0)
+		{
+			shiftFactor = 0;		// there aren't enough steps left in this interval to do multiple stepping, so try a single step
+		}
+		else if (mp.arc.nextReversal < mp.arc.numReversals)
+		{
+			// The motor reverses before it reaches the next step position
+			mp.arc.distance = mp.arc.intervalEnd;
+			mp.arc.lastPosition = mp.arc.intervalEndPosition;
+			mp.arc.rate = 0.0;
+			++mp.arc.nextReversal;
+			mp.arc.intervalEnd = (mp.arc.nextReversal < mp.arc.numReversals) ? mp.arc.reverseDistances[mp.arc.nextReversal] : dda.totalDistance;
+			float rate;
+			mp.arc.intervalEndPosition = ArcPosition(mp.arc.intervalEnd, rate);
+			direction = !direction;
+			if (live)
+			{
+				reprap.GetPlatform().SetDirection(drive, direction);
+			}
+		}
+		else
+		{
+			state = DMState::idle;
+			return false;
+		}
+	}
+}
+
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+
+// Get the height correction coefficients for the grid cell that the head enters at the specified distance, and convert them to motor step coefficients
+void DriveMovement::StartMeshCell(const DDA& dda, float distance)
+{
+	float a, b, c, cellLength;
+	reprap.GetMove().AccessHeightMap().GetLineCoefficients(mp.mesh.startX, mp.mesh.startY, mp.mesh.dx, mp.mesh.dy, distance, a, b, c, cellLength);
+	mp.mesh.cellStart = distance;
+	mp.mesh.cellEnd = min<float>(distance + max<float>(cellLength, MinMeshCellLength), dda.totalDistance);
+	mp.mesh.a = mp.mesh.k * distance + mp.mesh.s * (a - mp.mesh.h0);
+	mp.mesh.b = mp.mesh.k + mp.mesh.s * b;
+	mp.mesh.c = mp.mesh.s * c;
+}
+
+// Start a piece of the current cell in which the motor moves monotonically. It ends where the motor reverses or at the end of the cell.
+// Return true if the motor moves forwards in this piece.
+bool DriveMovement::StartMeshPiece(float distance)
+{
+	float pieceEnd = mp.mesh.cellEnd;
+	if (mp.mesh.c != 0.0)
+	{
+		const float reverseDistance = mp.mesh.cellStart - mp.mesh.b/(2.0 * mp.mesh.c);
+		if (reverseDistance > distance && reverseDistance < pieceEnd)
+		{
+			pieceEnd = reverseDistance;
+		}
+	}
+	mp.mesh.pieceEnd = pieceEnd;
+	mp.mesh.pieceEndPosition = MeshPosition(pieceEnd);
+
+	// The rate of change of position in the middle of the piece tells us the direction
+	return mp.mesh.b + mp.mesh.c * (distance + pieceEnd - 2.0 * mp.mesh.cellStart) >= 0.0;
+}
+
+// Return the distance along the path at which a motor that follows the height map reaches the specified position.
+// The position must lie between the positions at mp.mesh.distance and mp.mesh.pieceEnd, which the motor moves through monotonically in the current direction.
+// The position is a quadratic function of distance, so we can solve for the distance directly. We choose the form of the solution that doesn't suffer from cancellation.
+float DriveMovement::MeshDistance(float position) const
+{
+	const float pMinusA = position - mp.mesh.a;
+	const float root = sqrtf(max<float>(fsquare(mp.mesh.b) + 4.0 * mp.mesh.c * pMinusA, 0.0));
+	const float signedRoot = (direction) ? root : -root;			// the rate of change of position at the solution has the sign of the direction
+	float t;
+	if ((mp.mesh.b >= 0.0) == direction)
+	{
+		const float denom = mp.mesh.b + signedRoot;
+		t = (denom != 0.0) ? (2.0 * pMinusA)/denom : 0.0;
+	}
+	else
+	{
+		t = (mp.mesh.c != 0.0) ? (signedRoot - mp.mesh.b)/(2.0 * mp.mesh.c) : 0.0;
+	}
+	return constrain<float>(mp.mesh.cellStart + t, mp.mesh.distance, mp.mesh.pieceEnd);
+}
+
+// Calculate the time since the start of the move when the next step for a motor that follows the height map is due.
+// We search for the next step position within the current piece of the path in which the motor moves monotonically,
+// and move on to the next piece when there are no more steps in this one. The motor may reverse at the start of a piece.
+// Return true if there are more steps to do.
+bool DriveMovement::CalcNextStepTimeMeshFull(const DDA &dda, bool live)
+pre(stepsTillRecalc == 0)
+{
+	// Work out how many steps to calculate at a time
+	uint32_t shiftFactor = 0;		// assume single stepping
+	if (stepInterval < DDA::MinCalcIntervalCartesian)
+	{
+		if (stepInterval < DDA::MinCalcIntervalCartesian/8)
+		{
+			shiftFactor = 4;		// hexadecimal stepping
+		}
+		else if (stepInterval < DDA::MinCalcIntervalCartesian/4)
+		{
+			shiftFactor = 3;		// octal stepping
+		}
+		else if (stepInterval < DDA::MinCalcIntervalCartesian/2)
+		{
+			shiftFactor = 2;		// quad stepping
+		}
+		else
+		{
+			shiftFactor = 1;		// double stepping
+		}
+	}
+
+	for (;;)
+	{
+		const int32_t stepsToDo = 1 << shiftFactor;
+
+		// A step is due when the position passes half way between two step positions
+		const float nextCalcPosition = (direction)
+										? (float)(mp.mesh.position + stepsToDo) - 0.5
+										: (float)(mp.mesh.position - stepsToDo) + 0.5;
+		if ((direction) ? mp.mesh.pieceEndPosition >= nextCalcPosition : mp.mesh.pieceEndPosition <= nextCalcPosition)
+		{
+			const float distance = MeshDistance(nextCalcPosition);
+			mp.mesh.distance = distance;
+			mp.mesh.position += (direction) ? stepsToDo : -stepsToDo;
+			stepsTillRecalc = stepsToDo - 1;
+
+			const uint32_t nextCalcStepTime = min<uint32_t>((uint32_t)PathStepTime(dda, distance, (float)nextStepTime + (float)(stepInterval << shiftFactor)), dda.clocksNeeded);
+
+			// When crossing between movement phases with high microstepping, due to rounding errors the next step may appear to be due before the last one
+			stepInterval = (nextCalcStepTime > nextStepTime)
+							? (nextCalcStepTime - nextStepTime) >> shiftFactor	// calculate the time per step, ready for next time
+							: 0;
+			if (live && stepInterval < minStepInterval && stepInterval != 0)
+			{
+				minStepInterval = stepInterval;
+			}
+#if EVEN_STEPS
+			nextStepTime = nextCalcStepTime - (stepsTillRecalc * stepInterval);
+#else
+			nextStepTime = nextCalcStepTime;
+#endif
+			return true;
+		}
+
+		if (shiftFactor != 0)
+		{
+			shiftFactor = 0;		// there aren't enough steps left in this piece to do multiple stepping, so try a single step
+		}
+		else if (mp.mesh.pieceEnd < dda.totalDistance)
+		{
+			// The motor reaches the end of this piece before the next step position. Move on to the next piece, which may be in a new cell.
+			const float distance = mp.mesh.pieceEnd;
+			mp.mesh.distance = distance;
+			if (distance >= mp.mesh.cellEnd)
+			{
+				StartMeshCell(dda, distance);
+			}
+			const bool forwards = StartMeshPiece(distance);
+			if (forwards != direction)
+			{
+				direction = forwards;
+				if (live)
+				{
+					reprap.GetPlatform().SetDirection(drive, direction);
+				}
+			}
+		}
+		else
+		{
+			state = DMState::idle;
+			return false;
+		}
+	}
+}
+
+#endif
+
 // Reduce the speed of this movement. Called to reduce the homing speed when we detect we are near the endstop for a drive.
 void DriveMovement::ReduceSpeed(uint32_t inverseSpeedFactor)
 {
@@ -9,11 +9,19 @@
 #define DRIVEMOVEMENT_H_
 
 #include "RepRapFirmware.h"
+#include "Math/Isqrt.h"
+#include "AxisShaper.h"
+#include <limits>
 
 class LinearDeltaKinematics;
 
-#define EVEN_STEPS			(1)			// 1 to generate steps at even intervals when doing double/quad/octal stepping
+#if SUPPORT_NATIVE_ARCS
+constexpr size_t MaxArcReversals = 2;			// the maximum number of times that a motor can reverse during an arc of up to 360 degrees
+#endif
+
+#define EVEN_STEPS			(1)			// 1 to generate steps at even intervals when doing double/quad/octal/hexadecimal stepping
 #define ROUND_TO_NEAREST	(0)			// 1 for round to nearest (as used in 1.20beta10), 0 for round down (as used prior to 1.20beta10)
+#define INCREMENTAL_SQRT	(1)			// 1 to calculate Cartesian step times during acceleration and deceleration from the previous step time where possible
 
 // Rounding functions, to improve code clarity. Also allows a quick switch between round-to-nearest and round down in the movement code.
 inline uint32_t roundU32(float f)
@@ -119,6 +127,42 @@ struct PrepParams
 	float a2plusb2;								// sum of the squares of the X and Y movement fractions
 };
 
+// Return the integer square root of num, given an estimate of it. The result is always the same as isqrt64(num).
+// If the estimate is within a few units of the answer then this is much faster than isqrt64, because we only need a few 32x32 bit multiplications and additions.
+// We use this when calculating step times from the time of the previous step, which is a good estimate when the step rate is high.
+inline uint32_t isqrt64FromEstimate(uint64_t num, uint32_t estimate)
+{
+	constexpr unsigned int MaxAdjustments = 4;
+	uint32_t root = estimate;
+	uint64_t sq = isquare64(root);
+	if (sq > num)
+	{
+		for (unsigned int i = 0; i < MaxAdjustments; ++i)
+		{
+			--root;
+			sq -= 2 * (uint64_t)root + 1;						// this is now root^2
+			if (sq <= num)
+			{
+				return root;
+			}
+		}
+	}
+	else
+	{
+		for (unsigned int i = 0; i < MaxAdjustments; ++i)
+		{
+			const uint64_t nextSq = sq + 2 * (uint64_t)root + 1;	// this is (root + 1)^2
+			if (nextSq > num || root == 0xFFFFFFFF)
+			{
+				return root;
+			}
+			++root;
+			sq = nextSq;
+		}
+	}
+	return isqrt64(num);										// the estimate was too far out
+}
+
 enum class DMState : uint8_t
 {
 	idle = 0,
@@ -138,7 +182,15 @@ public:
 	bool CalcNextStepTimeDelta(const DDA &dda, bool live) __attribute__ ((hot));
 	bool PrepareCartesianAxis(const DDA& dda, const PrepParams& params) __attribute__ ((hot));
 	bool PrepareDeltaAxis(const DDA& dda, const PrepParams& params) __attribute__ ((hot));
-	bool PrepareExtruder(const DDA& dda, const PrepParams& params, float& extrusionPending, float speedChange, bool doCompensation) __attribute__ ((hot));
+#if SUPPORT_NATIVE_ARCS
+	bool CalcNextStepTimeArc(const DDA &dda, bool live) __attribute__ ((hot));
+	bool PrepareArcAxis(const DDA& dda) __attribute__ ((hot));
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+	bool CalcNextStepTimeMesh(const DDA &dda, bool live) __attribute__ ((hot));
+	bool PrepareMeshAxis(const DDA& dda) __attribute__ ((hot));
+#endif
+	bool PrepareExtruder(const DDA& dda, const PrepParams& params, float& extrusionPending, float& pressureAdvanceLag, float speedChange, bool doCompensation) __attribute__ ((hot));
 	void ReduceSpeed(uint32_t inverseSpeedFactor);
 	void DebugPrint() const;
 	int32_t GetNetStepsLeft() const;
@@ -155,17 +207,47 @@ public:
 	static void InitialAllocate(unsigned int num);
 	static int NumFree() { return numFree; }
 	static int MinFree() { return minFree; }
+	static unsigned int NumCreated() { return numCreated; }
 	static void ResetMinFree() { minFree = numFree; }
+	static uint32_t GetMinStepInterval() { return minStepInterval; }
+	static void ResetMinStepInterval() { minStepInterval = 0xFFFFFFFF; }
+#if SUPPORT_MOTION_SHAPING
+	static uint32_t GetNumUnshapedPhases() { return numUnshapedPhases; }
+	static void ResetNumUnshapedPhases() { numUnshapedPhases = 0; }
+#endif
 	static DriveMovement *Allocate(size_t drive, DMState st);
 	static void Release(DriveMovement *item);
 
 private:
 	bool CalcNextStepTimeCartesianFull(const DDA &dda, bool live) __attribute__ ((hot));
+#if SUPPORT_MOTION_SHAPING
+	static float ShapedJerkClocks(const DDA& dda, const AxisShaper& shaper, bool decel);
+	float ShapedPhaseTime(const DDA& dda, float distance, bool decel, float estimate) __attribute__ ((hot));
+	void StartShapedPiece(const DDA& dda, bool decel) __attribute__ ((hot));
+#endif
 	bool CalcNextStepTimeDeltaFull(const DDA &dda, bool live) __attribute__ ((hot));
+#if SUPPORT_NATIVE_ARCS
+	bool CalcNextStepTimeArcFull(const DDA &dda, bool live) __attribute__ ((hot));
+	float ArcPosition(float distance, float& rate) const __attribute__ ((hot));
+	float ArcDistance(float position, float& rate) const __attribute__ ((hot));
+	float PathStepTime(const DDA& dda, float distance, float estimate) const __attribute__ ((hot));
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+	bool CalcNextStepTimeMeshFull(const DDA &dda, bool live) __attribute__ ((hot));
+	void StartMeshCell(const DDA& dda, float distance) __attribute__ ((hot));
+	bool StartMeshPiece(float distance) __attribute__ ((hot));
+	float MeshPosition(float distance) const { const float t = distance - mp.mesh.cellStart; return mp.mesh.a + t * (mp.mesh.b + t * mp.mesh.c); }
+	float MeshDistance(float position) const __attribute__ ((hot));
+#endif
 
 	static DriveMovement *freeList;
 	static int numFree;
 	static int minFree;
+	static unsigned int numCreated;
+	static uint32_t minStepInterval;					// the shortest interval between steps of any drive that we have generated, for diagnostics
+#if SUPPORT_MOTION_SHAPING
+	static uint32_t numUnshapedPhases;					// how many acceleration and deceleration phases were too short to apply the input shaper to, for diagnostics
+#endif
 
 	// Parameters common to Cartesian, delta and extruder moves
 
@@ -173,10 +255,16 @@ private:
 
 	DMState state;										// whether this is active or not
 	uint8_t drive;										// the drive that this DM controls
-	uint8_t microstepShift : 4,							// log2 of the microstepping factor (for when we use dynamic microstepping adjustment)
+	uint16_t microstepShift : 4,						// log2 of the microstepping factor (for when we use dynamic microstepping adjustment)
 			direction : 1,								// true=forwards, false=backwards
 			fullCurrent : 1,							// true if the drivers are set to the full current, false if they are set to the standstill current
-			isDelta : 1;								// true if this DM uses segment-free delta kinematics
+			isDelta : 1,								// true if this DM uses segment-free delta kinematics
+			isShaped : 1,								// true if this DM follows the shaped acceleration and deceleration of the DDA
+			isArc : 1,									// true if this DM follows an arc move
+			isMesh : 1,									// true if this DM is a Z motor that follows the height map
+			shapeAccel : 1,								// true if the input shaper is applied to the acceleration phase
+			shapeDecel : 1,								// true if the input shaper is applied to the deceleration phase
+			shapedPhase : 2;							// the phase that the shaped piece parameters refer to: 0 = none, 1 = acceleration, 2 = deceleration
 	uint8_t stepsTillRecalc;							// how soon we need to recalculate
 
 	uint32_t totalSteps;								// total number of steps for this move
@@ -204,8 +292,25 @@ private:
 			uint32_t accelStopStep;						// the first step number at which we are no longer accelerating
 			uint32_t decelStartStep;					// the first step number at which we are decelerating
 			uint32_t mmPerStepTimesCKdivtopSpeed;		// mmPerStepInHyperCuboidSpace * clock / topSpeed
-			uint32_t compensationClocks;				// the pressure advance time in clocks
-			uint32_t accelCompensationClocks;			// compensationClocks * (1 - startSpeed/topSpeed)
+			uint32_t compensationClocks;				// the pressure advance time in clocks for the acceleration phase
+			int32_t accelCompensationClocks;			// compensationClocks * (1 - startSpeed/topSpeed), adjusted if smoothing changes the steady speed
+			uint32_t decelCompensationClocks;			// the pressure advance time in clocks for the deceleration phase
+#if SUPPORT_MOTION_SHAPING
+			float mmPerStep;							// the distance in hypercuboid space per step, used only if the acceleration is shaped
+			const AxisShaper *shaper;					// the input shaper for this motor, or nullptr if there isn't one
+			float accelPulseJerkClocks;					// the jerk time of the unshaped acceleration pulse, if the acceleration phase is shaped
+			float decelPulseJerkClocks;					// the jerk time of the unshaped deceleration pulse, if the deceleration phase is shaped
+			float accelPulsePeak;						// the peak acceleration of the unshaped acceleration pulse in mm per step clock squared
+			float decelPulsePeak;						// the peak acceleration of the unshaped deceleration pulse, which is negative
+
+			// The shaped acceleration is piecewise linear, so we step through it one piece at a time. These change as the move is executed.
+			float pieceStart;							// the time into the phase at which the current piece starts
+			float pieceEnd;								// the time into the phase at which the current piece ends
+			float pieceDistance;						// the distance into the phase at the start of the piece
+			float pieceSpeed;							// the speed at the start of the piece
+			float pieceAcceleration;					// the acceleration at the start of the piece
+			float pieceJerk;							// the rate of change of acceleration during the piece
+#endif
 		} cart;
 
 		struct DeltaParameters							// Parameters for delta movement
@@ -221,9 +326,66 @@ private:
 			uint32_t accelStopDsK;
 			uint32_t decelStartDsK;
 			uint32_t mmPerStepTimesCKdivtopSpeed;
+
+			// The following change as the move is executed
+			int32_t lastRoot;							// the square root in the distance calculation for the previous step, used to estimate the next one
+			int32_t rootChangePerStep;					// how much that square root changed per step last time
 		} delta;
+
+#if SUPPORT_NATIVE_ARCS
+		struct ArcParameters							// Parameters for motors that follow an arc
+		{
+			// The motor position in steps relative to the start is a.(cos(angle) - 1) + b.sin(angle) + k.distance, where the angle turned is proportional to the distance moved
+			float a, b, k;
+			float anglePerMm;							// the change in angle per mm moved along the path
+			float tolerance;							// how close to the step position we need to get, allowing for rounding error
+			float reverseDistances[MaxArcReversals];	// the distances along the path at which the motor reverses direction
+
+			// The following change as the move is executed
+			float distance;								// the distance along the path at which we reached the last calculated step position
+			float lastPosition;							// the motor position at that distance, which is half way between two step positions unless the motor reversed there
+			float rate;									// the rate of change of position in steps per mm at that distance
+			float intervalEnd;							// the distance at which the motor next reverses, or the total distance if it doesn't
+			float intervalEndPosition;					// the motor position at that distance
+			int32_t position;							// the last calculated step position relative to the start
+			int32_t finalPosition;						// the step position at the end of the move relative to the start
+			uint8_t numReversals;						// how many entries in reverseDistances are valid
+			uint8_t nextReversal;						// the index of the next reversal
+		} arc;
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+		struct MeshParameters							// Parameters for a Z motor that follows the height map during a straight move
+		{
+			// The motor position in steps relative to the start is k.distance + s.(h(distance) - h0), where h is the height correction at the head position
+			float startX, startY;						// the head position at the start of the move, in height map coordinates
+			float dx, dy;								// the change in head X and Y per mm moved along the path
+			float k;									// the linear term, which takes care of any Z movement requested and of rounding the end point
+			float s;									// motor steps per mm of height correction
+			float h0;									// the height correction at the start
+
+			// The following change as the move is executed. Within the current grid cell the position is a + b.t + c.t^2 where t = distance - cellStart.
+			float a, b, c;
+			float cellStart;							// the distance at which the head entered the current cell
+			float cellEnd;								// the distance at which it leaves the cell, or the total distance if that is less
+			float pieceEnd;								// the distance at which the motor next reverses or the head leaves the cell, whichever comes first
+			float pieceEndPosition;						// the motor position at that distance
+			float distance;								// the distance along the path at which we reached the last calculated step position
+			int32_t position;							// the last calculated step position relative to the start
+			int32_t finalPosition;						// the step position at the end of the move relative to the start
+		} mesh;
+#endif
 	} mp;
 
+#if SUPPORT_NATIVE_ARCS
+	static constexpr unsigned int MaxArcIterations = 8;		// the maximum number of iterations when finding the distance at which an arc motor reaches a step position
+	static constexpr float ArcPositionTolerance = 0.01;		// how close to the step position we need to get, in steps, if rounding error allows
+	static constexpr float ArcRelativeTolerance = 4.0 * std::numeric_limits<float>::epsilon();	// the float rounding error relative to the size of the terms in the position
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+	static constexpr float MinMeshCellLength = 0.001;		// the minimum distance we treat as being in one grid cell, so that rounding error at the grid lines can't stall us
+#endif
+
 	static constexpr uint32_t NoStepTime = 0xFFFFFFFF;	// value to indicate that no further steps are needed when calculating the next step time
 	static constexpr uint32_t K1 = 1024;				// a power of 2 used to multiply the value mmPerStepTimesCdivtopSpeed to reduce rounding errors
 	static constexpr uint32_t K2 = 512;					// a power of 2 used in delta calculations to reduce rounding errors (but too large makes things worse)
@@ -241,7 +403,7 @@ inline bool DriveMovement::CalcNextStepTimeCartesian(const DDA &dda, bool live)
 	{
 		if (stepsTillRecalc != 0)
 		{
-			--stepsTillRecalc;			// we are doing double/quad/octal stepping
+			--stepsTillRecalc;			// we are doing double/quad/octal/hexadecimal stepping
 #if EVEN_STEPS
 			nextStepTime += stepInterval;
 #endif
@@ -280,10 +442,63 @@ inline bool DriveMovement::CalcNextStepTimeDelta(const DDA &dda, bool live)
 	return false;
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Calculate the time since the start of the move when the next step for the specified DriveMovement is due.
+// Return true if there are more steps to do. The number of steps isn't known in advance because of rounding, so CalcNextStepTimeArcFull decides when we have finished.
+// We inline this part to speed things up when we are doing double/quad/octal stepping.
+inline bool DriveMovement::CalcNextStepTimeArc(const DDA &dda, bool live)
+{
+	++nextStep;
+	if (stepsTillRecalc != 0)
+	{
+		--stepsTillRecalc;			// we are doing double/quad/octal/hexadecimal stepping
+# if EVEN_STEPS
+		nextStepTime += stepInterval;
+# endif
+		return true;
+	}
+	return CalcNextStepTimeArcFull(dda, live);
+}
+
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+
+// Calculate the time since the start of the move when the next step for the specified DriveMovement is due.
+// Return true if there are more steps to do. Like arc motors, a motor that follows the height map may reverse, so CalcNextStepTimeMeshFull decides when we have finished.
+inline bool DriveMovement::CalcNextStepTimeMesh(const DDA &dda, bool live)
+{
+	++nextStep;
+	if (stepsTillRecalc != 0)
+	{
+		--stepsTillRecalc;			// we are doing double/quad/octal/hexadecimal stepping
+# if EVEN_STEPS
+		nextStepTime += stepInterval;
+# endif
+		return true;
+	}
+	return CalcNextStepTimeMeshFull(dda, live);
+}
+
+#endif
+
 // Return the number of net steps left for the move in the forwards direction.
 // We have already taken nextSteps - 1 steps, unless nextStep is zero.
 inline int32_t DriveMovement::GetNetStepsLeft() const
 {
+#if SUPPORT_NATIVE_ARCS
+	if (isArc)
+	{
+		return mp.arc.finalPosition - GetNetStepsTaken();
+	}
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+	if (isMesh)
+	{
+		return mp.mesh.finalPosition - GetNetStepsTaken();
+	}
+#endif
 	int32_t netStepsLeft;
 	if (reverseStartStep > totalSteps)		// if no reverse phase
 	{
@@ -305,6 +520,21 @@ inline int32_t DriveMovement::GetNetStepsLeft() const
 // We have already taken nextSteps - 1 steps, unless nextStep is zero.
 inline int32_t DriveMovement::GetNetStepsTaken() const
 {
+#if SUPPORT_NATIVE_ARCS
+	if (isArc)
+	{
+		// The step position is calculated for the last of the steps that we are generating at even intervals
+		const int32_t stepsPending = (state == DMState::moving) ? (int32_t)stepsTillRecalc + 1 : 0;
+		return (direction) ? mp.arc.position - stepsPending : mp.arc.position + stepsPending;
+	}
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+	if (isMesh)
+	{
+		const int32_t stepsPending = (state == DMState::moving) ? (int32_t)stepsTillRecalc + 1 : 0;
+		return (direction) ? mp.mesh.position - stepsPending : mp.mesh.position + stepsPending;
+	}
+#endif
 	int32_t netStepsTaken;
 	if (nextStep < reverseStartStep || reverseStartStep > totalSteps)				// if no reverse phase, or not started it yet
 	{
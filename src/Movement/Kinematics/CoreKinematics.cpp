@@ -215,11 +215,13 @@ const char* CoreKinematics::GetName(bool forStatusReport) const
 bool CoreKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error)
 {
 	bool seen;
+	bool seenNonGeometry = false;
 	switch (mCode)
 	{
 	case 669:
 		{
 			seen = gb.Seen('K');
+			TryGetSegmentDeviation(gb, seenNonGeometry);				// this is used when segmenting arcs
 			const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
 			for (size_t axis = 0; axis < numVisibleAxes; ++axis)
 			{
@@ -258,9 +260,9 @@ bool CoreKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const String
 	{
 		Recalc();
 	}
-	else
+	else if (!seenNonGeometry)
 	{
-		reply.printf("Kinematics is %s%s, matrix:", ((modified) ? "modified " : ""), GetName(false));
+		reply.printf("Kinematics is %s%s, max. segment deviation %.3f, matrix:", ((modified) ? "modified " : ""), GetName(false), (double)segmentDeviation);
 		const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
 		const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
 		for (size_t axis = 0; axis < numVisibleAxes; ++axis)
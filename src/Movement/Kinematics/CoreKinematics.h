@@ -27,6 +27,8 @@ public:
 	void LimitSpeedAndAcceleration(DDA& dda, const float *normalisedDirectionVector, size_t numVisibleAxes, bool continuousRotationShortcut) const override;
 	AxesBitmap GetConnectedAxes(size_t axis) const override;
 	AxesBitmap GetLinearAxes() const override;
+	bool HasLinearMotorMapping() const override { return true; }
+	float GetMotorCoefficient(size_t axis, size_t motor) const override { return inverseMatrix(axis, motor); }
 
 private:
 	void Recalc();											// recalculate internal variables following a configuration change
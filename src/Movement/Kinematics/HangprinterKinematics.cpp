@@ -90,6 +90,7 @@ bool HangprinterKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 		bool seenNonGeometry = false;
 		gb.TryGetFValue('S', segmentsPerSecond, seenNonGeometry);
 		gb.TryGetFValue('T', minSegmentLength, seenNonGeometry);
+		TryGetSegmentDeviation(gb, seenNonGeometry);
 		if (gb.TryGetFloatArray('A', 3, anchorA, reply, seen))
 		{
 			error = true;
@@ -119,12 +120,12 @@ bool HangprinterKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 		else if (!gb.Seen('K'))
 		{
 			reply.printf("Kinematics is Hangprinter with ABC anchor coordinates (%.2f,%.2f,%.2f) (%.2f,%.2f,%.2f) (%.2f,%.2f,%.2f),"
-							"D anchor Z coordinate %.2f, print radius %.1f, segments/sec %d, min. segment length %.2f",
+							"D anchor Z coordinate %.2f, print radius %.1f, segments/sec %d, min. segment length %.2f, max. segment deviation %.3f",
 							(double)anchorA[X_AXIS], (double)anchorA[Y_AXIS], (double)anchorA[Z_AXIS],
 							(double)anchorB[X_AXIS], (double)anchorB[Y_AXIS], (double)anchorB[Z_AXIS],
 							(double)anchorC[X_AXIS], (double)anchorC[Y_AXIS], (double)anchorC[Z_AXIS],
 							(double)anchorDz, (double)printRadius,
-							(int)segmentsPerSecond, (double)minSegmentLength);
+							(int)segmentsPerSecond, (double)minSegmentLength, (double)segmentDeviation);
 		}
 		return seen;
 	}
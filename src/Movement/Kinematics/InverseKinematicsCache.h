@@ -0,0 +1,85 @@
+/*
+ * InverseKinematicsCache.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: David
+ */
+
+#ifndef SRC_MOVEMENT_KINEMATICS_INVERSEKINEMATICSCACHE_H_
+#define SRC_MOVEMENT_KINEMATICS_INVERSEKINEMATICSCACHE_H_
+
+#include "RepRapFirmware.h"
+
+#include <limits>
+
+// Cache of recent inverse kinematics results, for kinematics that need trigonometric functions or square roots to convert Cartesian coordinates to motor positions.
+// The end point of a segmented move is converted when the move is checked against the limits, when we decide how many segments to use and when the last segment is queued,
+// and the start point of each move is the end point of the previous one. So most of the positions we are asked to convert are ones that we converted recently.
+// The outputs are stored before they are converted to steps, so the cache doesn't need to be invalidated when the steps/mm change. It must be invalidated when the geometry changes.
+template<size_t NumInputs, size_t NumOutputs, size_t NumEntries = 4> class InverseKinematicsCache
+{
+public:
+	InverseKinematicsCache() { Invalidate(); }
+
+	void Invalidate();
+	bool Find(const float inputs[NumInputs], float outputs[NumOutputs]) const;
+	void Store(const float inputs[NumInputs], const float outputs[NumOutputs]);
+
+private:
+	struct Entry
+	{
+		float inputs[NumInputs];
+		float outputs[NumOutputs];
+	};
+
+	Entry entries[NumEntries];
+	size_t nextEntry;									// the entry we will overwrite next
+};
+
+// Make sure that no coordinates match any of the entries
+template<size_t NumInputs, size_t NumOutputs, size_t NumEntries> void InverseKinematicsCache<NumInputs, NumOutputs, NumEntries>::Invalidate()
+{
+	for (Entry& e : entries)
+	{
+		e.inputs[0] = std::numeric_limits<float>::quiet_NaN();
+	}
+	nextEntry = 0;
+}
+
+// Look for the coordinates in the cache. If we find them, copy the corresponding outputs and return true.
+// We start with the most recent entry, because that is the one most likely to match.
+template<size_t NumInputs, size_t NumOutputs, size_t NumEntries> bool InverseKinematicsCache<NumInputs, NumOutputs, NumEntries>::Find(const float inputs[NumInputs], float outputs[NumOutputs]) const
+{
+	size_t index = nextEntry;
+	for (size_t i = 0; i < NumEntries; ++i)
+	{
+		index = (index == 0) ? NumEntries - 1 : index - 1;
+		const Entry& e = entries[index];
+		bool match = true;
+		for (size_t j = 0; j < NumInputs; ++j)
+		{
+			if (e.inputs[j] != inputs[j])
+			{
+				match = false;
+				break;
+			}
+		}
+		if (match)
+		{
+			memcpy(outputs, e.outputs, sizeof(e.outputs));
+			return true;
+		}
+	}
+	return false;
+}
+
+// Add a result to the cache, replacing the oldest entry
+template<size_t NumInputs, size_t NumOutputs, size_t NumEntries> void InverseKinematicsCache<NumInputs, NumOutputs, NumEntries>::Store(const float inputs[NumInputs], const float outputs[NumOutputs])
+{
+	Entry& e = entries[nextEntry];
+	memcpy(e.inputs, inputs, sizeof(e.inputs));
+	memcpy(e.outputs, outputs, sizeof(e.outputs));
+	nextEntry = (nextEntry + 1 == NumEntries) ? 0 : nextEntry + 1;
+}
+
+#endif /* SRC_MOVEMENT_KINEMATICS_INVERSEKINEMATICSCACHE_H_ */
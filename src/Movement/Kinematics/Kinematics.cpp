@@ -24,10 +24,70 @@ const char * const Kinematics::HomeXYFileName = "homexy.g";
 
 // Constructor. Pass segsPerSecond <= 0.0 to get non-segmented kinematics.
 Kinematics::Kinematics(KinematicsType t, float segsPerSecond, float minSegLength, bool doUseRawG0)
-	: segmentsPerSecond(segsPerSecond), minSegmentLength(minSegLength), useSegmentation(segsPerSecond > 0.0), useRawG0(doUseRawG0), type(t)
+	: segmentsPerSecond(segsPerSecond), minSegmentLength(minSegLength), segmentDeviation(DefaultSegmentDeviation),
+	  useSegmentation(segsPerSecond > 0.0), useRawG0(doUseRawG0), type(t)
 {
 }
 
+// Return how many segments a straight line move needs so that the path of the print head deviates from the line by no more than the segment deviation.
+// Within each segment the motors move linearly, so the print head follows a curve between the segment end points. We measure how far the midpoint of that curve strays
+// from the line when the whole move is done as a single segment. The deviation of a smooth curve from its chord is proportional to the square of the chord length,
+// so this tells us how many segments we need. Returns zero if the number can't be estimated.
+// Kinematics that cache inverse kinematics results will usually already have the start and end positions cached, so this costs one forward transform.
+unsigned int Kinematics::GetSegmentsForDeviation(const float startCoords[], const float endCoords[], size_t numVisibleAxes, size_t numTotalAxes) const
+{
+	const float * const stepsPerMm = reprap.GetPlatform().GetDriveStepsPerUnit();
+	int32_t startMotorPos[MaxAxes], endMotorPos[MaxAxes];
+	for (size_t axis = 0; axis < numTotalAxes; ++axis)
+	{
+		startMotorPos[axis] = endMotorPos[axis] = 0;					// in case CartesianToMotorSteps leaves any motors unchanged
+	}
+	if (   !CartesianToMotorSteps(startCoords, stepsPerMm, numVisibleAxes, numTotalAxes, startMotorPos, true)
+		|| !CartesianToMotorSteps(endCoords, stepsPerMm, numVisibleAxes, numTotalAxes, endMotorPos, true)
+	   )
+	{
+		return 0;
+	}
+
+	float lineVector[XYZ_AXES];
+	float lineLengthSquared = 0.0;
+	for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+	{
+		lineVector[axis] = endCoords[axis] - startCoords[axis];
+		lineLengthSquared += fsquare(lineVector[axis]);
+	}
+	if (lineLengthSquared == 0.0)
+	{
+		return 1;
+	}
+
+	// Find where the print head is when the motors are half way between their start and end positions
+	int32_t motorPos[MaxAxes];
+	for (size_t axis = 0; axis < numTotalAxes; ++axis)
+	{
+		motorPos[axis] = (startMotorPos[axis] + endMotorPos[axis])/2;
+	}
+	float machinePos[MaxAxes];
+	MotorStepsToCartesian(motorPos, stepsPerMm, numVisibleAxes, numTotalAxes, machinePos);
+
+	// Find the distance of that point from the line
+	float offset[XYZ_AXES];
+	float dotProduct = 0.0;
+	for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+	{
+		offset[axis] = machinePos[axis] - startCoords[axis];
+		dotProduct += offset[axis] * lineVector[axis];
+	}
+	const float projection = dotProduct/lineLengthSquared;
+	float deviationSquared = 0.0;
+	for (size_t axis = 0; axis < XYZ_AXES; ++axis)
+	{
+		deviationSquared += fsquare(offset[axis] - projection * lineVector[axis]);
+	}
+
+	return max<unsigned int>(1, (unsigned int)ceilf(sqrtf(sqrtf(deviationSquared)/segmentDeviation)));
+}
+
 // Set or report the parameters from a M665, M666 or M669 command
 // This is the fallback function for when the derived class doesn't use the specified M-code
 bool Kinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef& reply, bool& error)
@@ -47,6 +107,16 @@ bool Kinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const StringRef&
 	return false;
 }
 
+// Set the segment deviation from the E parameter of a M669 command if it is present
+void Kinematics::TryGetSegmentDeviation(GCodeBuffer& gb, bool& seen)
+{
+	if (gb.Seen('E'))
+	{
+		segmentDeviation = max<float>(gb.GetFValue(), MinSegmentDeviation);
+		seen = true;
+	}
+}
+
 // Return true if the specified XY position is reachable by the print head reference point.
 // This default implementation assumes a rectangular reachable area, so it just uses the bed dimensions give in the M208 command.
 bool Kinematics::IsReachable(float x, float y, bool isCoordinated) const
@@ -187,6 +187,13 @@ public:
 	// This is called to determine whether we can babystep the specified axis independently of regular motion.
 	virtual AxesBitmap GetLinearAxes() const = 0;
 
+	// Return true if every motor position is a fixed linear combination of the axis coordinates, as on Cartesian and Core machines.
+	// Arc moves can only be executed without splitting them into straight line segments if this is true.
+	virtual bool HasLinearMotorMapping() const { return false; }
+
+	// Return how far the specified motor moves per unit movement of the specified axis. Only called if HasLinearMotorMapping returns true.
+	virtual float GetMotorCoefficient(size_t axis, size_t motor) const { return (axis == motor) ? 1.0 : 0.0; }
+
 	// Override this virtual destructor if your constructor allocates any dynamic memory
 	virtual ~Kinematics() { }
 
@@ -201,11 +208,19 @@ public:
 	bool UseRawG0() const { return useRawG0; }
 	float GetSegmentsPerSecond() const pre(UseSegmentation()) { return segmentsPerSecond; }
 	float GetMinSegmentLength() const pre(UseSegmentation()) { return minSegmentLength; }
+	float GetSegmentDeviation() const { return segmentDeviation; }
+
+	// Return how many segments a straight line move needs so that the path of the print head deviates from the line by no more than the segment deviation.
+	// Returns zero if the number can't be estimated, e.g. because the move isn't reachable.
+	unsigned int GetSegmentsForDeviation(const float startCoords[], const float endCoords[], size_t numVisibleAxes, size_t numTotalAxes) const;
 
 protected:
 	// Constructor. Pass segsPerSecond <= 0.0 to get non-segmented motion.
 	Kinematics(KinematicsType t, float segsPerSecond, float minSegLength, bool doUseRawG0);
 
+	// Set the segment deviation from the E parameter of a M669 command if it is present
+	void TryGetSegmentDeviation(GCodeBuffer& gb, bool& seen);
+
 	// Apply the M208 limits to the Cartesian position that the user wants to move to for all axes from the specified one upwards
 	// Return true if any coordinates were changed
 	bool LimitPositionFromAxis(float coords[], size_t firstAxis, size_t numVisibleAxes, AxesBitmap axesHomed) const;
@@ -218,6 +233,9 @@ protected:
 
 	float segmentsPerSecond;				// if we are using segmentation, the target number of segments/second
 	float minSegmentLength;					// if we are using segmentation, the minimum segment size
+	float segmentDeviation;					// the maximum deviation from the ideal path that we allow when segmenting moves
+
+	static constexpr float MinSegmentDeviation = 0.001;	// the smallest segment deviation we allow
 
 	static const char * const HomeAllFileName;
 	static const char * const HomeXYFileName;
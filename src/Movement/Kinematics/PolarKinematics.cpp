@@ -45,6 +45,7 @@ bool PolarKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 		bool seenNonGeometry = false;
 		gb.TryGetFValue('S', segmentsPerSecond, seenNonGeometry);
 		gb.TryGetFValue('T', minSegmentLength, seenNonGeometry);
+		TryGetSegmentDeviation(gb, seenNonGeometry);
 
 		bool seen = false;
 		if (gb.Seen('R'))
@@ -76,9 +77,9 @@ bool PolarKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 		}
 		else if (!gb.Seen('K'))
 		{
-			reply.printf("Kinematics is Polar with radius %.1f to %.1fmm, homed radius %.1fmm, segments/sec %d, min. segment length %.2f",
+			reply.printf("Kinematics is Polar with radius %.1f to %.1fmm, homed radius %.1fmm, segments/sec %d, min. segment length %.2f, max. segment deviation %.3f",
 							(double)minRadius, (double)maxRadius, (double)homedRadius,
-							(int)segmentsPerSecond, (double)minSegmentLength);
+							(int)segmentsPerSecond, (double)minSegmentLength, (double)segmentDeviation);
 		}
 		return seen;
 	}
@@ -96,8 +97,15 @@ bool PolarKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 // Return true if successful, false if we were unable to convert
 bool PolarKinematics::CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const
 {
-	motorPos[0] = lrintf(sqrtf(fsquare(machinePos[0]) + fsquare(machinePos[1])) * stepsPerMm[0]);
-	motorPos[1] = (motorPos[0] == 0.0) ? 0 : lrintf(atan2f(machinePos[1], machinePos[0]) * RadiansToDegrees * stepsPerMm[1]);
+	float radiusAndAngle[2];
+	if (!ikCache.Find(machinePos, radiusAndAngle))
+	{
+		radiusAndAngle[0] = sqrtf(fsquare(machinePos[0]) + fsquare(machinePos[1]));
+		radiusAndAngle[1] = atan2f(machinePos[1], machinePos[0]) * RadiansToDegrees;
+		ikCache.Store(machinePos, radiusAndAngle);
+	}
+	motorPos[0] = lrintf(radiusAndAngle[0] * stepsPerMm[0]);
+	motorPos[1] = (motorPos[0] == 0.0) ? 0 : lrintf(radiusAndAngle[1] * stepsPerMm[1]);
 
 	// Transform remaining axes linearly
 	for (size_t axis = Z_AXIS; axis < numVisibleAxes; ++axis)
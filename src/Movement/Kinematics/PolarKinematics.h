@@ -9,6 +9,7 @@
 #define SRC_MOVEMENT_KINEMATICS_POLARKINEMATICS_H_
 
 #include "Kinematics.h"
+#include "InverseKinematicsCache.h"
 
 class PolarKinematics : public Kinematics
 {
@@ -49,6 +50,8 @@ private:
 	float maxTurntableSpeed, maxTurntableAcceleration;
 
 	float minRadiusSquared, maxRadiusSquared;
+
+	mutable InverseKinematicsCache<2, 2> ikCache;						// maps X and Y to radius and turntable angle
 };
 
 #endif /* SRC_MOVEMENT_KINEMATICS_POLARKINEMATICS_H_ */
@@ -42,6 +42,7 @@ void RotaryDeltaKinematics::Init()
 // Compute the derived parameters from the primary parameters
 void RotaryDeltaKinematics::Recalc()
 {
+	ikCache.Invalidate();
 	printRadiusSquared = fsquare(printRadius);
 	for (size_t axis = 0; axis < DELTA_AXES; ++axis)
 	{
@@ -76,6 +77,9 @@ bool RotaryDeltaKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 	case 669:
 		{
 			bool seen = false;
+			bool seenNonGeometry = false;
+			TryGetSegmentDeviation(gb, seenNonGeometry);
+
 			size_t numValues = 3;
 			if (gb.TryGetFloatArray('U', numValues, armLengths, reply, seen, true))
 			{
@@ -125,20 +129,22 @@ bool RotaryDeltaKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 			{
 				Recalc();
 			}
-			else
+			else if (!seenNonGeometry)
 			{
 				reply.printf("Kinematics is rotary delta, arms (%.3f,%.2f,%.3f)mm, rods (%.3f,%.3f,%.3f)mm, bearingHeights (%.3f,%.2f,%.3f)mm"
 							 ", arm movement %.1f to %.1f" DEGREE_SYMBOL
 							 ", delta radius %.3f, bed radius %.1f"
-							 ", angle corrections (%.3f,%.3f,%.3f)" DEGREE_SYMBOL ,
+							 ", angle corrections (%.3f,%.3f,%.3f)" DEGREE_SYMBOL
+							 ", max. segment deviation %.3f",
 							 (double)armLengths[DELTA_A_AXIS], (double)armLengths[DELTA_B_AXIS], (double)armLengths[DELTA_C_AXIS],
 							 (double)rodLengths[DELTA_A_AXIS], (double)rodLengths[DELTA_B_AXIS], (double)rodLengths[DELTA_C_AXIS],
 							 (double)bearingHeights[DELTA_A_AXIS], (double)bearingHeights[DELTA_B_AXIS], (double)bearingHeights[DELTA_C_AXIS],
 							 (double)minArmAngle, (double)maxArmAngle,
 							 (double)radius, (double)printRadius,
-							 (double)angleCorrections[DELTA_A_AXIS], (double)angleCorrections[DELTA_B_AXIS], (double)angleCorrections[DELTA_C_AXIS]);
+							 (double)angleCorrections[DELTA_A_AXIS], (double)angleCorrections[DELTA_B_AXIS], (double)angleCorrections[DELTA_C_AXIS],
+							 (double)segmentDeviation);
 			}
-			return seen;
+			return seen || seenNonGeometry;
 		}
 
 	case 666:
@@ -170,18 +176,35 @@ bool RotaryDeltaKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const
 bool RotaryDeltaKinematics::CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const
 {
 	bool ok = true;
-	for (size_t axis = 0; axis < min<size_t>(numVisibleAxes, DELTA_AXES); ++axis)
+	float angles[DELTA_AXES];
+	if (!ikCache.Find(machinePos, angles))
 	{
-		const float pos = Transform(machinePos, axis);
-		if (isnan(pos) || isinf(pos))
+		for (size_t axis = 0; axis < DELTA_AXES; ++axis)
 		{
-			ok = false;
+			angles[axis] = Transform(machinePos, axis);
+			if (isnan(angles[axis]) || isinf(angles[axis]))
+			{
+				ok = false;
+			}
 		}
-		else
+		if (ok)
+		{
+			ikCache.Store(machinePos, angles);
+		}
+	}
+
+	// Whether the angles came from the cache or were just calculated, convert them to motor steps, then transform any additional axes linearly
+	for (size_t axis = 0; axis < DELTA_AXES; ++axis)
+	{
+		if (!isnan(angles[axis]) && !isinf(angles[axis]))
 		{
-			motorPos[axis] = lrintf(pos * stepsPerMm[axis]);
+			motorPos[axis] = lrintf(angles[axis] * stepsPerMm[axis]);
 		}
 	}
+	for (size_t axis = DELTA_AXES; axis < numVisibleAxes; ++axis)
+	{
+		motorPos[axis] = lrintf(machinePos[axis] * stepsPerMm[axis]);
+	}
 
 	// TEMP DEBUG
 	if (reprap.Debug(moduleMove))
@@ -192,11 +215,6 @@ bool RotaryDeltaKinematics::CartesianToMotorSteps(const float machinePos[], cons
 			(ok) ? "ok" : "fail");
 	}
 
-	// Transform any additional axes linearly
-	for (size_t axis = DELTA_AXES; axis < numVisibleAxes; ++axis)
-	{
-		motorPos[axis] = lrintf(machinePos[axis] * stepsPerMm[axis]);
-	}
 	return ok;
 }
 
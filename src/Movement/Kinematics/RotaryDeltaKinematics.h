@@ -9,6 +9,7 @@
 #define SRC_MOVEMENT_KINEMATICS_ROTARYDELTAKINEMATICS_H_
 
 #include "Kinematics.h"
+#include "InverseKinematicsCache.h"
 
 class RotaryDeltaKinematics : public Kinematics
 {
@@ -84,6 +85,8 @@ private:
 	float rodSquared[DELTA_AXES];
 	float rodSquaredMinusArmSquared[DELTA_AXES];
 	float printRadiusSquared;
+
+	mutable InverseKinematicsCache<XYZ_AXES, DELTA_AXES> ikCache;		// maps X, Y and Z to the arm angles
 };
 
 #endif /* SRC_MOVEMENT_KINEMATICS_ROTARYDELTAKINEMATICS_H_ */
@@ -99,24 +99,29 @@ bool ScaraKinematics::CalculateThetaAndPsi(const float machinePos[], bool isCoor
 	}
 
 	// Save the original and transformed coordinates so that we don't need to calculate them again if we are commanded to move to this position
-	cachedX = machinePos[0];
-	cachedY = machinePos[1];
-	cachedTheta = theta;
-	cachedPsi = psi;
-	cachedArmMode = armMode;
+	CacheThetaAndPsi(machinePos[X_AXIS], machinePos[Y_AXIS], theta, psi, armMode);
 	return true;
 }
 
+// Save the arm angles and mode for a position in the cache
+void ScaraKinematics::CacheThetaAndPsi(float x, float y, float theta, float psi, bool armMode) const
+{
+	const float inputs[2] = { x, y };
+	const float outputs[3] = { theta, psi, (armMode) ? 1.0 : 0.0 };
+	ikCache.Store(inputs, outputs);
+}
+
 // Convert Cartesian coordinates to motor coordinates, returning true if successful
 // In the following, theta is the proximal arm angle relative to the X axis, psi is the distal arm angle relative to the proximal arm
 bool ScaraKinematics::CartesianToMotorSteps(const float machinePos[], const float stepsPerMm[], size_t numVisibleAxes, size_t numTotalAxes, int32_t motorPos[], bool isCoordinated) const
 {
 	float theta, psi;
-	if (machinePos[0] == cachedX && machinePos[1] == cachedY)
+	float cached[3];
+	if (ikCache.Find(machinePos, cached))
 	{
-		theta = cachedTheta;
-		psi = cachedPsi;
-		currentArmMode = cachedArmMode;
+		theta = cached[0];
+		psi = cached[1];
+		currentArmMode = (cached[2] != 0.0);
 	}
 	else
 	{
@@ -150,11 +155,10 @@ void ScaraKinematics::MotorStepsToCartesian(const int32_t motorPos[], const floa
     const float psi = ((float)motorPos[Y_AXIS]/stepsPerMm[Y_AXIS]) + (crosstalk[0] * theta);
 
     // Cache the current values so that a Z probe at this position won't fail due to rounding error when transforming the XY coordinates back
-    currentArmMode = cachedArmMode = (motorPos[Y_AXIS] >= 0);
-    cachedTheta = theta;
-    cachedPsi = psi;
-    cachedX = machinePos[X_AXIS] = (cosf(theta * DegreesToRadians) * proximalArmLength + cosf((psi + theta) * DegreesToRadians) * distalArmLength) - xOffset;
-    cachedY = machinePos[Y_AXIS] = (sinf(theta * DegreesToRadians) * proximalArmLength + sinf((psi + theta) * DegreesToRadians) * distalArmLength) - yOffset;
+    currentArmMode = (motorPos[Y_AXIS] >= 0);
+    machinePos[X_AXIS] = (cosf(theta * DegreesToRadians) * proximalArmLength + cosf((psi + theta) * DegreesToRadians) * distalArmLength) - xOffset;
+    machinePos[Y_AXIS] = (sinf(theta * DegreesToRadians) * proximalArmLength + sinf((psi + theta) * DegreesToRadians) * distalArmLength) - yOffset;
+    CacheThetaAndPsi(machinePos[X_AXIS], machinePos[Y_AXIS], theta, psi, currentArmMode);
 
     // On some machines (e.g. Helios), the X and/or Y arm motors also affect the Z height
     machinePos[Z_AXIS] = ((float)motorPos[Z_AXIS]/stepsPerMm[Z_AXIS]) + (crosstalk[1] * theta) + (crosstalk[2] * psi);
@@ -178,6 +182,7 @@ bool ScaraKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 		gb.TryGetFValue('D', distalArmLength, seen);
 		gb.TryGetFValue('S', segmentsPerSecond, seenNonGeometry);
 		gb.TryGetFValue('T', minSegmentLength, seenNonGeometry);
+		TryGetSegmentDeviation(gb, seenNonGeometry);
 		gb.TryGetFValue('X', xOffset, seen);
 		gb.TryGetFValue('Y', yOffset, seen);
 		if (gb.TryGetFloatArray('A', 2, thetaLimits, reply, seen))
@@ -204,12 +209,12 @@ bool ScaraKinematics::Configure(unsigned int mCode, GCodeBuffer& gb, const Strin
 		else if (!gb.Seen('K'))
 		{
 			reply.printf("Kinematics is Scara with proximal arm %.2fmm range %.1f to %.1f" DEGREE_SYMBOL
-							"%s, distal arm %.2fmm range %.1f to %.1f" DEGREE_SYMBOL "%s, crosstalk %.1f:%.1f:%.1f, bed origin (%.1f, %.1f), segments/sec %d, min. segment length %.2f",
+							"%s, distal arm %.2fmm range %.1f to %.1f" DEGREE_SYMBOL "%s, crosstalk %.1f:%.1f:%.1f, bed origin (%.1f, %.1f), segments/sec %d, min. segment length %.2f, max. segment deviation %.3f",
 							(double)proximalArmLength, (double)thetaLimits[0], (double)thetaLimits[1], (supportsContinuousRotation[0]) ? " (continuous)" : "",
 							(double)distalArmLength, (double)psiLimits[0], (double)psiLimits[1], (supportsContinuousRotation[0]) ? " (continuous)" : "",
 							(double)crosstalk[0], (double)crosstalk[1], (double)crosstalk[2],
 							(double)xOffset, (double)yOffset,
-							(int)segmentsPerSecond, (double)minSegmentLength);
+							(int)segmentsPerSecond, (double)minSegmentLength, (double)segmentDeviation);
 		}
 		return seen;
 	}
@@ -277,11 +282,11 @@ LimitPositionResult ScaraKinematics::LimitPosition(float finalCoords[], const fl
 		if (!CalculateThetaAndPsi(finalCoords, true, theta, psi, armMode) && !std::isnan(theta))
 		{
 			// Radius is in range but at least one arm angle isn't
-			cachedTheta = theta = constrain<float>(theta, thetaLimits[0], thetaLimits[1]);
-			cachedPsi = psi = constrain<float>(psi, psiLimits[0], psiLimits[1]);
-			cachedX = finalCoords[X_AXIS] = (cosf(theta * DegreesToRadians) * proximalArmLength + cosf((psi + theta) * DegreesToRadians) * distalArmLength) - xOffset;
-			cachedY = finalCoords[Y_AXIS] = (sinf(theta * DegreesToRadians) * proximalArmLength + sinf((psi + theta) * DegreesToRadians) * distalArmLength) - yOffset;
-			cachedArmMode = currentArmMode;
+			theta = constrain<float>(theta, thetaLimits[0], thetaLimits[1]);
+			psi = constrain<float>(psi, psiLimits[0], psiLimits[1]);
+			finalCoords[X_AXIS] = (cosf(theta * DegreesToRadians) * proximalArmLength + cosf((psi + theta) * DegreesToRadians) * distalArmLength) - xOffset;
+			finalCoords[Y_AXIS] = (sinf(theta * DegreesToRadians) * proximalArmLength + sinf((psi + theta) * DegreesToRadians) * distalArmLength) - yOffset;
+			CacheThetaAndPsi(finalCoords[X_AXIS], finalCoords[Y_AXIS], theta, psi, currentArmMode);
 		}
 	}
 
@@ -495,7 +500,7 @@ void ScaraKinematics::Recalc()
 	}
 	maxRadius *= 0.995;
 
-	cachedX = cachedY = std::numeric_limits<float>::quiet_NaN();		// make sure that the cached values won't match any coordinates
+	ikCache.Invalidate();						// the cached values are no longer valid
 }
 
 // End
@@ -9,6 +9,7 @@
 #define SRC_MOVEMENT_KINEMATICS_SCARAKINEMATICS_H_
 
 #include "ZLeadscrewKinematics.h"
+#include "InverseKinematicsCache.h"
 
 // Standard setup for SCARA machines assumed by this firmware
 // The X motor output drives the proximal arm joint, unless remapped using M584
@@ -60,6 +61,7 @@ private:
 
 	void Recalc();
 	bool CalculateThetaAndPsi(const float machinePos[], bool isCoordinated, float& theta, float& psi, bool& armMode) const;
+	void CacheThetaAndPsi(float x, float y, float theta, float psi, bool armMode) const;
 
 	// Primary parameters
 	float proximalArmLength;
@@ -81,8 +83,8 @@ private:
 	float twoPd;
 
 	// State variables
-	mutable float cachedX, cachedY, cachedTheta, cachedPsi;
-	mutable bool currentArmMode, cachedArmMode;
+	mutable InverseKinematicsCache<2, 3> ikCache;	// maps X and Y to theta, psi and arm mode
+	mutable bool currentArmMode;
 };
 
 #endif /* SRC_MOVEMENT_KINEMATICS_SCARAKINEMATICS_H_ */
@@ -37,6 +37,7 @@
 #include "StepTimer.h"
 #include "Platform.h"
 #include "GCodes/GCodeBuffer.h"
+#include "Tasks.h"
 #include "Tools/Tool.h"
 
 #if SUPPORT_CAN_EXPANSION
@@ -58,8 +59,15 @@ const ObjectModelTableEntry Move::objectModelTable[] =
 	{ "drcEnabled", OBJECT_MODEL_FUNC(&(self->drcEnabled)), TYPE_OF(bool), ObjectModelTableEntry::none },
 	{ "drcMinimumAcceleration", OBJECT_MODEL_FUNC(&(self->drcMinimumAcceleration)), TYPE_OF(float), ObjectModelTableEntry::none },
 	{ "drcPeriod", OBJECT_MODEL_FUNC(&(self->drcPeriod)), TYPE_OF(float), ObjectModelTableEntry::none },
+	{ "junctionDeviation", OBJECT_MODEL_FUNC(&(self->junctionDeviation)), TYPE_OF(float), ObjectModelTableEntry::none },
 	{ "maxPrintingAcceleration", OBJECT_MODEL_FUNC(&(self->maxPrintingAcceleration)), TYPE_OF(float), ObjectModelTableEntry::none },
 	{ "maxTravelAcceleration", OBJECT_MODEL_FUNC(&(self->maxTravelAcceleration)), TYPE_OF(float), ObjectModelTableEntry::none },
+#if SUPPORT_MOTION_SHAPING
+	{ "sCurveTime", OBJECT_MODEL_FUNC(&(self->sCurveTime)), TYPE_OF(float), ObjectModelTableEntry::none },
+#endif
+#if SUPPORT_STEP_TIMING_STATS
+	{ "stepTiming", OBJECT_MODEL_FUNC(&(self->stepTimingStats)), TYPE_OF(ObjectModel), ObjectModelTableEntry::none },
+#endif
 };
 
 DEFINE_GET_OBJECT_MODEL_TABLE(Move)
@@ -70,13 +78,17 @@ Move::Move()
 	: active(false),
 	  drcEnabled(false),											// disable dynamic ringing cancellation
 	  maxPrintingAcceleration(10000.0), maxTravelAcceleration(10000.0),
+#if SUPPORT_MOTION_SHAPING
+	  sCurveTime(0.0), shapedAxes(0),
+#endif
 	  drcPeriod(0.025),												// 40Hz
 	  drcMinimumAcceleration(10.0),
+	  junctionDeviation(0.0),
 	  jerkPolicy(0)
 {
 	// Kinematics must be set up here because GCodes::Init asks the kinematics for the assumed initial position
 	kinematics = Kinematics::Create(KinematicsType::cartesian);		// default to Cartesian
-	mainDDARing.Init1(DdaRingLength);
+	mainDDARing.Init1(DdaRingLength, false);
 	DriveMovement::InitialAllocate(NumDms);
 }
 
@@ -91,6 +103,9 @@ void Move::Init()
 	usingMesh = false;
 	useTaper = false;
 	zShift = 0.0;
+#if SUPPORT_SEGMENT_FREE_MESH
+	segmentFreeMesh = false;
+#endif
 
 	idleTimeout = DefaultIdleTimeout;
 	moveState = MoveState::idle;
@@ -109,6 +124,15 @@ void Move::Exit()
 {
 	StepTimer::DisableStepInterrupt();
 	mainDDARing.Exit();
+#if SUPPORT_ASYNC_MOVES
+	for (DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured())
+		{
+			ring.Exit();
+		}
+	}
+#endif
 	active = false;												// don't accept any more moves
 }
 
@@ -128,6 +152,15 @@ void Move::Spin()
 
 	// Recycle the DDAs for completed moves, checking for DDA errors to print if Move debug is enabled
 	mainDDARing.RecycleDDAs();
+#if SUPPORT_ASYNC_MOVES
+	for (DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured())
+		{
+			ring.RecycleDDAs();
+		}
+	}
+#endif
 
 	// See if we can add another move to the ring
 	bool canAddMove = (
@@ -141,7 +174,7 @@ void Move::Spin()
 		// OK to add another move. First check if a special move is available.
 		if (bedLevellingMoveAvailable)
 		{
-			if (simulationMode < 2)
+			if (simulationMode != 2)
 			{
 				if (mainDDARing.AddSpecialMove(reprap.GetPlatform().MaxFeedrate(Z_AXIS), specialMoveCoords))
 				{
@@ -165,9 +198,13 @@ void Move::Spin()
 		{
 			// If there's a G Code move available, add it to the DDA ring for processing.
 			GCodes::RawMove nextMove;
+#if SUPPORT_ASYNC_MOVES
+			if (reprap.GetGCodes().ReadMove(0, nextMove))	// if we have a new move for the main ring
+#else
 			if (reprap.GetGCodes().ReadMove(nextMove))		// if we have a new move
+#endif
 			{
-				if (simulationMode < 2)		// in simulation mode 2 and higher, we don't process incoming moves beyond this point
+				if (simulationMode != 2)	// in simulation mode 2, we don't process incoming moves beyond this point
 				{
 					if (nextMove.moveType == 0)
 					{
@@ -194,10 +231,48 @@ void Move::Spin()
 		}
 	}
 
+#if SUPPORT_ASYNC_MOVES
+	// Moves of axes that have been assigned to auxiliary rings are added to those rings instead
+	for (unsigned int ringNumber = 1; ringNumber <= MaxAuxDDARings; ++ringNumber)
+	{
+		DDARing& ring = auxDDARings[ringNumber - 1];
+		if (ring.IsConfigured() && ring.CanAddMove())
+		{
+			GCodes::RawMove nextMove;
+			if (reprap.GetGCodes().ReadMove(ringNumber, nextMove) && simulationMode != 2)
+			{
+				if (nextMove.moveType == 0)
+				{
+					AxisAndBedTransform(nextMove.coords, nextMove.tool, true);
+				}
+
+				if (ring.AddStandardMove(nextMove, !IsRawMotorMove(nextMove.moveType)))
+				{
+					idleCount = 0;
+					if (moveState == MoveState::idle || moveState == MoveState::timing)
+					{
+						moveState = MoveState::collecting;
+						lastStateChangeTime = millis();
+					}
+				}
+			}
+		}
+	}
+#endif
+
 	mainDDARing.Spin(simulationMode, idleCount > 10);	// let the DDA ring process moves. Better to have a few moves in the queue so that we can do lookahead, hence the test on idleCount.
+#if SUPPORT_ASYNC_MOVES
+	for (DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured())
+		{
+			ring.Spin(simulationMode, true);			// auxiliary moves are usually commanded one at a time, so don't wait for more of them before starting
+		}
+	}
+#endif
 
 	// Reduce motor current to standby if the rings have been idle for long enough
-	if (mainDDARing.IsIdle())
+	if (NoLiveMovement())
 	{
 		if (moveState == MoveState::executing && !reprap.GetGCodes().IsPaused())
 		{
@@ -253,6 +328,81 @@ bool Move::IsRawMotorMove(uint8_t moveType) const
 	return moveType == 2 || ((moveType == 1 || moveType == 3) && kinematics->GetHomingMode() != HomingMode::homeCartesianAxes);
 }
 
+#if SUPPORT_NATIVE_ARCS
+
+// Return true if arc moves can be executed without splitting them into straight segments.
+// This needs the motor positions to be linear in the X and Y coordinates, so we can't do it if bed compensation or axis skew compensation is in use,
+// or if X or Y is mapped to other axes. We also need all the axis motors to be driven locally.
+bool Move::CanUseNativeArcs(const Tool *tool) const
+{
+	if (   !kinematics->HasLinearMotorMapping()
+		|| usingMesh || probePoints.GetNumBedCompensationPoints() != 0
+		|| tanXY != 0.0 || tanYZ != 0.0 || tanXZ != 0.0
+		|| Tool::GetXAxes(tool) != MakeBitmap<AxesBitmap>(X_AXIS) || Tool::GetYAxes(tool) != MakeBitmap<AxesBitmap>(Y_AXIS)
+	   )
+	{
+		return false;
+	}
+
+# if SUPPORT_CAN_EXPANSION
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t axis = 0; axis < numTotalAxes; ++axis)
+	{
+		const AxisDriversConfig& config = reprap.GetPlatform().GetAxisDriversConfig(axis);
+		for (size_t i = 0; i < config.numDrivers; ++i)
+		{
+			if (config.driverNumbers[i] >= NumDirectDrivers)
+			{
+				return false;
+			}
+		}
+	}
+# endif
+	return true;
+}
+
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH
+
+// Return true if the Z motor can follow the height map during a straight move, so that the move doesn't need to be split where it crosses the grid lines.
+// The height correction along a straight line is then a quadratic function of distance within each grid cell, which the step generation code can follow.
+// This needs bilinear interpolation, a single X and Y axis so that we don't average several corrections, no taper because that makes the correction depend on Z,
+// and a Z axis that moves only the Z motor. The Z motor drivers must be local.
+bool Move::CanUseSegmentFreeMesh(const Tool *tool) const
+{
+	if (   !segmentFreeMesh || !usingMesh || useTaper || heightMap.UsingBicubicInterpolation()
+		|| Tool::GetXAxes(tool) != MakeBitmap<AxesBitmap>(X_AXIS) || Tool::GetYAxes(tool) != MakeBitmap<AxesBitmap>(Y_AXIS)
+		|| !kinematics->HasLinearMotorMapping()
+	   )
+	{
+		return false;
+	}
+
+	const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+	for (size_t axis = 0; axis < numTotalAxes; ++axis)
+	{
+		if ((kinematics->GetMotorCoefficient(Z_AXIS, axis) != 0.0) != (axis == Z_AXIS))
+		{
+			return false;
+		}
+	}
+
+# if SUPPORT_CAN_EXPANSION
+	const AxisDriversConfig& config = reprap.GetPlatform().GetAxisDriversConfig(Z_AXIS);
+	for (size_t i = 0; i < config.numDrivers; ++i)
+	{
+		if (config.driverNumbers[i] >= NumDirectDrivers)
+		{
+			return false;
+		}
+	}
+# endif
+	return true;
+}
+
+#endif
+
 // Return true if the specified point is accessible to the Z probe
 bool Move::IsAccessibleProbePoint(float x, float y) const
 {
@@ -263,7 +413,29 @@ bool Move::IsAccessibleProbePoint(float x, float y) const
 // Pause the print as soon as we can, returning true if we are able to skip any moves and updating 'rp' to the first move we skipped.
 bool Move::PausePrint(RestorePoint& rp)
 {
+#if SUPPORT_ASYNC_MOVES
+	// Only the main ring is paused. Moves in the auxiliary rings are always completed, so the restore point must record where they will finish.
+	const bool ret = mainDDARing.PauseMoves(rp);
+	for (const DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured())
+		{
+			float auxCoords[MaxAxes];
+			ring.GetCurrentMachinePosition(auxCoords, false);
+			const AxesBitmap ringAxes = ring.GetOwnAxes();
+			for (size_t axis = 0; axis < MaxAxes; ++axis)
+			{
+				if (IsBitSet(ringAxes, axis))
+				{
+					rp.moveCoords[axis] = auxCoords[axis];
+				}
+			}
+		}
+	}
+	return ret;
+#else
 	return mainDDARing.PauseMoves(rp);
+#endif
 }
 
 #if HAS_VOLTAGE_MONITOR || HAS_STALL_DETECT
@@ -271,7 +443,30 @@ bool Move::PausePrint(RestorePoint& rp)
 // Pause the print immediately, returning true if we were able to skip or abort any moves and setting up to the move we aborted
 bool Move::LowPowerOrStallPause(RestorePoint& rp)
 {
+#if SUPPORT_ASYNC_MOVES
+	// The machine must stop moving, so stop the auxiliary rings as well and record where their axes stopped, whether or not we could skip any moves in the main ring
+	const bool ret = mainDDARing.LowPowerOrStallPause(rp);
+	for (DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured())
+		{
+			ring.AbortMoves();
+			float auxCoords[MaxAxes];
+			ring.GetCurrentMachinePosition(auxCoords, false);
+			const AxesBitmap ringAxes = ring.GetOwnAxes();
+			for (size_t axis = 0; axis < MaxAxes; ++axis)
+			{
+				if (IsBitSet(ringAxes, axis))
+				{
+					rp.moveCoords[axis] = auxCoords[axis];
+				}
+			}
+		}
+	}
+	return ret;
+#else
 	return mainDDARing.LowPowerOrStallPause(rp);
+#endif
 }
 
 #endif
@@ -284,6 +479,9 @@ void Move::Diagnostics(MessageType mtype)
 	numHiccups = 0;
 	longestGcodeWaitInterval = 0;
 	DriveMovement::ResetMinFree();
+#if SUPPORT_STEP_TIMING_STATS
+	stepTimingStats.Diagnostics(mtype);
+#endif
 
 #if defined(__ALLIGATOR__)
 	// Motor Fault Diagnostic
@@ -333,8 +531,307 @@ void Move::Diagnostics(MessageType mtype)
 #endif
 
 	mainDDARing.Diagnostics(mtype, "");
+#if SUPPORT_ASYNC_MOVES
+	for (unsigned int ringNumber = 1; ringNumber <= MaxAuxDDARings; ++ringNumber)
+	{
+		DDARing& ring = auxDDARings[ringNumber - 1];
+		if (ring.IsConfigured())
+		{
+			String<StringLength20> prefix;
+			prefix.printf("Aux%u ", ringNumber);
+			ring.Diagnostics(mtype, prefix.c_str());
+		}
+	}
+#endif
+}
+
+#if SUPPORT_ASYNC_MOVES
+
+// Process M596, which sets up additional movement queues and assigns axes to them.
+// Moves that only move axes assigned to an additional queue are executed independently of moves in the main queue, so they can overlap them.
+// Only axes that are not moved by other axes' motors can be assigned to additional queues, and moves in those queues can't extrude.
+// M596 P0 returns the axes mentioned, or all axes if none are mentioned, to the main queue after the additional queues have finished their moves.
+GCodeResult Move::ConfigureAuxMovementQueue(GCodeBuffer& gb, const StringRef& reply)
+{
+	const size_t numVisibleAxes = reprap.GetGCodes().GetVisibleAxes();
+	if (!gb.Seen('P'))
+	{
+		reply.copy("Movement queues: main");
+		for (unsigned int ringNumber = 1; ringNumber <= MaxAuxDDARings; ++ringNumber)
+		{
+			const DDARing& ring = auxDDARings[ringNumber - 1];
+			if (ring.IsConfigured())
+			{
+				reply.catf(", %u (length %u, axes", ringNumber, ring.GetNumDdas());
+				for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+				{
+					if (IsBitSet(ring.GetOwnAxes(), axis))
+					{
+						reply.catf(" %c", reprap.GetGCodes().GetAxisLetters()[axis]);
+					}
+				}
+				reply.cat(')');
+			}
+		}
+		reply.cat("; use M596 P0 to return axes to the main queue");
+		return GCodeResult::ok;
+	}
+
+	const uint32_t ringNumber = gb.GetUIValue();
+	if (ringNumber > MaxAuxDDARings)
+	{
+		reply.printf("Movement queue number must be between 0 and %u", MaxAuxDDARings);
+		return GCodeResult::error;
+	}
+
+	// Find which axes to assign to this queue
+	AxesBitmap newAxes = 0;
+	for (size_t axis = 0; axis < numVisibleAxes; ++axis)
+	{
+		if (gb.Seen(reprap.GetGCodes().GetAxisLetters()[axis]))
+		{
+			if (ringNumber != 0)											// any axis can be returned to the main queue
+			{
+				if (axis <= Z_AXIS || kinematics->GetConnectedAxes(axis) != MakeBitmap<AxesBitmap>(axis))
+				{
+					reply.printf("Axis %c can't be assigned to an independent movement queue", reprap.GetGCodes().GetAxisLetters()[axis]);
+					return GCodeResult::error;
+				}
+#if SUPPORT_CAN_EXPANSION
+				// Movement for drivers on expansion boards is sent from the main queue only
+				const AxisDriversConfig& config = reprap.GetPlatform().GetAxisDriversConfig(axis);
+				for (size_t i = 0; i < config.numDrivers; ++i)
+				{
+					if (config.driverNumbers[i] >= NumDirectDrivers)
+					{
+						reply.printf("Axis %c uses a CAN-connected driver, so it can't be assigned to an independent movement queue", reprap.GetGCodes().GetAxisLetters()[axis]);
+						return GCodeResult::error;
+					}
+				}
+#endif
+			}
+			SetBit(newAxes, axis);
+		}
+	}
+
+	uint32_t numDdasWanted = DefaultAuxDdaRingLength;
+	if (ringNumber == 0)
+	{
+		if (newAxes == 0)
+		{
+			// Return all the axes that the additional queues own
+			for (const DDARing& ring : auxDDARings)
+			{
+				if (ring.IsConfigured())
+				{
+					newAxes |= ring.GetOwnAxes();
+				}
+			}
+		}
+	}
+	else
+	{
+		const DDARing& auxRing = auxDDARings[ringNumber - 1];
+		bool dummy;
+		gb.TryGetUIValue('Q', numDdasWanted, dummy);
+		if (auxRing.IsConfigured())
+		{
+			if (numDdasWanted != auxRing.GetNumDdas() && gb.Seen('Q'))
+			{
+				reply.copy("Movement queue length can't be changed once the queue has been created");
+				return GCodeResult::error;
+			}
+		}
+		else if (numDdasWanted < 2 || numDdasWanted > MaxDdaRingLength)
+		{
+			reply.printf("Movement queue length must be between 2 and %u", MaxDdaRingLength);
+			return GCodeResult::error;
+		}
+		else if (numDdasWanted * sizeof(DDA) + MinSpareRamAfterQueueAllocation > Tasks::GetNeverUsedRam())
+		{
+			reply.copy("Not enough free RAM for the requested movement queue length");
+			return GCodeResult::error;
+		}
+	}
+
+	// Axes can only be moved between queues when all the queues are empty. This also waits for the additional queues to finish the moves of any axes we are returning to the main queue.
+	if (!reprap.GetGCodes().LockMovementAndWaitForStandstill(gb))
+	{
+		return GCodeResult::notFinished;
+	}
+
+	float machinePos[MaxAxes];
+	GetCurrentMachinePosition(machinePos, false);			// get the position before we change which ring is responsible for each axis
+
+	if (ringNumber != 0 && !auxDDARings[ringNumber - 1].IsConfigured())
+	{
+		DDARing& auxRing = auxDDARings[ringNumber - 1];
+		auxRing.Init1(numDdasWanted, true);
+		auxRing.Init2();
+		auxRing.SetOwnAxes(0);
+	}
+
+	for (unsigned int i = 0; i <= MaxAuxDDARings; ++i)
+	{
+		DDARing& ring = GetRing(i);
+		if (i == ringNumber)
+		{
+			ring.SetOwnAxes(ring.GetOwnAxes() | newAxes);
+		}
+		else if (ring.IsConfigured())
+		{
+			ring.SetOwnAxes(ring.GetOwnAxes() & ~newAxes);
+		}
+	}
+
+	// Make all the rings agree about the current position of every axis, including the ones that they don't own
+	float newPos[MaxTotalDrivers];
+	memcpy(newPos, machinePos, sizeof(machinePos));
+	for (size_t drive = MaxAxes; drive < MaxTotalDrivers; ++drive)
+	{
+		newPos[drive] = 0.0;
+	}
+	for (unsigned int i = 1; i <= MaxAuxDDARings; ++i)
+	{
+		DDARing& ring = GetRing(i);
+		if (ring.IsConfigured())
+		{
+			ring.SetLiveCoordinates(newPos);
+			ring.SetPositions(newPos);
+		}
+	}
+
+	if (ringNumber == 0 && newAxes != 0)
+	{
+		// The main ring's coordinates for the returned axes are out of date because the additional queues have been moving them, so update them, keeping its extruder positions
+		mainDDARing.LiveCoordinates(newPos);
+		memcpy(newPos, machinePos, sizeof(machinePos));
+		mainDDARing.SetLiveCoordinates(newPos);
+		mainDDARing.SetPositions(newPos);
+	}
+	return GCodeResult::ok;
 }
 
+// Return the number of the movement queue that moves this axis, 0 for the main queue. This is called from ISRs.
+unsigned int Move::GetRingNumber(size_t axis) const
+{
+	for (unsigned int ringNumber = 1; ringNumber <= MaxAuxDDARings; ++ringNumber)
+	{
+		const DDARing& ring = auxDDARings[ringNumber - 1];
+		if (ring.IsConfigured() && IsBitSet(ring.GetOwnAxes(), axis))
+		{
+			return ringNumber;
+		}
+	}
+	return 0;
+}
+
+// Get the current position in untransformed coords, taking the position of each axis from the ring that moves it
+void Move::GetCurrentMachinePosition(float m[MaxAxes], bool disableMotorMapping) const
+{
+	mainDDARing.GetCurrentMachinePosition(m, disableMotorMapping);
+	for (const DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured() && ring.GetOwnAxes() != 0)
+		{
+			float auxCoords[MaxAxes];
+			ring.GetCurrentMachinePosition(auxCoords, disableMotorMapping);
+			for (size_t axis = 0; axis < MaxAxes; ++axis)
+			{
+				if (IsBitSet(ring.GetOwnAxes(), axis))
+				{
+					m[axis] = auxCoords[axis];
+				}
+			}
+		}
+	}
+}
+
+// Get the current position of a motor
+int32_t Move::GetEndPoint(size_t drive) const
+{
+	return GetRingForDrive(drive).GetEndPoint(drive);
+}
+
+// Perform motor endpoint adjustment. Only the main ring moves the motors that are adjusted, but the other rings must agree with it about their positions.
+void Move::AdjustMotorPositions(const float adjustment[], size_t numMotors)
+{
+	for (unsigned int i = 0; i <= MaxAuxDDARings; ++i)
+	{
+		DDARing& ring = GetRing(i);
+		if (ring.IsConfigured())
+		{
+			ring.AdjustMotorPositions(adjustment, numMotors);
+		}
+	}
+}
+
+// Return the current live XYZ and extruder coordinates, taking the position of each axis from the ring that moves it
+// Interrupts are assumed enabled on entry
+void Move::LiveCoordinates(float m[MaxTotalDrivers], const Tool *tool)
+{
+	mainDDARing.LiveCoordinates(m);
+	for (DDARing& ring : auxDDARings)
+	{
+		if (ring.IsConfigured() && ring.GetOwnAxes() != 0)
+		{
+			float auxCoords[MaxTotalDrivers];
+			ring.LiveCoordinates(auxCoords);
+			for (size_t axis = 0; axis < MaxAxes; ++axis)
+			{
+				if (IsBitSet(ring.GetOwnAxes(), axis))
+				{
+					m[axis] = auxCoords[axis];
+				}
+			}
+		}
+	}
+	InverseAxisAndBedTransform(m, tool);
+}
+
+// These are the actual numbers that we want to be the coordinates, so don't transform them.
+// The caller must make sure that no moves are in progress or pending when calling this
+void Move::SetLiveCoordinates(const float coords[MaxTotalDrivers])
+{
+	for (unsigned int i = 0; i <= MaxAuxDDARings; ++i)
+	{
+		DDARing& ring = GetRing(i);
+		if (ring.IsConfigured())
+		{
+			ring.SetLiveCoordinates(coords);
+		}
+	}
+}
+
+// Force the machine coordinates to be these
+void Move::SetPositions(const float move[MaxTotalDrivers])
+{
+	for (unsigned int i = 0; i <= MaxAuxDDARings; ++i)
+	{
+		DDARing& ring = GetRing(i);
+		if (ring.IsConfigured())
+		{
+			ring.SetPositions(move);
+		}
+	}
+}
+
+// Is a move running, or are there any queued?
+bool Move::NoLiveMovement() const
+{
+	for (unsigned int i = 0; i <= MaxAuxDDARings; ++i)
+	{
+		const DDARing& ring = GetRing(i);
+		if (ring.IsConfigured() && !ring.IsIdle())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
+
 // Set the current position to be this
 void Move::SetNewPosition(const float positionNow[MaxTotalDrivers], bool doBedCompensation)
 {
@@ -698,8 +1195,31 @@ void Move::Interrupt()
 	bool repeat;
 	do
 	{
+#if SUPPORT_ASYNC_MOVES
+		// Step each ring whose next step is due, then schedule the interrupt for whichever ring needs it first.
+		// We must not call DDARing::Interrupt early for a ring whose current move hasn't started yet, because DDA::StepDrivers would treat its start time as being in the past.
+		std::optional<uint32_t> nextStepTime;
+		for (unsigned int i = 0; i <= MaxAuxDDARings; ++i)
+		{
+			DDARing& ring = GetRing(i);
+			if (ring.IsConfigured())
+			{
+				std::optional<uint32_t> ringStepTime = ring.GetNextInterruptTime();
+				if (ringStepTime.has_value() && (int32_t)(ringStepTime.value() - StepTimer::GetInterruptClocks()) <= (int32_t)DDA::MinInterruptInterval)
+				{
+					ring.Interrupt(p);
+					ringStepTime = ring.GetNextInterruptTime();
+				}
+				if (ringStepTime.has_value() && (!nextStepTime.has_value() || (int32_t)(ringStepTime.value() - nextStepTime.value()) < 0))
+				{
+					nextStepTime = ringStepTime;
+				}
+			}
+		}
+#else
 		mainDDARing.Interrupt(p);
 		std::optional<uint32_t> nextStepTime = mainDDARing.GetNextInterruptTime();
+#endif
 		if (!nextStepTime.has_value())
 		{
 			break;
@@ -711,6 +1231,15 @@ void Move::Interrupt()
 		{
 			// Force a break by updating the move start time
 			mainDDARing.InsertHiccup(DDA::HiccupTime);
+#if SUPPORT_ASYNC_MOVES
+			for (DDARing& ring : auxDDARings)
+			{
+				if (ring.IsConfigured())
+				{
+					ring.InsertHiccup(DDA::HiccupTime);
+				}
+			}
+#endif
 			nextStepTime = nextStepTime.value() + DDA::HiccupTime;
 #if SUPPORT_CAN_EXPANSION
 			CanInterface::InsertHiccup(DDA::HiccupTime);
@@ -722,6 +1251,13 @@ void Move::Interrupt()
 		// If we have already spent too much time in the ISR, delay the interrupt
 		repeat = StepTimer::ScheduleStepInterrupt(nextStepTime.value());
 	} while (repeat);
+
+#if SUPPORT_STEP_TIMING_STATS
+	if (stepTimingStats.IsEnabled())
+	{
+		stepTimingStats.RecordIsrTime(StepTimer::GetInterruptClocksInterruptsDisabled() - isrStartTime);
+	}
+#endif
 }
 
 /*static*/ float Move::MotorStepsToMovement(size_t drive, int32_t endpoint)
@@ -862,9 +1398,22 @@ GCodeResult Move::ConfigureAccelerations(GCodeBuffer&gb, const StringRef& reply)
 		seen = true;
 		maxTravelAcceleration = gb.GetFValue();
 	}
+#if SUPPORT_MOTION_SHAPING
+	if (gb.Seen('J'))
+	{
+		seen = true;
+		sCurveTime = constrain<float>(gb.GetFValue(), 0.0, 1000.0) * MillisToSeconds;
+	}
+#endif
 	if (!seen)
 	{
 		reply.printf("Maximum printing acceleration %.1f, maximum travel acceleration %.1f", (double)maxPrintingAcceleration, (double)maxTravelAcceleration);
+#if SUPPORT_MOTION_SHAPING
+		if (sCurveTime > 0.0)
+		{
+			reply.catf(", S-curve jerk time %.1fms", (double)(sCurveTime * SecondsToMillis));
+		}
+#endif
 	}
 	return GCodeResult::ok;
 }
@@ -872,6 +1421,14 @@ GCodeResult Move::ConfigureAccelerations(GCodeBuffer&gb, const StringRef& reply)
 // Process M593
 GCodeResult Move::ConfigureDynamicAcceleration(GCodeBuffer& gb, const StringRef& reply)
 {
+#if SUPPORT_MOTION_SHAPING
+	// If there is a P parameter then we are configuring input shaping
+	if (gb.Seen('P'))
+	{
+		return ConfigureInputShaping(gb, reply);
+	}
+#endif
+
 	bool seen = false;
 	if (gb.Seen('F'))
 	{
@@ -903,8 +1460,138 @@ GCodeResult Move::ConfigureDynamicAcceleration(GCodeBuffer& gb, const StringRef&
 		{
 			reply.copy("Dynamic ringing cancellation is disabled");
 		}
+#if SUPPORT_MOTION_SHAPING
+		const char * const axisLetters = reprap.GetGCodes().GetAxisLetters();
+		for (size_t axis = 0; axis < reprap.GetGCodes().GetVisibleAxes(); ++axis)
+		{
+			if (IsBitSet(shapedAxes, axis))
+			{
+				const AxisShaper& shaper = axisShapers[axis];
+				reply.catf("\n%c: input shaper %s at %.1fHz, damping %.2f", axisLetters[axis], shaper.GetTypeName(), (double)shaper.GetFrequency(), (double)shaper.GetDamping());
+			}
+		}
+#endif
 	}
 	return GCodeResult::ok;
 }
 
+#if SUPPORT_MOTION_SHAPING
+
+// Process M593 with a P parameter. The shaper type, frequency and damping ratio apply to the axes named in the command, or to X and Y if no axes are named.
+// Frequencies and damping ratios that are not given keep their previous values for each axis.
+GCodeResult Move::ConfigureInputShaping(GCodeBuffer& gb, const StringRef& reply)
+{
+	String<StringLength20> typeName;
+	InputShaperType type;
+	if (!gb.GetPossiblyQuotedString(typeName.GetRef()) || !AxisShaper::GetTypeFromName(typeName.c_str(), type))
+	{
+		reply.printf("Unknown input shaper type '%s'", typeName.c_str());
+		return GCodeResult::error;
+	}
+
+	const char * const axisLetters = reprap.GetGCodes().GetAxisLetters();
+	AxesBitmap axes = 0;
+	for (size_t axis = 0; axis < reprap.GetGCodes().GetVisibleAxes(); ++axis)
+	{
+		if (gb.Seen(axisLetters[axis]))
+		{
+			SetBit(axes, axis);
+		}
+	}
+	if (axes == 0)
+	{
+		axes = MakeBitmap<AxesBitmap>(X_AXIS) | MakeBitmap<AxesBitmap>(Y_AXIS);
+	}
+
+	bool seenFreq = false, seenDamping = false;
+	float freq = 0.0, damping = 0.0;
+	gb.TryGetFValue('F', freq, seenFreq);
+	gb.TryGetFValue('S', damping, seenDamping);
+
+	// The DMs of moves being executed refer to the shapers, so we can only change them when the machine is stationary
+	if (!reprap.GetGCodes().LockMovementAndWaitForStandstill(gb))
+	{
+		return GCodeResult::notFinished;
+	}
+
+	for (size_t axis = 0; axis < MaxAxes; ++axis)
+	{
+		if (IsBitSet(axes, axis))
+		{
+			AxisShaper& shaper = axisShapers[axis];
+			if (!shaper.Configure(type, (seenFreq) ? freq : shaper.GetFrequency(), (seenDamping) ? damping : shaper.GetDamping()))
+			{
+				reply.printf("Bad input shaper parameters for axis %c", axisLetters[axis]);
+				return GCodeResult::error;
+			}
+			if (shaper.IsEnabled())
+			{
+				SetBit(shapedAxes, axis);
+			}
+			else
+			{
+				ClearBit(shapedAxes, axis);
+			}
+		}
+	}
+
+	// The shaper is applied to the motion of each motor, so warn about any motor that moves a shaped axis but can't be shaped
+	if (shapedAxes != 0)
+	{
+		if (!kinematics->HasLinearMotorMapping())
+		{
+			reply.copy("Input shaping is only applied to machines with Cartesian or Core kinematics");
+			return GCodeResult::warning;
+		}
+		const size_t numTotalAxes = reprap.GetGCodes().GetTotalAxes();
+		for (size_t motor = 0; motor < numTotalAxes; ++motor)
+		{
+			if (GetMotorShaper(motor) == nullptr)
+			{
+				for (size_t axis = 0; axis < numTotalAxes; ++axis)
+				{
+					if (IsBitSet(shapedAxes, axis) && kinematics->GetMotorCoefficient(axis, motor) != 0.0)
+					{
+						reply.printf("Input shaping is not applied to motor %u because the axes it moves have different input shapers", (unsigned int)motor);
+						return GCodeResult::warning;
+					}
+				}
+			}
+		}
+	}
+	return GCodeResult::ok;
+}
+
+// Return the input shaper to apply to the motion of a motor, or nullptr if there is none.
+// Shaping the motion of a motor shapes the motion of every axis that it moves, so we can only do it if the motor mapping is linear and all of those axes have the same shaper.
+const AxisShaper *Move::GetMotorShaper(size_t motor) const
+{
+	if (shapedAxes == 0 || motor >= MaxAxes || !kinematics->HasLinearMotorMapping())
+	{
+		return nullptr;
+	}
+
+	const AxisShaper *motorShaper = nullptr;
+	bool seenAxis = false;
+	for (size_t axis = 0; axis < reprap.GetGCodes().GetTotalAxes(); ++axis)
+	{
+		if (kinematics->GetMotorCoefficient(axis, motor) != 0.0)
+		{
+			const AxisShaper * const axisShaper = GetAxisShaper(axis);
+			if (!seenAxis)
+			{
+				motorShaper = axisShaper;
+				seenAxis = true;
+			}
+			else if ((axisShaper == nullptr) != (motorShaper == nullptr) || (axisShaper != nullptr && !axisShaper->SameAs(*motorShaper)))
+			{
+				return nullptr;
+			}
+		}
+	}
+	return motorShaper;
+}
+
+#endif
+
 // End
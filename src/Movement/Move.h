@@ -12,6 +12,8 @@
 #include "MessageType.h"
 #include "DDARing.h"
 #include "DDA.h"								// needed because of our inline functions
+#include "AxisShaper.h"
+#include "StepTimingStats.h"
 #include "BedProbing/RandomProbePointSet.h"
 #include "BedProbing/Grid.h"
 #include "Kinematics/Kinematics.h"
@@ -39,8 +41,21 @@ const unsigned int NumDms = 20 * 5;													// suitable for e.g. a delta + 2
 
 #endif
 
+constexpr unsigned int MaxDdaRingLength = 1000;										// the maximum length of movement queue that M595 will allow
+constexpr size_t MinSpareRamAfterQueueAllocation = 8 * 1024;						// how much never-used RAM M595 must leave
+constexpr uint32_t DefaultMaxQueuedMoveTime = 2000;									// the default maximum duration of queued moves in milliseconds
+constexpr uint32_t MinMaxQueuedMoveTime = 250;										// the lowest maximum duration of queued moves that M595 will allow, in milliseconds
+constexpr uint32_t MaxMaxQueuedMoveTime = 10000;									// the highest maximum duration of queued moves that M595 will allow, in milliseconds
+
+#if SUPPORT_ASYNC_MOVES
+constexpr unsigned int MaxAuxDDARings = 2;											// the number of additional movement queues that M596 can set up
+constexpr unsigned int DefaultAuxDdaRingLength = 5;									// the default length of an additional movement queue
+#endif
+
 constexpr uint32_t MovementStartDelayClocks = StepTimer::StepClockRate/100;			// 10ms delay between preparing the first move and starting it
 
+constexpr uint8_t StepTimingSimulationMode = 3;										// M37 S3: prepare the moves and calculate all the step times, but don't drive the motors
+
 // This is the master movement class.  It controls all movement in the machine.
 class Move INHERIT_OBJECT_MODEL
 {
@@ -77,11 +92,27 @@ public:
 	void SetTaperHeight(float h);
 	bool UseMesh(bool b);											// Try to enable mesh bed compensation and report the final state
 	bool IsUsingMesh() const { return usingMesh; }					// Return true if we are using mesh compensation
+#if SUPPORT_SEGMENT_FREE_MESH
+	void UseSegmentFreeMesh(bool b) { segmentFreeMesh = b; }		// Choose whether to apply mesh compensation in the step generation instead of segmenting moves
+	bool UsingSegmentFreeMesh() const { return segmentFreeMesh; }
+#endif
 	unsigned int GetNumProbePoints() const;							// Return the number of currently used probe points
 	float PushBabyStepping(size_t axis, float amount);				// Try to push some babystepping through the lookahead queue
 
 	GCodeResult ConfigureAccelerations(GCodeBuffer&gb, const StringRef& reply);			// process M204
+#if SUPPORT_MOTION_SHAPING
+	float GetSCurveTime() const { return sCurveTime; }
+	bool IsInputShapingEnabled() const { return shapedAxes != 0; }
+	const AxisShaper *GetAxisShaper(size_t axis) const { return (axis < MaxAxes && IsBitSet(shapedAxes, axis)) ? &axisShapers[axis] : nullptr; }
+	const AxisShaper *GetMotorShaper(size_t motor) const;
+	GCodeResult ConfigureInputShaping(GCodeBuffer& gb, const StringRef& reply);			// process M593 with a P parameter
+#endif
 	GCodeResult ConfigureDynamicAcceleration(GCodeBuffer& gb, const StringRef& reply);	// process M593
+	GCodeResult ConfigureMovementQueue(GCodeBuffer& gb, const StringRef& reply) { return mainDDARing.ConfigureMovementQueue(gb, reply); }	// process M595
+#if SUPPORT_ASYNC_MOVES
+	GCodeResult ConfigureAuxMovementQueue(GCodeBuffer& gb, const StringRef& reply);		// process M596
+	unsigned int GetRingNumber(size_t axis) const;										// Return the number of the movement queue that moves this axis, 0 for the main queue
+#endif
 
 	float GetMaxPrintingAcceleration() const { return maxPrintingAcceleration; }
 	float GetMaxTravelAcceleration() const { return maxTravelAcceleration; }
@@ -91,6 +122,9 @@ public:
 	float IsDRCenabled() const { return drcEnabled; }
 
 	void Diagnostics(MessageType mtype);							// Report useful stuff
+#if SUPPORT_STEP_TIMING_STATS
+	StepTimingStats& GetStepTimingStats() { return stepTimingStats; }
+#endif
 
 	// Kinematics and related functions
 	Kinematics& GetKinematics() const { return *kinematics; }
@@ -109,19 +143,26 @@ public:
 	// End temporary functions
 
 	bool IsRawMotorMove(uint8_t moveType) const;									// Return true if this is a raw motor move
+#if SUPPORT_NATIVE_ARCS
+	bool CanUseNativeArcs(const Tool *tool) const;									// Return true if arc moves can be executed without splitting them into straight segments
+#endif
+#if SUPPORT_SEGMENT_FREE_MESH
+	bool CanUseSegmentFreeMesh(const Tool *tool) const;								// Return true if the Z motor can follow the height map without splitting moves into segments
+#endif
 
 	float IdleTimeout() const;														// Returns the idle timeout in seconds
 	void SetIdleTimeout(float timeout);												// Set the idle timeout in seconds
 
 	void Simulate(uint8_t simMode);													// Enter or leave simulation mode
 	float GetSimulationTime() const { return mainDDARing.GetSimulationTime(); }		// Get the accumulated simulation time
+	void ReportSimulatedSteps(const StringRef& reply) const { mainDDARing.ReportSimulatedSteps(reply); }	// Append the step timing simulation results to the reply
 
 	bool PausePrint(RestorePoint& rp);												// Pause the print as soon as we can, returning true if we were able to
 #if HAS_VOLTAGE_MONITOR || HAS_STALL_DETECT
 	bool LowPowerOrStallPause(RestorePoint& rp);									// Pause the print immediately, returning true if we were able to
 #endif
 
-	bool NoLiveMovement() const { return mainDDARing.IsIdle(); }					// Is a move running, or are there any queued?
+	bool NoLiveMovement() const;													// Is a move running, or are there any queued?
 
 	uint32_t GetScheduledMoves() const { return mainDDARing.GetScheduledMoves(); }	// How many moves have been scheduled?
 	uint32_t GetCompletedMoves() const { return mainDDARing.GetCompletedMoves(); }	// How many moves have been completed?
@@ -149,6 +190,8 @@ public:
 
 	unsigned int GetJerkPolicy() const { return jerkPolicy; }
 	void SetJerkPolicy(unsigned int jp) { jerkPolicy = jp; }
+	float GetJunctionDeviation() const { return junctionDeviation; }
+	void SetJunctionDeviation(float jd) { junctionDeviation = max<float>(jd, 0.0); }
 
 #if HAS_SMART_DRIVERS
 	uint32_t GetStepInterval(size_t axis, uint32_t microstepShift) const;			// Get the current step interval for this axis or extruder
@@ -173,10 +216,18 @@ private:
 	void InverseBedTransform(float move[MaxAxes], const Tool *tool) const;	// Go from a bed-transformed point back to user coordinates
 	void AxisTransform(float move[MaxAxes], const Tool *tool) const;		// Take a position and apply the axis-angle compensations
 	void InverseAxisTransform(float move[MaxAxes], const Tool *tool) const;	// Go from an axis transformed point back to user coordinates
-	void SetPositions(const float move[MaxTotalDrivers]) { return mainDDARing.SetPositions(move); }	// Force the machine coordinates to be these;
+	void SetPositions(const float move[MaxTotalDrivers]);					// Force the machine coordinates to be these
 	float GetInterpolatedHeightError(float xCoord, float yCoord) const;		// Get the height error at an XY position
+#if SUPPORT_ASYNC_MOVES
+	DDARing& GetRing(unsigned int ringNumber) { return (ringNumber == 0) ? mainDDARing : auxDDARings[ringNumber - 1]; }
+	const DDARing& GetRing(unsigned int ringNumber) const { return (ringNumber == 0) ? mainDDARing : auxDDARings[ringNumber - 1]; }
+	const DDARing& GetRingForDrive(size_t drive) const { return (drive < MaxAxes) ? GetRing(GetRingNumber(drive)) : mainDDARing; }
+#endif
 
 	DDARing mainDDARing;								// The DDA ring used for regular moves
+#if SUPPORT_ASYNC_MOVES
+	DDARing auxDDARings[MaxAuxDDARings];				// Additional DDA rings for axes that move independently of the main ring, unused until configured by M596
+#endif
 
 	bool active;										// Are we live and running?
 	uint8_t simulationMode;								// Are we simulating, or really printing?
@@ -185,13 +236,22 @@ private:
 
 	float maxPrintingAcceleration;
 	float maxTravelAcceleration;
+#if SUPPORT_MOTION_SHAPING
+	float sCurveTime;									// how long the acceleration takes to ramp up and down in S-curve acceleration, or zero to use constant acceleration
+	AxesBitmap shapedAxes;								// the axes that have input shaping enabled
+	AxisShaper axisShapers[MaxAxes];					// the input shaper for each axis
+#endif
 	float drcPeriod;									// the period of ringing that we don't want to excite
 	float drcMinimumAcceleration;						// the minimum value that we reduce acceleration to
 
+	float junctionDeviation;							// the junction deviation in mm used to limit cornering speeds, or zero to use the XYZ jerk limits
 	unsigned int jerkPolicy;							// When we allow jerk
 	unsigned int idleCount;								// The number of times Spin was called and had no new moves to process
 	uint32_t longestGcodeWaitInterval;					// the longest we had to wait for a new GCode
 	uint32_t numHiccups;								// How many times we delayed an interrupt to avoid using too much CPU time in interrupts
+#if SUPPORT_STEP_TIMING_STATS
+	StepTimingStats stepTimingStats;					// Step ISR duration and step lateness histograms
+#endif
 
 	float tangents[3]; 									// Axis compensation - 90 degrees + angle gives angle between axes
 	float& tanXY = tangents[0];
@@ -205,6 +265,9 @@ private:
 	float zShift;										// Height to add to the bed transform
 	bool usingMesh;										// true if we are using the height map, false if we are using the random probe point set
 	bool useTaper;										// True to taper off the compensation
+#if SUPPORT_SEGMENT_FREE_MESH
+	bool segmentFreeMesh;								// True to apply mesh compensation in the step generation where possible
+#endif
 
 	uint32_t idleTimeout;								// How long we wait with no activity before we reduce motor currents to idle, in milliseconds
 	uint32_t lastStateChangeTime;						// The approximate time at which the state last changed, except we don't record timing->idle
@@ -217,6 +280,8 @@ private:
 
 //******************************************************************************************************
 
+#if !SUPPORT_ASYNC_MOVES
+
 // Get the current position in untransformed coords
 inline void Move::GetCurrentMachinePosition(float m[MaxAxes], bool disableMotorMapping) const
 {
@@ -250,6 +315,20 @@ inline void Move::SetLiveCoordinates(const float coords[MaxTotalDrivers])
 	mainDDARing.SetLiveCoordinates(coords);
 }
 
+// Force the machine coordinates to be these
+inline void Move::SetPositions(const float move[MaxTotalDrivers])
+{
+	mainDDARing.SetPositions(move);
+}
+
+// Is a move running, or are there any queued?
+inline bool Move::NoLiveMovement() const
+{
+	return mainDDARing.IsIdle();
+}
+
+#endif
+
 inline void Move::ResetExtruderPositions()
 {
 	mainDDARing.ResetExtruderPositions();
@@ -269,7 +348,11 @@ inline bool Move::AllMovesAreFinished()
 // This is called from the stepper drivers SPI interface ISR
 inline uint32_t Move::GetStepInterval(size_t axis, uint32_t microstepShift) const
 {
+#if SUPPORT_ASYNC_MOVES
+	return (simulationMode == 0) ? GetRingForDrive(axis).GetStepInterval(axis, microstepShift) : 0;
+#else
 	return (simulationMode == 0) ? mainDDARing.GetStepInterval(axis, microstepShift) : 0;
+#endif
 }
 
 #endif
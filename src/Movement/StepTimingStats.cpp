@@ -0,0 +1,173 @@
+/*
+ * StepTimingStats.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: David
+ */
+
+#include "StepTimingStats.h"
+
+#if SUPPORT_STEP_TIMING_STATS
+
+#include "StepTimer.h"
+#include "Platform.h"
+#include "RepRap.h"
+
+#if SUPPORT_OBJECT_MODEL
+
+const ObjectModelArrayDescriptor StepTimingStats::isrHistogramArrayDescriptor =
+{
+	[] (ObjectModel *self) -> size_t { return StepTimingStats::NumBuckets; },
+	[] (ObjectModel *self, size_t n) -> void* { return (void *)&(((StepTimingStats*)self)->isrHistogram[n]); }
+};
+
+const ObjectModelArrayDescriptor StepTimingStats::lateHistogramArrayDescriptor =
+{
+	[] (ObjectModel *self) -> size_t { return StepTimingStats::NumBuckets; },
+	[] (ObjectModel *self, size_t n) -> void* { return (void *)&(((StepTimingStats*)self)->lateHistogram[n]); }
+};
+
+const ObjectModelArrayDescriptor StepTimingStats::driveMaxLateArrayDescriptor =
+{
+	[] (ObjectModel *self) -> size_t { return MaxTotalDrivers; },
+	[] (ObjectModel *self, size_t n) -> void* { return (void *)&(((StepTimingStats*)self)->driveMaxLateClocks[n]); }
+};
+
+// Macro to build a standard lambda function that includes the necessary type conversions
+#define OBJECT_MODEL_FUNC(_ret) OBJECT_MODEL_FUNC_BODY(StepTimingStats, _ret)
+
+const ObjectModelTableEntry StepTimingStats::objectModelTable[] =
+{
+	// These entries must be in alphabetical order
+	{ "driveMaxLateClocks", OBJECT_MODEL_FUNC_NOSELF(&driveMaxLateArrayDescriptor), TYPE_OF(uint32_t) | IsArray, ObjectModelTableEntry::none },
+	{ "enabled", OBJECT_MODEL_FUNC(&(self->enabled)), TYPE_OF(bool), ObjectModelTableEntry::none },
+	{ "isrCount", OBJECT_MODEL_FUNC(&(self->isrCount)), TYPE_OF(uint32_t), ObjectModelTableEntry::none },
+	{ "isrHistogram", OBJECT_MODEL_FUNC_NOSELF(&isrHistogramArrayDescriptor), TYPE_OF(uint32_t) | IsArray, ObjectModelTableEntry::none },
+	{ "isrMaxClocks", OBJECT_MODEL_FUNC(&(self->isrMaxClocks)), TYPE_OF(uint32_t), ObjectModelTableEntry::none },
+	{ "lateHistogram", OBJECT_MODEL_FUNC_NOSELF(&lateHistogramArrayDescriptor), TYPE_OF(uint32_t) | IsArray, ObjectModelTableEntry::none },
+	{ "maxLateClocks", OBJECT_MODEL_FUNC(&(self->maxLateClocks)), TYPE_OF(uint32_t), ObjectModelTableEntry::none },
+	{ "stepCount", OBJECT_MODEL_FUNC(&(self->stepCount)), TYPE_OF(uint32_t), ObjectModelTableEntry::none },
+};
+
+DEFINE_GET_OBJECT_MODEL_TABLE(StepTimingStats)
+
+#endif
+
+StepTimingStats::StepTimingStats() : enabled(false)
+{
+	Reset();
+}
+
+void StepTimingStats::Enable(bool en)
+{
+	if (en && !enabled)
+	{
+		Reset();
+	}
+	enabled = en;
+}
+
+void StepTimingStats::Reset()
+{
+	const uint32_t basepri = ChangeBasePriority(NvicPriorityStep);
+	isrCount = isrMaxClocks = stepCount = maxLateClocks = 0;
+	memset(isrHistogram, 0, sizeof(isrHistogram));
+	memset(lateHistogram, 0, sizeof(lateHistogram));
+	memset(driveMaxLateClocks, 0, sizeof(driveMaxLateClocks));
+	memset(driveLateHistogram, 0, sizeof(driveLateHistogram));
+	RestoreBasePriority(basepri);
+}
+
+void StepTimingStats::RecordIsrTime(uint32_t clocks)
+{
+	++isrCount;
+	++isrHistogram[GetBucket(clocks)];
+	if (clocks > isrMaxClocks)
+	{
+		isrMaxClocks = clocks;
+	}
+}
+
+// Record a step. The step ISR generates steps that are due within the next MinInterruptInterval, so clocksLate may be negative.
+void StepTimingStats::RecordStep(size_t drive, int32_t clocksLate)
+{
+	const uint32_t late = (clocksLate < 0) ? 0 : (uint32_t)clocksLate;
+	const size_t bucket = GetBucket(late);
+	++stepCount;
+	++lateHistogram[bucket];
+	if (late > maxLateClocks)
+	{
+		maxLateClocks = late;
+	}
+	if (drive < MaxTotalDrivers)
+	{
+		++driveLateHistogram[drive][bucket];
+		if (late > driveMaxLateClocks[drive])
+		{
+			driveMaxLateClocks[drive] = late;
+		}
+	}
+}
+
+void StepTimingStats::Diagnostics(MessageType mtype)
+{
+	if (enabled)
+	{
+		reprap.GetPlatform().MessageF(mtype, "Step ISR calls %" PRIu32 ", max %" PRIu32 " clocks, steps %" PRIu32 ", max late %" PRIu32 " clocks\n",
+										isrCount, isrMaxClocks, stepCount, maxLateClocks);
+	}
+}
+
+// Append the non-empty buckets of a histogram to the reply
+/*static*/ void StepTimingStats::AppendHistogram(const StringRef& reply, const uint32_t histogram[NumBuckets])
+{
+	for (size_t i = 0; i < NumBuckets; ++i)
+	{
+		if (histogram[i] != 0)
+		{
+			if (i == 0)
+			{
+				reply.catf(" 0:%" PRIu32, histogram[i]);
+			}
+			else if (i == NumBuckets - 1)
+			{
+				reply.catf(" %u+:%" PRIu32, 1u << (i - 1), histogram[i]);
+			}
+			else
+			{
+				reply.catf(" %u-%u:%" PRIu32, 1u << (i - 1), (1u << i) - 1, histogram[i]);
+			}
+		}
+	}
+}
+
+void StepTimingStats::Report(const StringRef& reply) const
+{
+	if (!enabled)
+	{
+		reply.copy("Step timing statistics are disabled, use M122 P108 S1 to enable them");
+		return;
+	}
+
+	reply.printf("Step clock %" PRIu32 "Hz. ISR calls %" PRIu32 ", max %" PRIu32 " clocks:", StepTimer::StepClockRate, isrCount, isrMaxClocks);
+	AppendHistogram(reply, isrHistogram);
+	reply.catf("\nSteps %" PRIu32 ", max late %" PRIu32 " clocks:", stepCount, maxLateClocks);
+	AppendHistogram(reply, lateHistogram);
+	for (size_t drive = 0; drive < MaxTotalDrivers; ++drive)
+	{
+		bool any = false;
+		for (uint32_t count : driveLateHistogram[drive])
+		{
+			any = any || count != 0;
+		}
+		if (any)
+		{
+			reply.catf("\nDrive %u max late %" PRIu32 " clocks:", drive, driveMaxLateClocks[drive]);
+			AppendHistogram(reply, driveLateHistogram[drive]);
+		}
+	}
+}
+
+#endif
+
+// End
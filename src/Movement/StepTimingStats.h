@@ -0,0 +1,65 @@
+/*
+ * StepTimingStats.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: David
+ */
+
+#ifndef SRC_MOVEMENT_STEPTIMINGSTATS_H_
+#define SRC_MOVEMENT_STEPTIMINGSTATS_H_
+
+#include "RepRapFirmware.h"
+
+#if SUPPORT_STEP_TIMING_STATS
+
+#include "MessageType.h"
+#include "ObjectModel/ObjectModel.h"
+
+// Class to collect statistics about how long the step ISR takes and how late the steps are compared to when they were scheduled.
+// Values are recorded in log2 histograms of step clocks: bucket 0 counts zero values, bucket n counts values from 2^(n-1) to 2^n - 1, and the last bucket also counts larger values.
+// Collection is disabled by default, in which case the only cost in the step ISR is testing the enabled flag.
+class StepTimingStats INHERIT_OBJECT_MODEL
+{
+public:
+	static constexpr size_t NumBuckets = 16;
+
+	StepTimingStats();
+
+	bool IsEnabled() const { return enabled; }
+	void Enable(bool en);											// enable or disable collection, clearing the statistics if enabling
+	void Reset();
+
+	// These are called from the step ISR only when collection is enabled
+	void RecordIsrTime(uint32_t clocks) __attribute__ ((hot));
+	void RecordStep(size_t drive, int32_t clocksLate) __attribute__ ((hot));
+
+	void Diagnostics(MessageType mtype);							// print a summary for M122
+	void Report(const StringRef& reply) const;						// print the histograms for M122 P108
+
+protected:
+	DECLARE_OBJECT_MODEL
+
+private:
+#if SUPPORT_OBJECT_MODEL
+	static const ObjectModelArrayDescriptor isrHistogramArrayDescriptor;
+	static const ObjectModelArrayDescriptor lateHistogramArrayDescriptor;
+	static const ObjectModelArrayDescriptor driveMaxLateArrayDescriptor;
+#endif
+
+	static size_t GetBucket(uint32_t val) { return (val == 0) ? 0 : min<size_t>(32 - __builtin_clz(val), NumBuckets - 1); }
+	static void AppendHistogram(const StringRef& reply, const uint32_t histogram[NumBuckets]);
+
+	volatile bool enabled;
+	uint32_t isrCount;												// the number of step ISR calls
+	uint32_t isrMaxClocks;											// the longest time spent in the step ISR
+	uint32_t stepCount;												// the number of steps generated
+	uint32_t maxLateClocks;											// the latest step on any drive
+	uint32_t isrHistogram[NumBuckets];
+	uint32_t lateHistogram[NumBuckets];								// the lateness of the steps of all drives
+	uint32_t driveMaxLateClocks[MaxTotalDrivers];					// the latest step for each drive
+	uint32_t driveLateHistogram[MaxTotalDrivers][NumBuckets];		// the lateness of the steps for each drive
+};
+
+#endif
+
+#endif /* SRC_MOVEMENT_STEPTIMINGSTATS_H_ */
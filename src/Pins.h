@@ -48,6 +48,38 @@
 # define SUPPORT_NONLINEAR_EXTRUSION		1		// for now this is always enabled
 #endif
 
+#ifndef SUPPORT_MOTION_SHAPING
+# define SUPPORT_MOTION_SHAPING		(SAM4E || SAME70)	// S-curve acceleration uses floating point maths in the step ISR, so we only support it on processors with an FPU
+#endif
+
+#ifndef SUPPORT_NATIVE_ARCS
+# define SUPPORT_NATIVE_ARCS		(SAM4E || SAME70)	// arc step times are calculated using floating point maths in the step ISR, so we only support them on processors with an FPU
+#endif
+
+#ifndef SUPPORT_SEGMENT_FREE_MESH
+# define SUPPORT_SEGMENT_FREE_MESH	SUPPORT_NATIVE_ARCS	// mesh-following step times use the same floating point step time calculation as arcs
+#endif
+
+#if SUPPORT_SEGMENT_FREE_MESH && !SUPPORT_NATIVE_ARCS
+# error SUPPORT_SEGMENT_FREE_MESH requires SUPPORT_NATIVE_ARCS
+#endif
+
+#ifndef SUPPORT_ASYNC_MOVES
+# define SUPPORT_ASYNC_MOVES		(SAM4E || SAM4S || SAME70)	// each additional movement queue needs its own DDAs, so we don't support them on the older processors
+#endif
+
+#ifndef SUPPORT_FILE_READ_AHEAD
+# define SUPPORT_FILE_READ_AHEAD	(SAM4E || SAM4S || SAME70)	// the read-ahead buffers use too much RAM for the older processors
+#endif
+
+#ifndef SUPPORT_COMPACT_GCODE
+# define SUPPORT_COMPACT_GCODE		(SUPPORT_FILE_READ_AHEAD)	// the compact GCode decoder reads the file through the read-ahead buffers
+#endif
+
+#ifndef SUPPORT_STEP_TIMING_STATS
+# define SUPPORT_STEP_TIMING_STATS	(SAM4E || SAM4S || SAME70)	// the histograms need about 1K of RAM, so we don't support them on the older processors
+#endif
+
 #ifndef SUPPORT_WORKPLACE_COORDINATES
 # define SUPPORT_WORKPLACE_COORDINATES		0
 #endif
@@ -29,6 +29,7 @@
 #include "Network.h"
 #include "PrintMonitor.h"
 #include "FilamentMonitors/FilamentMonitor.h"
+#include "GCodes/GCodeBuffer.h"
 #include "RepRap.h"
 #include "Scanner.h"
 #include "Version.h"
@@ -459,6 +460,8 @@ void Platform::Init()
 	{
 		extruderDrivers[extr] = (uint8_t)(extr + MinAxes);		// set up default extruder drive mapping
 		SetPressureAdvance(extr, 0.0);							// no pressure advance
+		SetPressureAdvanceQuadratic(extr, 0.0);
+		SetPressureAdvanceSmoothingTime(extr, 0.0);
 #if SUPPORT_NONLINEAR_EXTRUSION
 		nonlinearExtrusionA[extr] = nonlinearExtrusionB[extr] = 0.0;
 		nonlinearExtrusionLimit[extr] = DefaultNonlinearExtrusionLimit;
@@ -2891,6 +2894,39 @@ void Platform::Diagnostics(MessageType mtype)
 #endif
 }
 
+// Format test number 'index' of range 'range' for the float parsing test. Each range covers every number of its format within the stated limits.
+// Range 0 is coordinates from -1999.999 to 1999.999, range 1 is extrusion amounts from -9.99999 to 9.99999 and range 2 is integer feed rates from 0 to 99999.
+static constexpr uint32_t FloatTestRangeSizes[] = { 2 * 2000000, 2 * 1000000, 100000 };
+
+static void FormatFloatTestNumber(const StringRef& str, unsigned int range, uint32_t index)
+{
+	const char * const sign = (index & 1) ? "-" : "";
+	const uint32_t val = index >> 1;
+	switch (range)
+	{
+	case 0:
+		str.printf("%s%" PRIu32 ".%03" PRIu32, sign, val/1000, val % 1000);
+		break;
+
+	case 1:
+		str.printf("%s%" PRIu32 ".%05" PRIu32, sign, val/100000, val % 100000);
+		break;
+
+	default:
+		str.printf("%" PRIu32, index);
+		break;
+	}
+}
+
+// Return true if FastStrtof and SafeStrtof agree about a string
+static bool FloatParsersAgree(const char *str)
+{
+	const char *endptr1, *endptr2;
+	const float f1 = SafeStrtof(str, &endptr1);
+	const float f2 = FastStrtof(str, &endptr2);
+	return f1 == f2 && std::signbit(f1) == std::signbit(f2) && endptr1 == endptr2;
+}
+
 GCodeResult Platform::DiagnosticTest(GCodeBuffer& gb, const StringRef& reply, int d)
 {
 	static const uint32_t dummy[2] = { 0, 0 };
@@ -3167,6 +3203,230 @@ GCodeResult Platform::DiagnosticTest(GCodeBuffer& gb, const StringRef& reply, in
 	case (int)DiagnosticTestType::TimeSDWrite:
 		return reprap.GetGCodes().StartSDTiming(gb, reply);
 
+	case (int)DiagnosticTestType::TimeStepScheduling:	// Show how long it takes to reschedule a drive after a step. The displayed values are subject to interrupts.
+		DDA::TimeStepScheduling(reply);
+		break;
+
+#if SUPPORT_STEP_TIMING_STATS
+	case (int)DiagnosticTestType::StepTimingStats:
+		if (gb.Seen('S'))
+		{
+			reprap.GetMove().GetStepTimingStats().Enable(gb.GetIValue() > 0);
+		}
+		else
+		{
+			reprap.GetMove().GetStepTimingStats().Report(reply);
+		}
+		break;
+#endif
+
+	case (int)DiagnosticTestType::TimeIncrementalSquareRoot:	// Check that the incremental square root gives the same step times as the full one and compare the times. The displayed values are subject to interrupts.
+		{
+			// Simulate a drive with 80 steps/mm accelerating from rest at 1000mm/sec^2, estimating each step time from the previous one in the same way as the step ISR
+			constexpr uint64_t twoCsquaredTimesMmPerStepDivA = ((uint64_t)StepTimer::StepClockRate * StepTimer::StepClockRate * 2)/(80 * 1000);
+			uint32_t tim1 = 0, tim2 = 0;
+			bool ok = true;
+			uint32_t lastStepTime = 0, lastStepInterval = 0;
+			for (uint32_t step = 1; step <= 1000; ++step)
+			{
+				const uint64_t num = twoCsquaredTimesMmPerStepDivA * step;
+				const uint32_t now1 = StepTimer::GetInterruptClocks();
+				const uint32_t stepTime1 = isqrt64(num);
+				tim1 += StepTimer::GetInterruptClocks() - now1;
+				const uint32_t now2 = StepTimer::GetInterruptClocks();
+				const uint32_t stepTime2 = isqrt64FromEstimate(num, lastStepTime + lastStepInterval);
+				tim2 += StepTimer::GetInterruptClocks() - now2;
+				if (stepTime2 != stepTime1)
+				{
+					ok = false;
+				}
+				lastStepInterval = stepTime2 - lastStepTime;
+				lastStepTime = stepTime2;
+			}
+			reply.printf("Step time square roots: full %.2fus, incremental %.2fus %s",
+					((double)tim1 * 1000)/StepTimer::StepClockRate, ((double)tim2 * 1000)/StepTimer::StepClockRate, (ok) ? "ok" : "ERROR");
+		}
+		break;
+
+	case (int)DiagnosticTestType::TimeDeltaSquareRoot:	// Check that the incremental square root gives the same delta carriage positions as the full one and compare the times. The displayed values are subject to interrupts.
+		{
+			// Simulate a tower at (0,120) with 250mm diagonals and 160 steps/mm while the effector moves along the X axis from (-80,0) to (80,0).
+			// The carriage rises about 2400 steps and then falls again. We estimate each square root from the previous two in the same way as the step ISR.
+			constexpr float stepsPerMm = 160.0;
+			constexpr int32_t K2 = 512;					// same scaling factor as DriveMovement uses
+			constexpr float A = -80.0, B = -120.0, diagonal = 250.0;
+			const float dSquaredMinusAsquaredMinusBsquared = fsquare(diagonal) - fsquare(A) - fsquare(B);
+			const int64_t dSquaredMinusAsquaredMinusBsquaredTimesKsquaredSsquared = roundS64(dSquaredMinusAsquaredMinusBsquared * fsquare(stepsPerMm * K2));
+			const int32_t t1 = roundS32(-A * stepsPerMm * K2);
+			const int32_t initialHmz0sK = roundS32(sqrtf(dSquaredMinusAsquaredMinusBsquared) * stepsPerMm * K2);
+			const int32_t stepsUp = (int32_t)((sqrtf(fsquare(diagonal) - fsquare(B)) - sqrtf(dSquaredMinusAsquaredMinusBsquared)) * stepsPerMm);
+			uint32_t tim1 = 0, tim2 = 0;
+			bool ok = true;
+			int32_t lastRoot = abs(t1), rootChangePerStep = 0;
+			for (int32_t step = 1; step <= 2 * stepsUp; ++step)
+			{
+				const int32_t hmz0sK = initialHmz0sK + K2 * ((step <= stepsUp) ? step : 2 * stepsUp - step);
+				const int64_t t2a = dSquaredMinusAsquaredMinusBsquaredTimesKsquaredSsquared - (int64_t)isquare64(hmz0sK) + (int64_t)isquare64(t1);
+				if (t2a <= 0)
+				{
+					continue;
+				}
+				const uint32_t now1 = StepTimer::GetInterruptClocks();
+				const int32_t root1 = (int32_t)isqrt64(t2a);
+				tim1 += StepTimer::GetInterruptClocks() - now1;
+				const uint32_t now2 = StepTimer::GetInterruptClocks();
+				const int32_t estimate = lastRoot + rootChangePerStep;
+				const int32_t root2 = (estimate > 0) ? (int32_t)isqrt64FromEstimate((uint64_t)t2a, (uint32_t)estimate) : (int32_t)isqrt64(t2a);
+				tim2 += StepTimer::GetInterruptClocks() - now2;
+				if (root2 != root1)
+				{
+					ok = false;
+				}
+				rootChangePerStep = root2 - lastRoot;
+				lastRoot = root2;
+			}
+			reply.printf("Delta square roots for %" PRIi32 " steps: full %.2fus, incremental %.2fus %s",
+					2 * stepsUp, ((double)tim1 * 1000)/StepTimer::StepClockRate, ((double)tim2 * 1000)/StepTimer::StepClockRate, (ok) ? "ok" : "ERROR");
+		}
+		break;
+
+	case (int)DiagnosticTestType::TimeGCodeParsing:	// Time how long it takes to parse typical slicer output and fetch the G1 parameters. The displayed values are subject to interrupts.
+		{
+			// These lines are taken from a sliced file
+			static const char * const TestLines[] =
+			{
+				"G1 X103.842 Y95.216 E0.03751",
+				"G1 F1800 X104.512 Y94.871 E0.02458",
+				"G1 X105.127 Y94.617 E.02164 ; perimeter",
+				"G1 E-.8 F2100",
+				"G0 F7200 X110.5 Y120.25",
+				"G1 Z.45 F600",
+				"G1 E.8 F2100",
+				"M204 S1000",
+				"G1 X98.331 Y101.004 E1.20522",
+				"G1 X97.74 Y101.56 E.02703",
+			};
+			constexpr unsigned int NumPasses = 100;
+			static const char * const G1Letters = "XYZEFS";
+
+			// Use a separate buffer so that we don't overwrite the command we are executing
+			static GCodeBuffer *testBuffer = nullptr;
+			if (testBuffer == nullptr)
+			{
+				testBuffer = new GCodeBuffer("test", GenericMessage, false);
+			}
+
+			volatile float total = 0.0;							// volatile to stop the compiler optimising the parameter reads away
+			const uint32_t now = StepTimer::GetInterruptClocks();
+			for (unsigned int pass = 0; pass < NumPasses; ++pass)
+			{
+				for (const char *line : TestLines)
+				{
+					testBuffer->Put(line);
+					for (const char *p = G1Letters; *p != 0; ++p)
+					{
+						if (testBuffer->Seen(*p))
+						{
+							total = total + testBuffer->GetFValue();
+						}
+					}
+					testBuffer->SetFinished(true);
+				}
+			}
+			const uint32_t tim = StepTimer::GetInterruptClocks() - now;
+			const unsigned int numLines = NumPasses * ARRAY_SIZE(TestLines);
+			reply.printf("Parsed %u lines in %.2fms, %.0f lines/sec", numLines, ((double)tim * 1000)/StepTimer::StepClockRate, ((double)numLines * StepTimer::StepClockRate)/tim);
+		}
+		break;
+
+	case (int)DiagnosticTestType::TimeFloatParsing:	// Check that FastStrtof gives the same results as SafeStrtof and compare the times. The displayed values are subject to interrupts.
+		if (gb.Seen('S') && gb.GetIValue() == 1)
+		{
+			// Check every number in each range. This takes a long time, so we check a batch of numbers each time we are called and return notFinished until we are done.
+			// If we haven't been called recently then this is a new test, not a continuation of the previous one.
+			constexpr uint32_t NumbersPerCall = 2000;
+			static unsigned int range = 0, numErrors = 0;
+			static uint32_t index = 0, numChecked = 0, lastCallMillis = 0;
+			static String<ShortScratchStringLength> firstError;
+
+			const uint32_t now = millis();
+			if (now - lastCallMillis > 1000)
+			{
+				range = 0;
+				index = 0;
+				numChecked = 0;
+				numErrors = 0;
+				firstError.Clear();
+			}
+			lastCallMillis = now;
+
+			String<ShortScratchStringLength> str;
+			for (uint32_t i = 0; i < NumbersPerCall && range < ARRAY_SIZE(FloatTestRangeSizes); ++i)
+			{
+				FormatFloatTestNumber(str.GetRef(), range, index);
+				++numChecked;
+				if (!FloatParsersAgree(str.c_str()))
+				{
+					if (numErrors == 0)
+					{
+						firstError.copy(str.c_str());
+					}
+					++numErrors;
+				}
+				++index;
+				if (index == FloatTestRangeSizes[range])
+				{
+					++range;
+					index = 0;
+				}
+			}
+
+			if (range < ARRAY_SIZE(FloatTestRangeSizes))
+			{
+				return GCodeResult::notFinished;
+			}
+
+			lastCallMillis = now - 2000;						// so that the next test starts afresh
+			reply.printf("Float parsing of all %" PRIu32 " numbers in the test ranges: %u mismatches %s", numChecked, numErrors, (numErrors == 0) ? "ok" : "ERROR");
+			if (numErrors != 0)
+			{
+				reply.catf(", first was %s", firstError.c_str());
+			}
+		}
+		else
+		{
+			// Time a sample of numbers in each range. We step through each range with a large odd stride, so that both signs occur and every digit position varies.
+			// The sample covers 0.05% of the coordinates, 0.1% of the extrusion amounts and 2% of the feed rates. Use S1 to check every number.
+			constexpr unsigned int NumbersPerRange = 2000;
+			uint32_t tim1 = 0, tim2 = 0;
+			unsigned int numChecked = 0, numErrors = 0;
+			String<ShortScratchStringLength> str;
+			for (unsigned int range = 0; range < ARRAY_SIZE(FloatTestRangeSizes); ++range)
+			{
+				for (uint32_t i = 0; i < NumbersPerRange; ++i)
+				{
+					FormatFloatTestNumber(str.GetRef(), range, (i * 4999) % FloatTestRangeSizes[range]);
+
+					const char *endptr1, *endptr2;
+					const uint32_t now1 = StepTimer::GetInterruptClocks();
+					const float f1 = SafeStrtof(str.c_str(), &endptr1);
+					tim1 += StepTimer::GetInterruptClocks() - now1;
+					const uint32_t now2 = StepTimer::GetInterruptClocks();
+					const float f2 = FastStrtof(str.c_str(), &endptr2);
+					tim2 += StepTimer::GetInterruptClocks() - now2;
+					++numChecked;
+					if (f1 != f2 || std::signbit(f1) != std::signbit(f2) || endptr1 != endptr2)
+					{
+						++numErrors;
+					}
+				}
+			}
+			reply.printf("Float parsing of %u sample numbers: library %.2fus, fast %.2fus per number, %u mismatches %s",
+					numChecked, ((double)tim1 * 1000000)/((double)StepTimer::StepClockRate * numChecked), ((double)tim2 * 1000000)/((double)StepTimer::StepClockRate * numChecked),
+					numErrors, (numErrors == 0) ? "ok" : "ERROR");
+		}
+		break;
+
 	case (int)DiagnosticTestType::PrintObjectSizes:
 		reply.printf(
 				"DDA %u, DM %u, Tool %u, GCodeBuffer %u, heater %u"
@@ -4511,6 +4771,22 @@ void Platform::SetPressureAdvance(size_t extruder, float factor)
 	}
 }
 
+void Platform::SetPressureAdvanceQuadratic(size_t extruder, float factor)
+{
+	if (extruder < MaxExtruders)
+	{
+		pressureAdvanceQuadratic[extruder] = factor;
+	}
+}
+
+void Platform::SetPressureAdvanceSmoothingTime(size_t extruder, float seconds)
+{
+	if (extruder < MaxExtruders)
+	{
+		pressureAdvanceSmoothingTime[extruder] = seconds;
+	}
+}
+
 #if SUPPORT_NONLINEAR_EXTRUSION
 
 bool Platform::GetExtrusionCoefficients(size_t extruder, float& a, float& b, float& limit) const
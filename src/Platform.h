@@ -213,6 +213,14 @@ enum class DiagnosticTestType : int
 	TimeSinCos = 103,				// do a timing test on the trig functions
 	TimeSDWrite = 104,				// do a write timing test on the SD card
 	PrintObjectSizes = 105,			// print the sizes of various objects
+	TimeStepScheduling = 106,		// do a timing test on scheduling the next step of a drive
+	TimeIncrementalSquareRoot = 107,	// check and time the incremental square root used to calculate step times
+#if SUPPORT_STEP_TIMING_STATS
+	StepTimingStats = 108,			// enable (S1), disable (S0) or report step ISR timing statistics
+#endif
+	TimeDeltaSquareRoot = 109,		// check and time the incremental square root used to calculate delta carriage positions
+	TimeGCodeParsing = 110,			// time how fast we can parse typical G1 commands
+	TimeFloatParsing = 111,			// check that the fast float parser gives the same results as the library one and compare the times
 
 	SetWriteBuffer = 500,			// enable/disable the write buffer
 
@@ -464,6 +472,10 @@ public:
 	float AxisTotalLength(size_t axis) const;
 	float GetPressureAdvance(size_t extruder) const;
 	void SetPressureAdvance(size_t extruder, float factor);
+	float GetPressureAdvanceQuadratic(size_t extruder) const;
+	void SetPressureAdvanceQuadratic(size_t extruder, float factor);
+	float GetPressureAdvanceSmoothingTime(size_t extruder) const;
+	void SetPressureAdvanceSmoothingTime(size_t extruder, float seconds);
 
 	void SetEndStopConfiguration(size_t axis, EndStopPosition endstopPos, EndStopInputType inputType)
 		pre(axis < MaxAxes);
@@ -800,6 +812,8 @@ private:
 	float driveStepsPerUnit[MaxTotalDrivers];
 	float instantDvs[MaxTotalDrivers];
 	float pressureAdvance[MaxExtruders];
+	float pressureAdvanceQuadratic[MaxExtruders];		// the coefficient of the square of the extrusion speed in the pressure advance
+	float pressureAdvanceSmoothingTime[MaxExtruders];	// the time constant of the first-order lag applied to the pressure advance
 #if SUPPORT_NONLINEAR_EXTRUSION
 	float nonlinearExtrusionA[MaxExtruders], nonlinearExtrusionB[MaxExtruders], nonlinearExtrusionLimit[MaxExtruders];
 #endif
@@ -1249,6 +1263,16 @@ inline float Platform::GetPressureAdvance(size_t extruder) const
 	return (extruder < MaxExtruders) ? pressureAdvance[extruder] : 0.0;
 }
 
+inline float Platform::GetPressureAdvanceQuadratic(size_t extruder) const
+{
+	return (extruder < MaxExtruders) ? pressureAdvanceQuadratic[extruder] : 0.0;
+}
+
+inline float Platform::GetPressureAdvanceSmoothingTime(size_t extruder) const
+{
+	return (extruder < MaxExtruders) ? pressureAdvanceSmoothingTime[extruder] : 0.0;
+}
+
 // This is called by the tick ISR to get the raw Z probe reading to feed to the filter
 inline uint16_t Platform::GetRawZProbeReading() const
 {
@@ -256,6 +256,65 @@ double HideNan(float val)
 	return (double)((std::isnan(val) || std::isinf(val)) ? 9999.9 : val);
 }
 
+// Convert a decimal number to a float.
+// Numbers in GCode have few significant digits and no exponent, so usually the digits fit in a float mantissa exactly and the number of decimal places
+// is small enough for the power of 10 to be exact too. A single division then gives the correctly-rounded result. Anything else is passed to SafeStrtof.
+float FastStrtof(const char *p, const char **endptr)
+{
+	static constexpr float PowersOfTen[] = { 1.0e0, 1.0e1, 1.0e2, 1.0e3, 1.0e4, 1.0e5, 1.0e6, 1.0e7, 1.0e8, 1.0e9, 1.0e10 };
+	constexpr uint32_t MaxExactMantissa = 1u << 24;
+
+	const char *q = p;
+	const bool negative = (*q == '-');
+	if (negative || *q == '+')
+	{
+		++q;
+	}
+
+	uint32_t mantissa = 0;
+	unsigned int numDecimals = 0;
+	bool seenDigit = false, seenPoint = false;
+	for (;;)
+	{
+		const char c = *q;
+		if (isdigit(c))
+		{
+			if (mantissa >= MaxExactMantissa)
+			{
+				return SafeStrtof(p, endptr);					// too many significant digits
+			}
+			mantissa = (10 * mantissa) + (c - '0');
+			seenDigit = true;
+			if (seenPoint)
+			{
+				++numDecimals;
+			}
+		}
+		else if (c == '.' && !seenPoint)
+		{
+			seenPoint = true;
+		}
+		else
+		{
+			break;
+		}
+		++q;
+	}
+
+	// Leave anything unusual to the library function, including exponents, hex numbers, leading spaces, infinity and NaN
+	if (!seenDigit || mantissa > MaxExactMantissa || numDecimals >= ARRAY_SIZE(PowersOfTen) || *q == 'e' || *q == 'E' || *q == 'x' || *q == 'X')
+	{
+		return SafeStrtof(p, endptr);
+	}
+
+	if (endptr != nullptr)
+	{
+		*endptr = q;
+	}
+	const float val = (float)mantissa/PowersOfTen[numDecimals];
+	return (negative) ? -val : val;
+}
+
 // Append a list of driver numbers to a string, with a space before each one
 void ListDrivers(const StringRef& str, DriversBitmap drivers)
 {
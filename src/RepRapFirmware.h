@@ -167,6 +167,7 @@ inline void delay(uint32_t ms)
 #endif
 
 double HideNan(float val);
+float FastStrtof(const char *p, const char **endptr = nullptr);
 
 void ListDrivers(const StringRef& str, DriversBitmap drivers);
 
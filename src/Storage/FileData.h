@@ -8,9 +8,13 @@
 #ifndef FILEDATA_H_
 #define FILEDATA_H_
 
+#include "RepRapFirmware.h"
 #include "FileStore.h"
 
 class FileGCodeInput;
+#if SUPPORT_COMPACT_GCODE
+class CompactFileGCodeInput;
+#endif
 
 // Small class to hold an open file and data relating to it.
 // This is designed so that files are never left open and we never duplicate a file reference.
@@ -18,8 +22,11 @@ class FileData
 {
 public:
 	friend class FileGCodeInput;
+#if SUPPORT_COMPACT_GCODE
+	friend class CompactFileGCodeInput;
+#endif
 
-	FileData() : f(nullptr) {}
+	FileData() { Init(); }
 
 	// Set this to refer to a newly-opened file
 	void Set(FileStore* pfile)
@@ -35,7 +42,7 @@ public:
 		if (f != nullptr)
 		{
 			bool ok = f->Close();
-			f = nullptr;
+			Init();
 			return ok;
 		}
 		return false;
@@ -102,6 +109,9 @@ public:
 	{
 		Close();
 		f = other.f;
+#if SUPPORT_COMPACT_GCODE
+		compactFormat = other.compactFormat;
+#endif
 		if (f != nullptr)
 		{
 			f->Duplicate();
@@ -113,15 +123,28 @@ public:
 	{
 		Close();
 		f = other.f;
+#if SUPPORT_COMPACT_GCODE
+		compactFormat = other.compactFormat;
+#endif
 		other.Init();
 	}
 
 private:
+#if SUPPORT_COMPACT_GCODE
+	enum class CompactFormat : uint8_t { unknown, notCompact, compact };
+#endif
+
 	FileStore *f;
+#if SUPPORT_COMPACT_GCODE
+	CompactFormat compactFormat;						// Whether CompactFileGCodeInput has checked the header of the file and found it to be in compact format
+#endif
 
 	void Init()
 	{
 		f = nullptr;
+#if SUPPORT_COMPACT_GCODE
+		compactFormat = CompactFormat::unknown;
+#endif
 	}
 
 	// Private assignment operator to prevent us assigning these objects
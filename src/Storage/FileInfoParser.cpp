@@ -11,6 +11,11 @@
 #include "Platform.h"
 #include "PrintMonitor.h"
 #include "GCodes/GCodes.h"
+#include "GCodes/GCodeInput.h"
+
+#if SUPPORT_COMPACT_GCODE
+static_assert(GCODE_READ_SIZE % CompactFileGCodeInput::CompactGCodeBlockSize == 0, "Compact files must be read in whole blocks");
+#endif
 
 void GCodeFileInfo::Init()
 {
@@ -77,6 +82,9 @@ bool FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& info, bool
 		// File has been opened, let's start now
 		filenameBeingParsed.copy(filePath);
 		fileOverlapLength = 0;
+#if SUPPORT_COMPACT_GCODE
+		parsingCompactFile = false;
+#endif
 
 		// Set up the info struct
 		parsedFileInfo.Init();
@@ -93,7 +101,11 @@ bool FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& info, bool
 
 		// If the file is empty or not a G-Code file, we don't need to parse anything
 		if (fileBeingParsed->Length() == 0 || (!StringEndsWithIgnoreCase(filePath, ".gcode") && !StringEndsWithIgnoreCase(filePath, ".g")
-					&& !StringEndsWithIgnoreCase(filePath, ".gco") && !StringEndsWithIgnoreCase(filePath, ".gc")))
+					&& !StringEndsWithIgnoreCase(filePath, ".gco") && !StringEndsWithIgnoreCase(filePath, ".gc")
+#if SUPPORT_COMPACT_GCODE
+					&& !StringEndsWithIgnoreCase(filePath, ".cgc")
+#endif
+		   ))
 		{
 			fileBeingParsed->Close();
 			parsedFileInfo.incomplete = false;
@@ -128,6 +140,9 @@ bool FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& info, bool
 				}
 
 				uint32_t startTime = millis();
+#if SUPPORT_COMPACT_GCODE
+				const FilePosition readPos = fileBeingParsed->Position();
+#endif
 				const int nbytes = fileBeingParsed->Read(&buf[fileOverlapLength], sizeToRead);
 				if (nbytes != (int)sizeToRead)
 				{
@@ -137,6 +152,17 @@ bool FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& info, bool
 					info = parsedFileInfo;
 					return true;
 				}
+#if SUPPORT_COMPACT_GCODE
+				// Compact files hold the moves in binary, so convert what we read to text. We read from multiples of GCODE_READ_SIZE, which are block boundaries.
+				if (readPos == 0)
+				{
+					parsingCompactFile = CompactFileGCodeInput::IsCompactHeader(&buf[fileOverlapLength], sizeToRead);
+				}
+				if (parsingCompactFile)
+				{
+					sizeToScan = fileOverlapLength + CompactFileGCodeInput::ConvertToText(&buf[fileOverlapLength], sizeToRead, readPos);
+				}
+#endif
 				buf[sizeToScan] = 0;
 
 				// Record performance data
@@ -199,8 +225,8 @@ bool FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& info, bool
 				else
 				{
 					// No - copy the last chunk of the buffer for overlapping search
-					fileOverlapLength = min<size_t>(sizeToRead, GCODE_OVERLAP_SIZE);
-					memcpy(buf, &buf[sizeToRead - fileOverlapLength], fileOverlapLength);
+					fileOverlapLength = min<size_t>(sizeToScan, GCODE_OVERLAP_SIZE);
+					memmove(buf, &buf[sizeToScan - fileOverlapLength], fileOverlapLength);
 				}
 			}
 			break;
@@ -263,6 +289,15 @@ bool FileInfoParser::GetFileInfo(const char *filePath, GCodeFileInfo& info, bool
 					info = parsedFileInfo;
 					return true;
 				}
+#if SUPPORT_COMPACT_GCODE
+				if (parsingCompactFile)
+				{
+					// Convert the records to text and move the overlap from the previous chunk down to follow it
+					const size_t textLength = CompactFileGCodeInput::ConvertToText(buf, sizeToRead, nextSeekPos);
+					memmove(&buf[textLength], &buf[sizeToRead], fileOverlapLength);
+					sizeToScan = textLength + fileOverlapLength;
+				}
+#endif
 				buf[sizeToScan] = 0;
 
 				// Record performance data
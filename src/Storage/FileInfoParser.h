@@ -87,6 +87,9 @@ private:
 	uint32_t lastFileParseTime;
 	uint32_t accumulatedParseTime, accumulatedReadTime, accumulatedSeekTime;
 	size_t fileOverlapLength;
+#if SUPPORT_COMPACT_GCODE
+	bool parsingCompactFile;													// True if the file is in compact format, so we convert what we read to text
+#endif
 
 	// We used to allocate the following buffer on the stack; but now that this is called by more than one task
 	// it is more economical to allocate it permanently because that lets us use smaller stacks.
@@ -117,6 +117,8 @@ Tool * Tool::freelist = nullptr;
 	t->heaterFault = false;
 	t->axisOffsetsProbed = 0;
 	t->displayColdExtrudeWarning = false;
+	t->maxVolumetricFlow = t->maxFilamentSpeed = 0.0;
+	t->filamentDiameter = DefaultFilamentDiameter;
 
 	for (size_t axis = 0; axis < MaxAxes; axis++)
 	{
@@ -267,6 +269,14 @@ float Tool::MaxFeedrate() const
 	return result;
 }
 
+// Set the maximum volumetric flow rate in mm^3/sec and the filament diameter in mm. A flow rate of zero means there is no limit.
+void Tool::SetMaxVolumetricFlow(float flow, float diameter)
+{
+	maxVolumetricFlow = flow;
+	filamentDiameter = diameter;
+	maxFilamentSpeed = (flow > 0.0) ? flow/(fsquare(diameter) * (Pi * 0.25)) : 0.0;
+}
+
 // There is a temperature fault on a heater, so disable all tools using that heater.
 // This function must be called for the first entry in the linked list.
 void Tool::FlagTemperatureFault(int8_t heater)
@@ -68,6 +68,10 @@ public:
 	void DefineMix(const float m[]);
 	const float* GetMix() const;
 	float MaxFeedrate() const;
+	float GetMaxVolumetricFlow() const { return maxVolumetricFlow; }
+	float GetFilamentDiameter() const { return filamentDiameter; }
+	float GetMaxFilamentSpeed() const { return maxFilamentSpeed; }	// Return the total extrusion speed allowed by the maximum volumetric flow, or 0 if there is no limit
+	void SetMaxVolumetricFlow(float flow, float diameter);
 	void Print(const StringRef& reply) const;
 	AxesBitmap GetXAxisMap() const { return xMapping; }
 	AxesBitmap GetYAxisMap() const { return yMapping; }
@@ -114,6 +118,9 @@ private:
 	float mix[MaxExtrudersPerTool];
 	float activeTemperatures[MaxHeatersPerTool];
 	float standbyTemperatures[MaxHeatersPerTool];
+	float maxVolumetricFlow;									// the maximum volumetric flow rate in mm^3/sec, or 0 if there is no limit
+	float filamentDiameter;										// the filament diameter used to convert the flow rate to an extrusion speed
+	float maxFilamentSpeed;										// the extrusion speed in mm/sec corresponding to the maximum volumetric flow rate
 	uint8_t driveCount;
 	uint8_t heaterCount;
 	uint16_t myNumber;